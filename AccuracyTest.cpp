@@ -0,0 +1,71 @@
+//
+//  AccuracyTest.cpp
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "GaussianAccuracy.h"
+#include "GameModel.h"
+#include "TruncatedGaussianCorrectionTables.h"
+
+#include <stdio.h>
+
+// Checks the documented error bounds: every GaussianAccuracy tier against GaussianAccuracyTiers::Guarantee
+// and the correction tables of the default game against the bounds in TruncatedGaussianCorrectionTables.h.
+// Exits with 1 when one is exceeded, run by ctest.
+
+namespace
+{
+    const int TIER_SAMPLES_PER_UNIT = 64;
+    const int TABLE_SAMPLES_PER_CELL = 16;
+
+    bool Check(const char* label, const char* name, double measured, double bound)
+    {
+        bool within = measured <= bound;
+        printf("%-6s %-22s %10.2e %10.2e%s\n", label, name, measured, bound, within ? "" : "  FAILED");
+        return within;
+    }
+}
+
+int main()
+{
+    bool success = true;
+    printf("%-6s %-22s %10s %10s\n", "", "", "measured", "bound");
+
+    for (int tier = 0; tier < GAUSSIAN_ACCURACY_COUNT; tier++)
+    {
+        GaussianAccuracy accuracy = (GaussianAccuracy) tier;
+        const char* label = GaussianAccuracyTiers::Name(accuracy);
+        GaussianAccuracyTiers::MaximumError guarantee = GaussianAccuracyTiers::Guarantee(accuracy);
+        GaussianAccuracyTiers::MaximumError measured = GaussianAccuracyTiers::MeasureMaximumError(accuracy, TIER_SAMPLES_PER_UNIT);
+
+        bool tierWithin = Check(label, "erfc (relative)", measured.errorFunction, guarantee.errorFunction);
+        tierWithin = Check(label, "inverse erfc", measured.inverseErrorFunction, guarantee.inverseErrorFunction) && tierWithin;
+        tierWithin = Check(label, "VExceedsMargin", measured.vExceedsMargin, guarantee.vExceedsMargin) && tierWithin;
+        tierWithin = Check(label, "WExceedsMargin", measured.wExceedsMargin, guarantee.wExceedsMargin) && tierWithin;
+        tierWithin = Check(label, "VWithinMargin", measured.vWithinMargin, guarantee.vWithinMargin) && tierWithin;
+        tierWithin = Check(label, "WWithinMargin", measured.wWithinMargin, guarantee.wWithinMargin) && tierWithin;
+
+        // same sweep, this is what callers of Verify get
+        if (GaussianAccuracyTiers::Verify(accuracy, TIER_SAMPLES_PER_UNIT) != tierWithin)
+        {
+            printf("%-6s Verify disagrees with the sweep\n", label);
+            tierWithin = false;
+        }
+        success = success && tierWithin;
+    }
+
+    GameModel model;
+    model.UseCorrectionTables();
+    TruncatedGaussianCorrectionTables::MaximumError tables = model.CorrectionTables()->MeasureMaximumError(TABLE_SAMPLES_PER_CELL);
+
+    success = Check("tables", "VExceedsMargin", tables.vExceedsMargin, 6.3e-10) && success;
+    success = Check("tables", "WExceedsMargin", tables.wExceedsMargin, 1.2e-09) && success;
+    success = Check("tables", "VWithinMargin", tables.vWithinMargin, 1.1e-08) && success;
+    success = Check("tables", "WWithinMargin", tables.wWithinMargin, 5.5e-09) && success;
+
+    printf("\n%s\n", success ? "all bounds hold" : "bounds exceeded");
+    return success ? 0 : 1;
+}
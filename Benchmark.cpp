@@ -0,0 +1,756 @@
+//
+//  Benchmark.cpp
+//  Skills
+//
+//  Created by KleMiX on 23/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "RatingCalculator.h"
+#include "Instrumentation.h"
+#include "RatingCalculatorCore.h"
+#include "RatingMatrix.h"
+#include "TeamRatingCalculator.h"
+#include "ParallelReplay.h"
+#include "ShardedRatingService.h"
+#include "SimdKernels.h"
+#include "TruncatedGaussianCorrectionFunctions.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of the math hot path and end to end replays of a simple simulation at growing player
+// counts. Every result is reported as ns per operation, --save-baseline stores them and --baseline compares
+// a later run against the stored numbers and fails when anything got slower than the threshold.
+//
+//   Benchmark [--quick] [--filter text] [--threads n] [--max-players n]
+//             [--save-baseline file] [--baseline file] [--threshold percent]
+
+namespace
+{
+    const size_t INPUT_COUNT = 4096;    // fits in L1/L2, so the micro numbers measure the math and not memory
+    const size_t ATTACKS_PER_PLAYER = 100;
+    const size_t MAXIMUM_SIMULATION_MATCHES = 16 * 1024 * 1024;   // big simulations get fewer attacks per player
+    const int SHARD_COUNT_STEPS = 4;    // ShardedRatingService with 1, 2, 4 and 8 shards
+    const size_t SHARDED_BATCH = 64 * 1024;
+
+    struct Options
+    {
+        double minimumSeconds;
+        const char* filter;
+        size_t threadCount;
+        size_t maximumPlayers;
+        const char* saveBaseline;
+        const char* baseline;
+        double threshold;
+
+        Options() : minimumSeconds(0.25), filter(NULL), threadCount(0), maximumPlayers(4 * 1024 * 1024),
+                    saveBaseline(NULL), baseline(NULL), threshold(10.0) { }
+    };
+
+    struct Result
+    {
+        std::string name;
+        double nanosecondsPerOperation;
+        double operationsPerSecond;
+        const char* unit;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    // keeps the compiler from dropping the benchmarked work
+    volatile double sink;
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    bool Selected(const Options& options, const char* name)
+    {
+        return !options.filter || strstr(name, options.filter) != NULL;
+    }
+
+    void Report(std::vector<Result>& results, const char* name, double seconds, double operations, const char* unit)
+    {
+        Result result;
+        result.name = name;
+        result.nanosecondsPerOperation = seconds * 1e9 / operations;
+        result.operationsPerSecond = operations / seconds;
+        result.unit = unit;
+        results.push_back(result);
+
+        printf("%-48s %12.2f ns/op %16.0f %s/s\n", name, result.nanosecondsPerOperation, result.operationsPerSecond, unit);
+        fflush(stdout);
+    }
+
+    // Runs body(repetitions) with doubling repetition counts until one run takes long enough, body returns
+    // the number of operations it did
+    void RunMicro(const Options& options, std::vector<Result>& results, const char* name, const std::function<double(size_t)>& body)
+    {
+        if (!Selected(options, name))
+        {
+            return;
+        }
+
+        body(1);    // warm up caches and lazily built tables
+
+        for (size_t repetitions = 1; ; repetitions *= 2)
+        {
+            Clock::time_point start = Clock::now();
+            double operations = body(repetitions);
+            double seconds = SecondsSince(start);
+
+            if (seconds >= options.minimumSeconds || repetitions >= (size_t) 1 << 30)
+            {
+                Report(results, name, seconds, operations, "op");
+                return;
+            }
+        }
+    }
+
+    struct Inputs
+    {
+        std::vector<double> uniform;            // (-6, 6), arguments of the Gaussian functions
+        std::vector<double> probability;        // (0, 1)
+        std::vector<double> meanDelta;          // winner minus loser mean
+        std::vector<double> drawMargin;         // normalized margins of the default game
+        std::vector<double> c;
+        std::vector<Rating> ratings;
+    };
+
+    Inputs MakeInputs()
+    {
+        std::mt19937_64 random(42);
+        std::uniform_real_distribution<double> uniform(-6.0, 6.0);
+        std::uniform_real_distribution<double> probability(1e-6, 1.0 - 1e-6);
+        std::normal_distribution<double> mean(25.0, 8.0);
+        std::uniform_real_distribution<double> standardDeviation(1.0, 25.0 / 3.0);
+
+        const GameModel& model = GameModel::Default();
+
+        Inputs inputs;
+        for (size_t i = 0; i < INPUT_COUNT; i++)
+        {
+            Rating player1(mean(random), standardDeviation(random));
+            Rating player2(mean(random), standardDeviation(random));
+            double c = sqrt(player1.standardDeviation * player1.standardDeviation +
+                            player2.standardDeviation * player2.standardDeviation + model.twoBetaSquared);
+
+            inputs.uniform.push_back(uniform(random));
+            inputs.probability.push_back(probability(random));
+            inputs.meanDelta.push_back(player1.mean - player2.mean);
+            inputs.drawMargin.push_back(model.drawMargin / c);
+            inputs.c.push_back(c);
+            inputs.ratings.push_back(player1);
+            inputs.ratings.push_back(player2);
+        }
+        return inputs;
+    }
+
+    // Scalar function of one input array
+    std::function<double(size_t)> Unary(const std::vector<double>& input, double (*function)(double))
+    {
+        return [&input, function](size_t repetitions)
+        {
+            double sum = 0;
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                for (size_t i = 0; i < input.size(); i++)
+                {
+                    sum += function(input[i]);
+                }
+            }
+            sink = sum;
+            return (double) repetitions * input.size();
+        };
+    }
+
+    // One of the three argument corrections the calculator uses
+    std::function<double(size_t)> Correction(const Inputs& inputs, double (*function)(double, double, double))
+    {
+        const GameModel& model = GameModel::Default();
+        return [&inputs, &model, function](size_t repetitions)
+        {
+            double sum = 0;
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                for (size_t i = 0; i < INPUT_COUNT; i++)
+                {
+                    sum += function(inputs.meanDelta[i], model.drawMargin, inputs.c[i]);
+                }
+            }
+            sink = sum;
+            return (double) repetitions * INPUT_COUNT;
+        };
+    }
+
+    // Array kernel of SimdKernels over the input arrays
+    std::function<double(size_t)> Kernel(const std::vector<double>& input, void (*kernel)(const double*, double*, size_t))
+    {
+        return [&input, kernel](size_t repetitions)
+        {
+            std::vector<double> output(input.size());
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                kernel(input.data(), output.data(), input.size());
+            }
+            sink = output[0];
+            return (double) repetitions * input.size();
+        };
+    }
+
+    std::function<double(size_t)> CorrectionKernel(const Inputs& inputs, void (*kernel)(const double*, const double*, double*, size_t))
+    {
+        return [&inputs, kernel](size_t repetitions)
+        {
+            std::vector<double> t(INPUT_COUNT);
+            std::vector<double> output(INPUT_COUNT);
+            for (size_t i = 0; i < INPUT_COUNT; i++)
+            {
+                t[i] = inputs.meanDelta[i] / inputs.c[i];
+            }
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                kernel(t.data(), inputs.drawMargin.data(), output.data(), INPUT_COUNT);
+            }
+            sink = output[0];
+            return (double) repetitions * INPUT_COUNT;
+        };
+    }
+
+    void RunMicroBenchmarks(const Options& options, std::vector<Result>& results)
+    {
+        static Inputs inputs = MakeInputs();
+
+        RunMicro(options, results, "ErrorFunctionCumulativeTo", Unary(inputs.uniform, GaussianDistribution::ErrorFunctionCumulativeTo));
+        RunMicro(options, results, "CumulativeTo", Unary(inputs.uniform, GaussianDistribution::CumulativeTo));
+        RunMicro(options, results, "InverseCumulativeTo", Unary(inputs.probability, GaussianDistribution::InverseCumulativeTo));
+        RunMicro(options, results, "At", Unary(inputs.uniform, GaussianDistribution::At));
+
+        for (int a = GAUSSIAN_ACCURACY_HIGH; a < GAUSSIAN_ACCURACY_COUNT; a++)
+        {
+            GaussianAccuracy accuracy = (GaussianAccuracy) a;
+            std::string tier = std::string(" [") + GaussianAccuracyTiers::Name(accuracy) + "]";
+            RunMicro(options, results, ("CumulativeTo" + tier).c_str(), [accuracy](size_t repetitions)
+            {
+                double sum = 0;
+                for (size_t r = 0; r < repetitions; r++)
+                {
+                    for (size_t i = 0; i < inputs.uniform.size(); i++)
+                    {
+                        sum += GaussianDistribution::CumulativeTo(inputs.uniform[i], accuracy);
+                    }
+                }
+                sink = sum;
+                return (double) repetitions * inputs.uniform.size();
+            });
+            RunMicro(options, results, ("InverseCumulativeTo" + tier).c_str(), [accuracy](size_t repetitions)
+            {
+                double sum = 0;
+                for (size_t r = 0; r < repetitions; r++)
+                {
+                    for (size_t i = 0; i < inputs.probability.size(); i++)
+                    {
+                        sum += GaussianDistribution::InverseCumulativeTo(inputs.probability[i], accuracy);
+                    }
+                }
+                sink = sum;
+                return (double) repetitions * inputs.probability.size();
+            });
+        }
+
+        RunMicro(options, results, "VExceedsMargin", Correction(inputs, TruncatedGaussianCorrectionFunctions::VExceedsMargin));
+        RunMicro(options, results, "WExceedsMargin", Correction(inputs, TruncatedGaussianCorrectionFunctions::WExceedsMargin));
+        RunMicro(options, results, "VWithinMargin", Correction(inputs, TruncatedGaussianCorrectionFunctions::VWithinMargin));
+        RunMicro(options, results, "WWithinMargin", Correction(inputs, TruncatedGaussianCorrectionFunctions::WWithinMargin));
+
+        std::string simd = std::string(" [") + SimdKernels::InstructionSetName(SimdKernels::ActiveInstructionSet()) + "]";
+        RunMicro(options, results, ("SimdKernels::ErrorFunctionCumulativeTo" + simd).c_str(),
+                 Kernel(inputs.uniform, SimdKernels::ErrorFunctionCumulativeTo));
+        RunMicro(options, results, ("SimdKernels::CumulativeTo" + simd).c_str(), Kernel(inputs.uniform, SimdKernels::CumulativeTo));
+        RunMicro(options, results, ("SimdKernels::VExceedsMargin" + simd).c_str(), CorrectionKernel(inputs, SimdKernels::VExceedsMargin));
+        RunMicro(options, results, ("SimdKernels::WWithinMargin" + simd).c_str(), CorrectionKernel(inputs, SimdKernels::WWithinMargin));
+        RunMicro(options, results, ("SimdKernels::InflateStandardDeviations" + simd).c_str(), [&](size_t repetitions)
+        {
+            std::vector<double> standardDeviation(INPUT_COUNT);
+            std::vector<uint64_t> lastPlayed(INPUT_COUNT);
+            std::vector<double> output(INPUT_COUNT);
+            for (size_t i = 0; i < INPUT_COUNT; i++)
+            {
+                standardDeviation[i] = inputs.ratings[i].standardDeviation;
+                lastPlayed[i] = i * 97 % INPUT_COUNT;
+            }
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                SimdKernels::InflateStandardDeviations(standardDeviation.data(), lastPlayed.data(), INPUT_COUNT, 0.0025, 25.0 / 3.0,
+                                                       output.data(), INPUT_COUNT);
+            }
+            sink = output[0];
+            return (double) repetitions * INPUT_COUNT;
+        });
+
+        const GameModel& model = GameModel::Default();
+        static GameModel tableModel;
+        if (!tableModel.CorrectionTables())
+        {
+            tableModel.UseCorrectionTables();
+        }
+
+        RunMicro(options, results, "CalculateWinChance", [&](size_t repetitions)
+        {
+            double sum = 0;
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                for (size_t i = 0; i < INPUT_COUNT; i++)
+                {
+                    sum += RatingCalculator::CalculateWinChance(model, inputs.ratings[2 * i], inputs.ratings[2 * i + 1]);
+                }
+            }
+            sink = sum;
+            return (double) repetitions * INPUT_COUNT;
+        });
+
+        RunMicro(options, results, "CalculateMatchQuality", [&](size_t repetitions)
+        {
+            double sum = 0;
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                for (size_t i = 0; i < INPUT_COUNT; i++)
+                {
+                    sum += RatingCalculator::CalculateMatchQuality(model, inputs.ratings[2 * i], inputs.ratings[2 * i + 1]);
+                }
+            }
+            sink = sum;
+            return (double) repetitions * INPUT_COUNT;
+        });
+
+        // ratings are copied every time so the inputs don't drift over the repetitions
+        RunMicro(options, results, "CalculateNewRatings", [&](size_t repetitions)
+        {
+            double sum = 0;
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                for (size_t i = 0; i < INPUT_COUNT; i++)
+                {
+                    Rating player1 = inputs.ratings[2 * i];
+                    Rating player2 = inputs.ratings[2 * i + 1];
+                    RatingCalculator::CalculateNewRatings(model, player1, player2, (int) (i % 3), 1);
+                    sum += player1.mean + player2.standardDeviation;
+                }
+            }
+            sink = sum;
+            return (double) repetitions * INPUT_COUNT;
+        });
+
+        RunMicro(options, results, "CalculateNewRatings [tables]", [&](size_t repetitions)
+        {
+            double sum = 0;
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                for (size_t i = 0; i < INPUT_COUNT; i++)
+                {
+                    Rating player1 = inputs.ratings[2 * i];
+                    Rating player2 = inputs.ratings[2 * i + 1];
+                    RatingCalculator::CalculateNewRatings(tableModel, player1, player2, (int) (i % 3), 1);
+                    sum += player1.mean + player2.standardDeviation;
+                }
+            }
+            sink = sum;
+            return (double) repetitions * INPUT_COUNT;
+        });
+
+        for (int a = GAUSSIAN_ACCURACY_HIGH; a < GAUSSIAN_ACCURACY_COUNT; a++)
+        {
+            GameModel tierModel;
+            tierModel.UseAccuracy((GaussianAccuracy) a);
+            std::string name = std::string("CalculateNewRatings [") + GaussianAccuracyTiers::Name(tierModel.Accuracy()) + "]";
+            RunMicro(options, results, name.c_str(), [tierModel](size_t repetitions)
+            {
+                double sum = 0;
+                for (size_t r = 0; r < repetitions; r++)
+                {
+                    for (size_t i = 0; i < INPUT_COUNT; i++)
+                    {
+                        Rating player1 = inputs.ratings[2 * i];
+                        Rating player2 = inputs.ratings[2 * i + 1];
+                        RatingCalculator::CalculateNewRatings(tierModel, player1, player2, (int) (i % 3), 1);
+                        sum += player1.mean + player2.standardDeviation;
+                    }
+                }
+                sink = sum;
+                return (double) repetitions * INPUT_COUNT;
+            });
+        }
+
+        RunMicro(options, results, "CalculateNewRatings [fixed model]", [&](size_t repetitions)
+        {
+            DefaultFixedGameModel fixedModel;
+            double sum = 0;
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                for (size_t i = 0; i < INPUT_COUNT; i++)
+                {
+                    Rating player1 = inputs.ratings[2 * i];
+                    Rating player2 = inputs.ratings[2 * i + 1];
+                    RatingCalculator::CalculateNewRatings(fixedModel, player1, player2, (int) (i % 3), 1);
+                    sum += player1.mean + player2.standardDeviation;
+                }
+            }
+            sink = sum;
+            return (double) repetitions * INPUT_COUNT;
+        });
+
+        RunMicro(options, results, "TeamRatingCalculator 5v5", [&](size_t repetitions)
+        {
+            int teamSizes[2] = {5, 5};
+            double sum = 0;
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                for (size_t i = 0; i + 10 <= 2 * INPUT_COUNT; i += 10)
+                {
+                    Rating ratings[10];
+                    std::copy(&inputs.ratings[i], &inputs.ratings[i] + 10, ratings);
+                    int teamRanks[2] = {(int) (i % 3), 1};
+                    TeamRatingCalculator::CalculateNewRatings(model, ratings, teamSizes, teamRanks, 2);
+                    sum += ratings[0].mean;
+                }
+            }
+            sink = sum;
+            return (double) repetitions * (2 * INPUT_COUNT / 10);
+        });
+
+        RunMicro(options, results, "RatingMatrix::CalculateMatchQualities 64x64", [&](size_t repetitions)
+        {
+            std::vector<double> output(INPUT_COUNT);
+            for (size_t r = 0; r < repetitions; r++)
+            {
+                RatingMatrix::CalculateMatchQualities(model, inputs.ratings.data(), 64, inputs.ratings.data() + 64, 64, output.data());
+            }
+            sink = output[0];
+            return (double) repetitions * INPUT_COUNT;
+        });
+    }
+
+    // Simple simulation: every player attacks ATTACKS_PER_PLAYER random opponents, the one with more
+    // luck wins
+    std::vector<MatchRecord> MakeSimulation(size_t playerCount)
+    {
+        size_t attacks = std::max(std::min(ATTACKS_PER_PLAYER, MAXIMUM_SIMULATION_MATCHES / playerCount), (size_t) 1);
+
+        std::mt19937_64 random(playerCount);
+        std::vector<int> luck(playerCount);
+        for (size_t i = 0; i < playerCount; i++)
+        {
+            luck[i] = (int) (random() % 10);
+        }
+
+        std::vector<MatchRecord> matches;
+        matches.reserve(playerCount * attacks);
+        for (size_t i = 0; i < playerCount; i++)
+        {
+            for (size_t j = 0; j < attacks; j++)
+            {
+                size_t opponent = random() % playerCount;
+                if (opponent != i)
+                {
+                    bool won = luck[i] >= luck[opponent];
+                    matches.push_back(MatchRecord((int) i, (int) opponent, won ? 1 : 0, won ? 0 : 1));
+                }
+            }
+        }
+        return matches;
+    }
+
+    void RunScenario(const Options& options, std::vector<Result>& results, const char* name,
+                     const std::function<void()>& prepare, const std::function<void()>& body, double updates)
+    {
+        if (!Selected(options, name))
+        {
+            return;
+        }
+
+        // best of three, the first run also pages everything in
+        double best = 0;
+        for (int run = 0; run < 3; run++)
+        {
+            prepare();
+            Clock::time_point start = Clock::now();
+            body();
+            double seconds = SecondsSince(start);
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+
+        Report(results, name, best, updates, "update");
+    }
+
+    void RunScenarios(const Options& options, std::vector<Result>& results, ThreadPool& pool)
+    {
+        const GameModel& model = GameModel::Default();
+
+        for (size_t playerCount = 256; playerCount <= options.maximumPlayers; playerCount *= 16)
+        {
+            char prefix[64];
+            snprintf(prefix, sizeof(prefix), "Simulation %zu players", playerCount);
+
+            // skip generating matches nobody asked for
+            std::string names[4 + SHARD_COUNT_STEPS] =
+            {
+                std::string(prefix) + " [Rating]",
+                std::string(prefix) + " [RatingTable]",
+                std::string(prefix) + " [ParallelReplay]",
+                std::string(prefix) + " [ParallelReplay " + SimdKernels::InstructionSetName(SimdKernels::ActiveInstructionSet()) + "]",
+            };
+            bool selected = false;
+            for (int i = 0; i < 4 + SHARD_COUNT_STEPS; i++)
+            {
+                if (i >= 4)
+                {
+                    char shards[48];
+                    snprintf(shards, sizeof(shards), " [ShardedRatingService %d]", 1 << (i - 4));
+                    names[i] = std::string(prefix) + shards;
+                }
+                selected = selected || Selected(options, names[i].c_str());
+            }
+            if (!selected)
+            {
+                continue;
+            }
+
+            std::vector<MatchRecord> matches = MakeSimulation(playerCount);
+            double updates = 2.0 * matches.size();
+
+            std::vector<Rating> ratings;
+            RatingTable table;
+            ParallelReplay::Schedule schedule;
+            ParallelReplay::BuildSchedule(matches.data(), matches.size(), playerCount, schedule);
+
+            RunScenario(options, results, names[0].c_str(), [&]
+            {
+                ratings.assign(playerCount, Rating(model.initialMean, model.initialStandardDeviation));
+            }, [&]
+            {
+                for (size_t i = 0; i < matches.size(); i++)
+                {
+                    const MatchRecord& match = matches[i];
+                    RatingCalculator::CalculateNewRatings(model, ratings[match.player1], ratings[match.player2], match.rank1, match.rank2);
+                }
+                sink = ratings[0].mean;
+            }, updates);
+
+            RunScenario(options, results, names[1].c_str(), [&]
+            {
+                table = RatingTable(playerCount, model.initialMean, model.initialStandardDeviation);
+            }, [&]
+            {
+                RatingCalculator::CalculateNewRatings(model, table, matches.data(), matches.size());
+                sink = table.mean[0];
+            }, updates);
+
+            RunScenario(options, results, names[2].c_str(), [&]
+            {
+                table = RatingTable(playerCount, model.initialMean, model.initialStandardDeviation);
+            }, [&]
+            {
+                ParallelReplay::CalculateNewRatings(model, table, schedule, pool);
+                sink = table.mean[0];
+            }, updates);
+
+            RunScenario(options, results, names[3].c_str(), [&]
+            {
+                table = RatingTable(playerCount, model.initialMean, model.initialStandardDeviation);
+            }, [&]
+            {
+                ParallelReplay::CalculateNewRatings(model, table, schedule, pool, ParallelReplay::REPLAY_KERNEL_VECTORIZED);
+                sink = table.mean[0];
+            }, updates);
+
+            // 1, 2, 4 and 8 shards, started fresh for every run outside the timing and fed in batches like a
+            // service would be. Scaling needs as many cores as shards.
+            std::unique_ptr<ShardedRatingService> service;
+            for (int step = 0; step < SHARD_COUNT_STEPS; step++)
+            {
+                RunScenario(options, results, names[4 + step].c_str(), [&]
+                {
+                    service.reset();
+                    service.reset(new ShardedRatingService(model, playerCount, 1 << step));
+                    service->Start();
+                }, [&]
+                {
+                    for (size_t first = 0; first < matches.size(); first += SHARDED_BATCH)
+                    {
+                        service->CalculateNewRatings(matches.data() + first, std::min(SHARDED_BATCH, matches.size() - first));
+                    }
+                }, updates);
+                service.reset();
+            }
+        }
+    }
+
+    bool SaveBaseline(const char* path, const std::vector<Result>& results)
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            fprintf(file, "%.6f\t%s\n", results[i].nanosecondsPerOperation, results[i].name.c_str());
+        }
+        return fclose(file) == 0;
+    }
+
+    bool LoadBaseline(const char* path, std::map<std::string, double>& baseline)
+    {
+        FILE* file = fopen(path, "r");
+        if (!file)
+        {
+            return false;
+        }
+
+        char line[512];
+        while (fgets(line, sizeof(line), file))
+        {
+            char* tab = strchr(line, '\t');
+            if (!tab)
+            {
+                continue;
+            }
+
+            std::string name(tab + 1);
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r'))
+            {
+                name.pop_back();
+            }
+            baseline[name] = atof(line);
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    // Returns the number of regressions
+    int CompareBaseline(const Options& options, const std::vector<Result>& results, const std::map<std::string, double>& baseline)
+    {
+        int regressions = 0;
+
+        printf("\n%-48s %12s %12s %9s\n", "compared to baseline", "baseline", "now", "change");
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            std::map<std::string, double>::const_iterator previous = baseline.find(results[i].name);
+            if (previous == baseline.end())
+            {
+                printf("%-48s %12s %12.2f %9s\n", results[i].name.c_str(), "-", results[i].nanosecondsPerOperation, "new");
+                continue;
+            }
+
+            double change = (results[i].nanosecondsPerOperation / previous->second - 1.0) * 100.0;
+            bool regressed = change > options.threshold;
+            regressions += regressed ? 1 : 0;
+
+            printf("%-48s %12.2f %12.2f %+8.1f%%%s\n", results[i].name.c_str(), previous->second, results[i].nanosecondsPerOperation,
+                   change, regressed ? "  REGRESSION" : "");
+        }
+
+        return regressions;
+    }
+
+    void PrintUsage()
+    {
+        printf("usage: Benchmark [--quick] [--filter text] [--threads n] [--max-players n]\n"
+               "                 [--save-baseline file] [--baseline file] [--threshold percent]\n");
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            options.minimumSeconds = 0.05;
+            options.maximumPlayers = 65536;
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && hasValue)
+        {
+            options.filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            options.threadCount = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-players") == 0 && hasValue)
+        {
+            options.maximumPlayers = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--save-baseline") == 0 && hasValue)
+        {
+            options.saveBaseline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && hasValue)
+        {
+            options.baseline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && hasValue)
+        {
+            options.threshold = atof(argv[++i]);
+        }
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (options.baseline && !LoadBaseline(options.baseline, baseline))
+    {
+        fprintf(stderr, "can't read baseline %s\n", options.baseline);
+        return 2;
+    }
+
+    ThreadPool pool(options.threadCount);
+    printf("instruction set %s, %zu threads\n\n", SimdKernels::InstructionSetName(SimdKernels::ActiveInstructionSet()), pool.ThreadCount());
+
+    std::vector<Result> results;
+    RunMicroBenchmarks(options, results);
+    RunScenarios(options, results, pool);
+
+    if (Instrumentation::Enabled())
+    {
+        printf("\n");
+        Instrumentation::Dump(stdout);
+    }
+
+    if (options.saveBaseline && !SaveBaseline(options.saveBaseline, results))
+    {
+        fprintf(stderr, "can't write baseline %s\n", options.saveBaseline);
+        return 2;
+    }
+
+    if (options.baseline)
+    {
+        int regressions = CompareBaseline(options, results, baseline);
+        if (regressions > 0)
+        {
+            printf("\n%d regression%s above %.1f%%\n", regressions, regressions == 1 ? "" : "s", options.threshold);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,279 @@
+//
+//  ConcurrentRatingStore.cpp
+//  Skills
+//
+//  Created by KleMiX on 09/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "ConcurrentRatingStore.h"
+#include "RatingCalculator.h"
+#include "TimeDynamics.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+#include <thread>
+
+// Player ids can be anything but this one
+static const uint64_t EMPTY_KEY = ~(uint64_t) 0;
+
+// One entry per cache line so updates of neighbouring players don't slow each other down
+static const size_t CACHE_LINE_SIZE = 64;
+
+struct alignas(CACHE_LINE_SIZE) ConcurrentRatingStore::Entry
+{
+    std::atomic<uint64_t> key;
+    std::atomic<uint32_t> sequence;     // odd while an update is writing
+    std::atomic<double> mean;
+    std::atomic<double> standardDeviation;
+};
+
+static inline size_t HashPlayerId(uint64_t playerId)
+{
+    // splitmix64 finalizer, ids are often sequential
+    playerId ^= playerId >> 30;
+    playerId *= 0xbf58476d1ce4e5b9ULL;
+    playerId ^= playerId >> 27;
+    playerId *= 0x94d049bb133111ebULL;
+    playerId ^= playerId >> 31;
+    return (size_t) playerId;
+}
+
+ConcurrentRatingStore::ConcurrentRatingStore(const GameModel& model, size_t capacity, double conservativeMultiplier) :
+    model(model), conservativeMultiplier(conservativeMultiplier), capacity(capacity), size(0)
+{
+    // keep the table at most half full so probe sequences stay short
+    size_t slotCount = 16;
+    while (slotCount < 2 * capacity)
+    {
+        slotCount *= 2;
+    }
+    mask = slotCount - 1;
+
+    void* memory = NULL;
+    if (posix_memalign(&memory, CACHE_LINE_SIZE, slotCount * sizeof(Entry)) != 0)
+    {
+        throw std::bad_alloc();
+    }
+
+    // every slot starts with the initial rating, a player becomes visible with it the moment its key is set
+    entries = static_cast<Entry*>(memory);
+    for (size_t i = 0; i < slotCount; i++)
+    {
+        Entry* entry = new (&entries[i]) Entry();
+        entry->key.store(EMPTY_KEY, std::memory_order_relaxed);
+        entry->sequence.store(0, std::memory_order_relaxed);
+        entry->mean.store(model.initialMean, std::memory_order_relaxed);
+        entry->standardDeviation.store(model.initialStandardDeviation, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+ConcurrentRatingStore::~ConcurrentRatingStore()
+{
+    for (size_t i = 0; i <= mask; i++)
+    {
+        entries[i].~Entry();
+    }
+    free(entries);
+}
+
+size_t ConcurrentRatingStore::Size() const
+{
+    return std::min(size.load(std::memory_order_relaxed), capacity);
+}
+
+size_t ConcurrentRatingStore::Capacity() const
+{
+    return capacity;
+}
+
+ConcurrentRatingStore::Entry* ConcurrentRatingStore::Find(uint64_t playerId) const
+{
+    for (size_t slot = HashPlayerId(playerId) & mask; ; slot = (slot + 1) & mask)
+    {
+        uint64_t key = entries[slot].key.load(std::memory_order_acquire);
+        if (key == playerId)
+        {
+            return &entries[slot];
+        }
+        if (key == EMPTY_KEY)
+        {
+            return NULL;
+        }
+    }
+}
+
+ConcurrentRatingStore::Entry* ConcurrentRatingStore::FindOrAdd(uint64_t playerId)
+{
+    if (playerId == EMPTY_KEY)
+    {
+        return NULL;
+    }
+
+    bool reserved = false;
+    for (size_t slot = HashPlayerId(playerId) & mask; ; slot = (slot + 1) & mask)
+    {
+        Entry& entry = entries[slot];
+        uint64_t key = entry.key.load(std::memory_order_acquire);
+
+        if (key == EMPTY_KEY)
+        {
+            if (!reserved)
+            {
+                if (size.fetch_add(1, std::memory_order_relaxed) >= capacity)
+                {
+                    size.fetch_sub(1, std::memory_order_relaxed);
+                    return NULL;
+                }
+                reserved = true;
+            }
+
+            if (entry.key.compare_exchange_strong(key, playerId, std::memory_order_acq_rel))
+            {
+                return &entry;
+            }
+            // somebody took the slot first, key now holds their id
+        }
+
+        if (key == playerId)
+        {
+            if (reserved)
+            {
+                size.fetch_sub(1, std::memory_order_relaxed);
+            }
+            return &entry;
+        }
+    }
+}
+
+void ConcurrentRatingStore::Lock(Entry& entry)
+{
+    for (int spin = 0; ; spin++)
+    {
+        uint32_t sequence = entry.sequence.load(std::memory_order_relaxed);
+        if ((sequence & 1) == 0 &&
+            entry.sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire))
+        {
+            break;
+        }
+
+        if (spin > 64)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // keeps the field stores below from moving above the odd sequence
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void ConcurrentRatingStore::Unlock(Entry& entry)
+{
+    entry.sequence.fetch_add(1, std::memory_order_release);
+}
+
+bool ConcurrentRatingStore::Get(uint64_t playerId, Rating& rating) const
+{
+    Entry* entry = Find(playerId);
+    if (!entry)
+    {
+        rating = Rating(model.initialMean, model.initialStandardDeviation, conservativeMultiplier);
+        return false;
+    }
+
+    for (;;)
+    {
+        uint32_t before = entry->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        double mean = entry->mean.load(std::memory_order_relaxed);
+        double standardDeviation = entry->standardDeviation.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry->sequence.load(std::memory_order_relaxed) == before)
+        {
+            rating = Rating(mean, standardDeviation, conservativeMultiplier);
+            return true;
+        }
+    }
+}
+
+Rating ConcurrentRatingStore::Get(uint64_t playerId) const
+{
+    Rating rating;
+    Get(playerId, rating);
+    return rating;
+}
+
+bool ConcurrentRatingStore::Set(uint64_t playerId, Rating rating)
+{
+    Entry* entry = FindOrAdd(playerId);
+    if (!entry)
+    {
+        return false;
+    }
+
+    Lock(*entry);
+    entry->mean.store(rating.mean, std::memory_order_relaxed);
+    entry->standardDeviation.store(rating.standardDeviation, std::memory_order_relaxed);
+    Unlock(*entry);
+    return true;
+}
+
+bool ConcurrentRatingStore::CalculateNewRatings(uint64_t player1, uint64_t player2, int rank1, int rank2)
+{
+    Rating newRating1;
+    Rating newRating2;
+    return CalculateNewRatings(player1, player2, rank1, rank2, newRating1, newRating2);
+}
+
+bool ConcurrentRatingStore::CalculateNewRatings(uint64_t player1, uint64_t player2, int rank1, int rank2, Rating& newRating1, Rating& newRating2)
+{
+    if (TimeDynamics::NeedsTimestamps(model))
+    {
+        return false;
+    }
+
+    Entry* entry1 = FindOrAdd(player1);
+    Entry* entry2 = FindOrAdd(player2);
+    if (!entry1 || !entry2)
+    {
+        return false;
+    }
+
+    // always lock the lower slot first so two updates can't wait for each other
+    Entry* first = entry1 < entry2 ? entry1 : entry2;
+    Entry* second = entry1 < entry2 ? entry2 : entry1;
+
+    Lock(*first);
+    if (second != first)
+    {
+        Lock(*second);
+    }
+
+    Rating rating1(entry1->mean.load(std::memory_order_relaxed), entry1->standardDeviation.load(std::memory_order_relaxed), conservativeMultiplier);
+    Rating rating2(entry2->mean.load(std::memory_order_relaxed), entry2->standardDeviation.load(std::memory_order_relaxed), conservativeMultiplier);
+
+    RatingCalculator::CalculateNewRatings(model, rating1, rating2, rank1, rank2);
+
+    entry1->mean.store(rating1.mean, std::memory_order_relaxed);
+    entry1->standardDeviation.store(rating1.standardDeviation, std::memory_order_relaxed);
+    entry2->mean.store(rating2.mean, std::memory_order_relaxed);
+    entry2->standardDeviation.store(rating2.standardDeviation, std::memory_order_relaxed);
+
+    if (second != first)
+    {
+        Unlock(*second);
+    }
+    Unlock(*first);
+
+    newRating1 = rating1;
+    newRating2 = rating2;
+    return true;
+}
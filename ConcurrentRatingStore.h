@@ -0,0 +1,70 @@
+//
+//  ConcurrentRatingStore.h
+//  Skills
+//
+//  Created by KleMiX on 09/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "Rating.h"
+#include "GameModel.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Ratings keyed by player id that any number of threads can read and update at once.
+//
+// Open addressing table of fixed capacity, players are added by a compare-and-swap on the key and never
+// removed. Every entry carries its own sequence lock: readers retry until they see an even sequence that
+// didn't change while they copied mean and standard deviation, so they never write shared memory and scale
+// with the reader count. Updates lock the two entries in slot order, there is no global lock and two updates
+// can't deadlock. Unknown players read as the model's initial rating.
+class ConcurrentRatingStore
+{
+public:
+    // capacity is the number of players the store can hold
+    ConcurrentRatingStore(const GameModel& model, size_t capacity, double conservativeMultiplier = DEFAULT_CONSERVATIVE_MULTIPLIER);
+    ~ConcurrentRatingStore();
+
+    // False when the player was never added, rating is then the initial one
+    bool    Get(uint64_t playerId, Rating& rating) const;
+    Rating  Get(uint64_t playerId) const;
+
+    // These add the players when needed and fail when the store is full. Updates also fail, changing nothing,
+    // when the model has time dynamics: the store keeps no timestamps, see TimeDynamics::NeedsTimestamps.
+    bool    Set(uint64_t playerId, Rating rating);
+    bool    CalculateNewRatings(uint64_t player1, uint64_t player2, int rank1, int rank2);
+    // Also hands out the ratings the update wrote, later updates by other threads can't get in between
+    bool    CalculateNewRatings(uint64_t player1, uint64_t player2, int rank1, int rank2, Rating& newRating1, Rating& newRating2);
+
+    size_t  Size() const;
+    size_t  Capacity() const;
+
+    const GameModel& Model() const
+    {
+        return model;
+    }
+
+private:
+    struct Entry;
+
+    ConcurrentRatingStore(const ConcurrentRatingStore&);
+    ConcurrentRatingStore& operator = (const ConcurrentRatingStore&);
+
+    Entry*  Find(uint64_t playerId) const;
+    Entry*  FindOrAdd(uint64_t playerId);
+
+    static void Lock(Entry& entry);
+    static void Unlock(Entry& entry);
+
+    GameModel model;
+    double conservativeMultiplier;
+
+    Entry* entries;
+    size_t mask;
+    size_t capacity;
+    std::atomic<size_t> size;
+};
@@ -0,0 +1,255 @@
+//
+//  FitModel.cpp
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "ModelFitting.h"
+#include "MatchLog.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Fits beta, drawProbability and dynamicsFactor to a match log by predictive log-likelihood, see ModelFitting.
+// Without a log it fits a synthetic history drawn from the default model, which shows how close the fit
+// gets to parameters that are known.
+//
+//   FitModel [--log file] [--players n] [--matches n] [--initial-mean x] [--threads n] [--grid n]
+//            [--burn-in n] [--accuracy full|high|fast] [--tables] [--time-dynamics x]
+//
+// --time-dynamics fits a mode that runs with GameModel::UseTimeDynamics(x, initial deviation), the log's
+// timestamps are replayed with it. Synthetic histories have no timestamps and are fitted without.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        const char* log;
+        size_t playerCount;
+        size_t matchCount;
+        double initialMean;
+        size_t threadCount;
+        int gridSteps;
+        size_t burnIn;
+        GaussianAccuracy accuracy;
+        bool correctionTables;
+        double timeDynamicsFactor;
+
+        Options()
+        : log(NULL), playerCount(10000), matchCount(1000000), initialMean(25.0), threadCount(0), gridSteps(4), burnIn(0),
+          accuracy(GAUSSIAN_ACCURACY_FULL), correctionTables(false), timeDynamicsFactor(0)
+        {
+        }
+    };
+
+    // Partial play weights are dropped, the fit scores whole matches
+    bool LoadLog(const char* path, std::vector<MatchRecord>& matches, std::vector<uint64_t>& timestamps, size_t& playerCount)
+    {
+        MatchLog::Reader reader;
+        if (!reader.Open(path))
+        {
+            return false;
+        }
+
+        matches.reserve(reader.RecordCount());
+        timestamps.reserve(reader.RecordCount());
+        playerCount = 0;
+
+        MatchLog::Window window;
+        size_t first = 0;
+        while (reader.Map(first, reader.RecordCount() - first, window))
+        {
+            for (size_t i = 0; i < window.count; i++)
+            {
+                const MatchLog::Record& record = window.RecordAt(i);
+                matches.push_back(MatchRecord((int) record.player1, (int) record.player2, record.rank1, record.rank2));
+                timestamps.push_back(record.timestamp);
+                playerCount = std::max(playerCount, (size_t) std::max(record.player1, record.player2) + 1);
+            }
+            first += window.count;
+        }
+        return true;
+    }
+
+    // Hidden skills start from the model prior and drift by dynamicsFactor per match, performances add beta
+    // noise, a difference inside the draw margin is a draw
+    void MakeSynthetic(const Options& options, const GameModel& truth, std::vector<MatchRecord>& matches)
+    {
+        std::mt19937_64 random(options.playerCount);
+        std::normal_distribution<double> normal;
+
+        std::vector<double> skill(options.playerCount);
+        for (size_t i = 0; i < options.playerCount; i++)
+        {
+            skill[i] = truth.initialMean + truth.initialStandardDeviation * normal(random);
+        }
+
+        matches.reserve(options.matchCount);
+        while (matches.size() < options.matchCount)
+        {
+            int player1 = (int) (random() % options.playerCount);
+            int player2 = (int) (random() % options.playerCount);
+            if (player1 == player2)
+            {
+                continue;
+            }
+
+            skill[player1] += truth.dynamicsFactor * normal(random);
+            skill[player2] += truth.dynamicsFactor * normal(random);
+            double difference = skill[player1] + truth.beta * normal(random) - (skill[player2] + truth.beta * normal(random));
+
+            int rank1 = fabs(difference) <= truth.drawMargin ? 0 : (difference > 0 ? 1 : 0);
+            int rank2 = fabs(difference) <= truth.drawMargin ? 0 : (difference > 0 ? 0 : 1);
+            matches.push_back(MatchRecord(player1, player2, rank1, rank2));
+        }
+    }
+
+    bool ParseAccuracy(const char* name, GaussianAccuracy& accuracy)
+    {
+        for (int tier = 0; tier < GAUSSIAN_ACCURACY_COUNT; tier++)
+        {
+            if (strcmp(name, GaussianAccuracyTiers::Name((GaussianAccuracy) tier)) == 0)
+            {
+                accuracy = (GaussianAccuracy) tier;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void PrintParameters(const char* label, const ModelFitting::Parameters& parameters)
+    {
+        printf("%-10s beta %.4f  drawProbability %.4f  dynamicsFactor %.5f\n", label, parameters.beta, parameters.drawProbability,
+               parameters.dynamicsFactor);
+    }
+
+    void PrintUsage()
+    {
+        printf("usage: FitModel [--log file] [--players n] [--matches n] [--initial-mean x] [--threads n] [--grid n]\n"
+               "                [--burn-in n] [--accuracy full|high|fast] [--tables] [--time-dynamics x]\n");
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--log") == 0 && hasValue)
+        {
+            options.log = argv[++i];
+        }
+        else if (strcmp(argv[i], "--players") == 0 && hasValue)
+        {
+            options.playerCount = std::max((size_t) atol(argv[++i]), (size_t) 2);
+        }
+        else if (strcmp(argv[i], "--matches") == 0 && hasValue)
+        {
+            options.matchCount = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--initial-mean") == 0 && hasValue)
+        {
+            options.initialMean = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            options.threadCount = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--grid") == 0 && hasValue)
+        {
+            options.gridSteps = std::max(atoi(argv[++i]), 1);
+        }
+        else if (strcmp(argv[i], "--burn-in") == 0 && hasValue)
+        {
+            options.burnIn = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--accuracy") == 0 && hasValue && ParseAccuracy(argv[i + 1], options.accuracy))
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "--tables") == 0)
+        {
+            options.correctionTables = true;
+        }
+        else if (strcmp(argv[i], "--time-dynamics") == 0 && hasValue)
+        {
+            options.timeDynamicsFactor = std::max(atof(argv[++i]), 0.0);
+        }
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    // the initial rating stays fixed, it only sets the scale
+    GameModel base = GameModel::FromInitialMean(options.initialMean, 0.10);
+    base.UseAccuracy(options.accuracy);
+    base.UseTimeDynamics(options.timeDynamicsFactor, base.initialStandardDeviation);
+    if (options.correctionTables)
+    {
+        base.UseCorrectionTables();
+    }
+
+    std::vector<MatchRecord> matches;
+    std::vector<uint64_t> timestamps;
+    size_t playerCount = options.playerCount;
+    if (options.log)
+    {
+        if (!LoadLog(options.log, matches, timestamps, playerCount))
+        {
+            fprintf(stderr, "can't read match log %s\n", options.log);
+            return 2;
+        }
+    }
+    else
+    {
+        MakeSynthetic(options, base, matches);
+    }
+
+    ThreadPool pool(options.threadCount);
+    ModelFitting::SearchOptions searchOptions(base);
+    searchOptions.gridSteps = options.gridSteps;
+    searchOptions.firstScoredMatch = options.burnIn;
+
+    printf("%zu players, %zu matches, %zu threads, %s accuracy%s\n\n", playerCount, matches.size(), pool.ThreadCount(),
+           GaussianAccuracyTiers::Name(options.accuracy), options.correctionTables ? ", correction tables" : "");
+
+    // synthetic histories have no timestamps, they are scored without time dynamics like the search does
+    const uint64_t* matchTimestamps = timestamps.empty() ? NULL : timestamps.data();
+    GameModel startModel = base;
+    if (!matchTimestamps)
+    {
+        startModel.UseTimeDynamics(0, base.maximumStandardDeviation);
+    }
+    double startLogLikelihood = ModelFitting::LogLikelihood(startModel, matches.data(), matchTimestamps, matches.size(), playerCount,
+                                                            options.burnIn);
+
+    Clock::time_point start = Clock::now();
+    ModelFitting::Fit fit = ModelFitting::Search(base, matches.data(), matchTimestamps, matches.size(), playerCount, searchOptions, pool);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (!options.log)
+    {
+        PrintParameters("generated", ModelFitting::Parameters::FromModel(base));
+    }
+    PrintParameters("fitted", fit.parameters);
+    printf("\naverage log-likelihood %.6f, default parameters %.6f\n", fit.AverageLogLikelihood(),
+           fit.scoredMatches > 0 ? startLogLikelihood / fit.scoredMatches : 0.0);
+    printf("%zu replays in %.2f s, %.1f ns per match and candidate\n", fit.evaluations, seconds,
+           seconds * 1e9 / std::max((double) fit.evaluations * matches.size(), 1.0));
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+//
+//  GameModel.h
+//  Skills
+//
+//  Created by KleMiX on 09/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "GaussianDistribution.h"
+#include "TruncatedGaussianCorrectionTables.h"
+
+#include <algorithm>
+#include <memory>
+
+// Parameters of a game mode together with every value derived from them. Create one per mode and pass it
+// to the RatingCalculator functions, derived values are computed once by the constructor so create a new
+// model instead of changing the fields.
+struct GameModel
+{
+    double initialMean;
+    double initialStandardDeviation;
+    double beta;
+    double drawProbability;
+    double dynamicsFactor;
+
+    // Inactivity, see UseTimeDynamics and TimeDynamics
+    double timeDynamicsFactor;
+    double maximumStandardDeviation;
+
+    // derived values
+    double drawMargin;
+    double betaSquared;
+    double twoBetaSquared;
+    double dynamicsFactorSquared;
+    double timeDynamicsFactorSquared;
+
+    // optional, see UseCorrectionTables and UseAccuracy
+    std::shared_ptr<const TruncatedGaussianCorrectionTables> correctionTables;
+    GaussianAccuracy accuracy;
+
+    // Default game values
+    GameModel()
+    {
+        Initialize(25.0, 25.0 / 3.0, 25.0 / 6.0, 0.10, 25.0 / 300.0);
+    }
+
+    GameModel(double initialMean, double initialStandardDeviation, double beta, double drawProbability, double dynamicsFactor)
+    {
+        Initialize(initialMean, initialStandardDeviation, beta, drawProbability, dynamicsFactor);
+    }
+
+    // Same proportions as the default game, scaled to another initial mean
+    static GameModel FromInitialMean(double initialMean, double drawProbability)
+    {
+        return GameModel(initialMean, initialMean / 3.0, initialMean / 6.0, drawProbability, initialMean / 300.0);
+    }
+
+    static const GameModel& Default()
+    {
+        static const GameModel defaultModel;
+        return defaultModel;
+    }
+
+    // Lets the standard deviation of a player grow while they don't play: the variance grows by
+    // timeDynamicsFactor^2 per unit of time, the unit being whatever the timestamps passed to TimeDynamics use,
+    // but never past maximumStandardDeviation. Off (0) by default. Call it before UseCorrectionTables, the tables
+    // have to cover the larger deviations.
+    void UseTimeDynamics(double timeDynamicsFactor, double maximumStandardDeviation)
+    {
+        this->timeDynamicsFactor = timeDynamicsFactor;
+        this->maximumStandardDeviation = maximumStandardDeviation;
+        timeDynamicsFactorSquared = timeDynamicsFactor * timeDynamicsFactor;
+    }
+
+    // Switches the V/W corrections to interpolated tables built for this game, see TruncatedGaussianCorrectionTables
+    // for the error bounds. Copies of the model share the tables.
+    void UseCorrectionTables()
+    {
+        double largestStandardDeviation = std::max(initialStandardDeviation, maximumStandardDeviation);
+        largestStandardDeviation = sqrt(largestStandardDeviation * largestStandardDeviation + dynamicsFactorSquared);
+        correctionTables = std::make_shared<TruncatedGaussianCorrectionTables>(
+            TruncatedGaussianCorrectionTables::ForGame(drawMargin, beta, largestStandardDeviation));
+    }
+
+    const TruncatedGaussianCorrectionTables* CorrectionTables() const
+    {
+        return correctionTables.get();
+    }
+
+    // Trades accuracy of the cumulative in the rating updates and win chances for speed, see GaussianAccuracy
+    // for the tiers and their error bounds. GAUSSIAN_ACCURACY_FULL by default. Correction tables take precedence
+    // over the tier for the V/W corrections, the draw margin is always computed at full accuracy.
+    void UseAccuracy(GaussianAccuracy accuracy)
+    {
+        this->accuracy = accuracy;
+    }
+
+    GaussianAccuracy Accuracy() const
+    {
+        return accuracy;
+    }
+
+    static double GetDrawMarginFromDrawProbability(double drawProbability, double beta)
+    {
+        // Derived from TrueSkill technical report (MSR-TR-2006-80), page 6
+
+        // draw probability = 2 * CDF(margin/(sqrt(n1+n2)*beta)) -1
+
+        // implies
+        //
+        // margin = inversecdf((draw probability + 1)/2) * sqrt(n1+n2) * beta
+        // n1 and n2 are the number of players on each team
+        double margin = GaussianDistribution::InverseCumulativeTo(.5*(drawProbability + 1), 0, 1) * sqrt(1 + 1) * beta;
+        return margin;
+    }
+
+private:
+    void Initialize(double initialMean, double initialStandardDeviation, double beta, double drawProbability, double dynamicsFactor)
+    {
+        this->initialMean = initialMean;
+        this->initialStandardDeviation = initialStandardDeviation;
+        this->beta = beta;
+        this->drawProbability = drawProbability;
+        this->dynamicsFactor = dynamicsFactor;
+        timeDynamicsFactor = 0;
+        maximumStandardDeviation = initialStandardDeviation;
+        accuracy = GAUSSIAN_ACCURACY_FULL;
+
+        drawMargin = GetDrawMarginFromDrawProbability(drawProbability, beta);
+        betaSquared = beta * beta;
+        twoBetaSquared = 2 * betaSquared;
+        dynamicsFactorSquared = dynamicsFactor * dynamicsFactor;
+        timeDynamicsFactorSquared = 0;
+    }
+};
+
+// Compile-time version of GameModel for modes that never change, every value is a constant so the
+// calculator templates fold them into the generated code. Traits provide initialMean, initialStandardDeviation,
+// beta, drawProbability, dynamicsFactor and drawMargin as static constexpr doubles; drawMargin can't be
+// computed at compile time, take it from GameModel::GetDrawMarginFromDrawProbability.
+template <class Traits>
+struct FixedGameModel
+{
+    static constexpr double initialMean = Traits::initialMean;
+    static constexpr double initialStandardDeviation = Traits::initialStandardDeviation;
+    static constexpr double beta = Traits::beta;
+    static constexpr double drawProbability = Traits::drawProbability;
+    static constexpr double dynamicsFactor = Traits::dynamicsFactor;
+
+    static constexpr double drawMargin = Traits::drawMargin;
+    static constexpr double betaSquared = Traits::beta * Traits::beta;
+    static constexpr double twoBetaSquared = 2 * betaSquared;
+    static constexpr double dynamicsFactorSquared = Traits::dynamicsFactor * Traits::dynamicsFactor;
+
+    static constexpr const TruncatedGaussianCorrectionTables* CorrectionTables()
+    {
+        return nullptr;
+    }
+
+    static constexpr GaussianAccuracy Accuracy()
+    {
+        return GAUSSIAN_ACCURACY_FULL;
+    }
+
+    // Runtime copy, handy for code that only takes a GameModel
+    static GameModel ToGameModel()
+    {
+        return GameModel(initialMean, initialStandardDeviation, beta, drawProbability, dynamicsFactor);
+    }
+};
+
+template <class Traits> constexpr double FixedGameModel<Traits>::initialMean;
+template <class Traits> constexpr double FixedGameModel<Traits>::initialStandardDeviation;
+template <class Traits> constexpr double FixedGameModel<Traits>::beta;
+template <class Traits> constexpr double FixedGameModel<Traits>::drawProbability;
+template <class Traits> constexpr double FixedGameModel<Traits>::dynamicsFactor;
+template <class Traits> constexpr double FixedGameModel<Traits>::drawMargin;
+template <class Traits> constexpr double FixedGameModel<Traits>::betaSquared;
+template <class Traits> constexpr double FixedGameModel<Traits>::twoBetaSquared;
+template <class Traits> constexpr double FixedGameModel<Traits>::dynamicsFactorSquared;
+
+// Same values as GameModel()
+struct DefaultGameModelTraits
+{
+    static constexpr double initialMean = 25.0;
+    static constexpr double initialStandardDeviation = 25.0 / 3.0;
+    static constexpr double beta = 25.0 / 6.0;
+    static constexpr double drawProbability = 0.10;
+    static constexpr double dynamicsFactor = 25.0 / 300.0;
+    static constexpr double drawMargin = 0.74046658745214988;
+};
+
+typedef FixedGameModel<DefaultGameModelTraits> DefaultFixedGameModel;
@@ -0,0 +1,121 @@
+//
+//  GaussianAccuracy.cpp
+//  Skills
+//
+//  Created by KleMiX on 06/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "GaussianAccuracy.h"
+#include "GaussianDistribution.h"
+#include "TruncatedGaussianCorrectionFunctions.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+    // erfc(x) leaves the normal range just past this
+    const double ERROR_FUNCTION_LIMIT = 26.5;
+    const double SMALLEST_PROBABILITY_EXPONENT = -300.0;
+
+    // The argument range of the correction tables, margins wider than the default game on both sides
+    const double EXCEEDS_MINIMUM = -24.0;
+    const double EXCEEDS_MAXIMUM = 12.0;
+    const double WITHIN_MAXIMUM = 12.0;
+    const double DRAW_MARGIN_MINIMUM = 0.05;
+    const double DRAW_MARGIN_MAXIMUM = 0.5;
+    const int DRAW_MARGIN_COUNT = 8;
+
+    void Maximize(double& maximum, double value)
+    {
+        // NaN has to fail the verification, not disappear in the comparison
+        maximum = (value > maximum || value != value) ? value : maximum;
+    }
+}
+
+GaussianAccuracyTiers::MaximumError GaussianAccuracyTiers::Guarantee(GaussianAccuracy accuracy)
+{
+    static const MaximumError guarantees[GAUSSIAN_ACCURACY_COUNT] =
+    {
+        { 0, 0, 0, 0, 0, 0 },
+        { 1.5e-8, 2.0e-8, 1.0e-7, 2.5e-6, 8.0e-8, 1.0e-6 },
+        { 7.0e-5, 1.0e-4, 1.0e-3, 2.5e-2, 8.0e-4, 1.0e-2 },
+    };
+    return guarantees[accuracy];
+}
+
+GaussianAccuracyTiers::MaximumError GaussianAccuracyTiers::MeasureMaximumError(GaussianAccuracy accuracy, int samplesPerUnit)
+{
+    MaximumError result = { 0, 0, 0, 0, 0, 0 };
+    double step = 1.0 / samplesPerUnit;
+
+    for (double x = -ERROR_FUNCTION_LIMIT; x <= ERROR_FUNCTION_LIMIT; x += step)
+    {
+        double exact = GaussianDistribution::ErrorFunctionCumulativeTo(x);
+        double approximate = GaussianDistribution::ErrorFunctionCumulativeTo(x, accuracy);
+        Maximize(result.errorFunction, fabs(approximate - exact) / exact);
+    }
+
+    // both tails of p in (0, 2), then the middle on a linear grid
+    for (double exponent = SMALLEST_PROBABILITY_EXPONENT; exponent < 0.0; exponent += step)
+    {
+        double p = pow(10.0, exponent);
+        Maximize(result.inverseErrorFunction, fabs(GaussianDistribution::InverseErrorFunctionCumulativeTo(p, accuracy) -
+                                                   GaussianDistribution::InverseErrorFunctionCumulativeTo(p)));
+        Maximize(result.inverseErrorFunction, fabs(GaussianDistribution::InverseErrorFunctionCumulativeTo(2.0 - p, accuracy) -
+                                                   GaussianDistribution::InverseErrorFunctionCumulativeTo(2.0 - p)));
+    }
+    for (double p = step * 0.01; p < 2.0; p += step * 0.01)
+    {
+        Maximize(result.inverseErrorFunction, fabs(GaussianDistribution::InverseErrorFunctionCumulativeTo(p, accuracy) -
+                                                   GaussianDistribution::InverseErrorFunctionCumulativeTo(p)));
+    }
+
+    for (double x = EXCEEDS_MINIMUM; x < EXCEEDS_MAXIMUM; x += step)
+    {
+        Maximize(result.vExceedsMargin, fabs(TruncatedGaussianCorrectionFunctions::VExceedsMargin(x, 0.0, accuracy) -
+                                             TruncatedGaussianCorrectionFunctions::VExceedsMargin(x, 0.0)));
+        Maximize(result.wExceedsMargin, fabs(TruncatedGaussianCorrectionFunctions::WExceedsMargin(x, 0.0, accuracy) -
+                                             TruncatedGaussianCorrectionFunctions::WExceedsMargin(x, 0.0)));
+    }
+
+    for (int m = 0; m < DRAW_MARGIN_COUNT; m++)
+    {
+        double drawMargin = DRAW_MARGIN_MINIMUM + (DRAW_MARGIN_MAXIMUM - DRAW_MARGIN_MINIMUM) * m / (DRAW_MARGIN_COUNT - 1);
+        for (double t = 0.0; t < WITHIN_MAXIMUM; t += step)
+        {
+            Maximize(result.vWithinMargin, fabs(TruncatedGaussianCorrectionFunctions::VWithinMargin(t, drawMargin, accuracy) -
+                                                TruncatedGaussianCorrectionFunctions::VWithinMargin(t, drawMargin)));
+            Maximize(result.wWithinMargin, fabs(TruncatedGaussianCorrectionFunctions::WWithinMargin(t, drawMargin, accuracy) -
+                                                TruncatedGaussianCorrectionFunctions::WWithinMargin(t, drawMargin)));
+        }
+    }
+
+    return result;
+}
+
+bool GaussianAccuracyTiers::Verify(GaussianAccuracy accuracy, int samplesPerUnit)
+{
+    MaximumError guarantee = Guarantee(accuracy);
+    MaximumError measured = MeasureMaximumError(accuracy, samplesPerUnit);
+
+    return measured.errorFunction <= guarantee.errorFunction && measured.inverseErrorFunction <= guarantee.inverseErrorFunction &&
+           measured.vExceedsMargin <= guarantee.vExceedsMargin && measured.wExceedsMargin <= guarantee.wExceedsMargin &&
+           measured.vWithinMargin <= guarantee.vWithinMargin && measured.wWithinMargin <= guarantee.wWithinMargin;
+}
+
+const char* GaussianAccuracyTiers::Name(GaussianAccuracy accuracy)
+{
+    switch (accuracy)
+    {
+        case GAUSSIAN_ACCURACY_FULL:
+            return "full";
+        case GAUSSIAN_ACCURACY_HIGH:
+            return "high";
+        case GAUSSIAN_ACCURACY_FAST:
+            return "fast";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,79 @@
+//
+//  GaussianAccuracy.h
+//  Skills
+//
+//  Created by KleMiX on 06/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+// Accuracy tiers of the error function and its inverse, see GameModel::UseAccuracy. The tiers truncate the
+// Chebyshev series of ErrorFunctionCumulativeTo (28 coefficients) and run fewer Halley steps in
+// InverseErrorFunctionCumulativeTo, everything else stays the same code.
+//
+// Guaranteed maximum errors against the full precision functions, double:
+//   tier    coefficients  Halley steps  erfc (relative)  inverse erfc (absolute)
+//   FULL    28            2             0                0
+//   HIGH    12            2             1.5e-08          2.0e-08
+//   FAST    6             1             7.0e-05          1.0e-04
+// The erfc bounds are the sums of the dropped coefficients (the series gives the exponent, so they bound the
+// relative error), the inverse bounds add the Halley residual. Both are checked by MeasureMaximumError,
+// measured: erfc 1.05e-08 / 5.8e-05, inverse erfc 9.3e-09 / 2.0e-05. Relative errors are only guaranteed
+// for results in the normal range, erfc(x) gets subnormal past x = 26.5.
+//
+// V/W corrections, which is what the rating updates consume, inherit the relative error of the cumulative
+// and W loses the most as it cancels V against the argument. Their maximum absolute errors over the whole
+// range of the correction tables (arguments already divided by c in [-24, 12], within margin up to 12) are
+// measured rather than derived, so the guarantees add some headroom to the largest measured error:
+//   tier    VExceedsMargin     WExceedsMargin     VWithinMargin      WWithinMargin      (guaranteed / measured)
+//   HIGH    1.0e-07 / 8.7e-08  2.5e-06 / 2.1e-06  8.0e-08 / 6.3e-08  1.0e-06 / 7.6e-07
+//   FAST    1.0e-03 / 7.8e-04  2.5e-02 / 1.9e-02  8.0e-04 / 5.9e-04  1.0e-02 / 7.0e-03
+// The worst cases are far in the tails, with the arguments in [-6, 12] the measured errors are 3.8e-08,
+// 1.8e-07, 4.0e-08 and 2.5e-07 for HIGH and 1.9e-04, 8.0e-04, 1.9e-04 and 8.1e-04 for FAST.
+// AccuracyTest checks every bound.
+enum GaussianAccuracy
+{
+    GAUSSIAN_ACCURACY_FULL = 0,
+    GAUSSIAN_ACCURACY_HIGH,    // erfc ~1e-8, rating updates (V/W) ~1e-6
+    GAUSSIAN_ACCURACY_FAST,    // erfc ~1e-4, rating updates (V/W) ~1e-2
+    GAUSSIAN_ACCURACY_COUNT,
+};
+
+namespace GaussianAccuracyTiers
+{
+    struct MaximumError
+    {
+        double errorFunction;           // relative
+        double inverseErrorFunction;    // absolute
+        double vExceedsMargin;
+        double wExceedsMargin;
+        double vWithinMargin;
+        double wWithinMargin;
+    };
+
+    inline int ErrorFunctionCoefficientCount(GaussianAccuracy accuracy)
+    {
+        static const int counts[GAUSSIAN_ACCURACY_COUNT] = { 28, 12, 6 };
+        return counts[accuracy];
+    }
+
+    inline int HalleyStepCount(GaussianAccuracy accuracy)
+    {
+        static const int counts[GAUSSIAN_ACCURACY_COUNT] = { 2, 2, 1 };
+        return counts[accuracy];
+    }
+
+    // Bounds from the tables above
+    MaximumError    Guarantee(GaussianAccuracy accuracy);
+
+    // Sweeps the double versions of a tier against the full precision ones: erfc over [-26.5, 26.5], the
+    // inverse over p in [1e-300, 2) on a logarithmic grid, samplesPerUnit points per unit of argument (or
+    // decade of p). The corrections are sampled over the whole table range, normalized draw margins in [0.05, 0.5].
+    MaximumError    MeasureMaximumError(GaussianAccuracy accuracy, int samplesPerUnit);
+
+    // True when every measured error stays within Guarantee
+    bool            Verify(GaussianAccuracy accuracy, int samplesPerUnit);
+
+    const char*     Name(GaussianAccuracy accuracy);
+}
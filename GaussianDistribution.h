@@ -8,112 +8,130 @@
 
 #pragma once
 
+#include "GaussianAccuracy.h"
+#include "Instrumentation.h"
+
 #include <math.h>
 #include <algorithm>
 
-struct GaussianDistribution
+// Scalar is the floating point type of every value and calculation, GaussianDistribution is the double version
+template <class Scalar>
+struct BasicGaussianDistribution
 {
-    double mean;
-    double standardDeviation;
+    Scalar mean;
+    Scalar standardDeviation;
     
-    double precision;
-    double precisionMean;
-    double variance;
+    Scalar precision;
+    Scalar precisionMean;
+    Scalar variance;
     
-    GaussianDistribution() : mean(0), standardDeviation(0), precision(0), precisionMean(0), variance(0) { }
+    BasicGaussianDistribution() : mean(0), standardDeviation(0), precision(0), precisionMean(0), variance(0) { }
     
-    GaussianDistribution(double mean, double standardDeviation) : mean(mean), standardDeviation(standardDeviation)
+    BasicGaussianDistribution(Scalar mean, Scalar standardDeviation) : mean(mean), standardDeviation(standardDeviation)
     {
         variance = standardDeviation * standardDeviation;
-        precision = 1.0 / variance;
+        precision = Scalar(1) / variance;
         precisionMean = precision * mean;
     }
     
-    double NormalizationConstant()
+    Scalar NormalizationConstant()
     {
-        return 1.0 / (sqrt(2.0 * M_PI) * standardDeviation);
+        return Scalar(1) / (sqrt(Scalar(2) * Scalar(M_PI)) * standardDeviation);
     }
     
-    static GaussianDistribution FromPrecisionMean(double precisionMean, double precision)
+    static BasicGaussianDistribution FromPrecisionMean(Scalar precisionMean, Scalar precision)
     {
-        GaussianDistribution result = GaussianDistribution();
+        BasicGaussianDistribution result = BasicGaussianDistribution();
         result.precision = precision;
         result.precisionMean = precisionMean;
-        result.variance = 1.0 / precision;
+        result.variance = Scalar(1) / precision;
         result.standardDeviation = sqrt(result.variance);
         result.mean = precisionMean / precision;
         
         return result;
     }
     
-    static double LogProductNormalization(GaussianDistribution left, GaussianDistribution right)
+    static Scalar LogProductNormalization(BasicGaussianDistribution left, BasicGaussianDistribution right)
     {
         if ((left.precision == 0) || (right.precision == 0))
         {
             return 0;
         }
         
-        double varianceSum = left.variance + right.variance;
-        double meanDifference = left.mean - right.mean;
+        Scalar varianceSum = left.variance + right.variance;
+        Scalar meanDifference = left.mean - right.mean;
         
-        double logSqrt2Pi = log(sqrt(2.0 * M_PI));
-        return -logSqrt2Pi - (log(varianceSum)/2.0) - ((meanDifference*meanDifference)/(2.0*varianceSum));
+        Scalar logSqrt2Pi = log(sqrt(Scalar(2) * Scalar(M_PI)));
+        return -logSqrt2Pi - (log(varianceSum)/Scalar(2)) - ((meanDifference*meanDifference)/(Scalar(2)*varianceSum));
     }
     
-    static double LogRatioNormalization(GaussianDistribution numerator, GaussianDistribution denominator)
+    static Scalar LogRatioNormalization(BasicGaussianDistribution numerator, BasicGaussianDistribution denominator)
     {
         if ((numerator.precision == 0) || (denominator.precision == 0))
         {
             return 0;
         }
         
-        double varianceDifference = denominator.variance - numerator.variance;
-        double meanDifference = numerator.mean - denominator.mean;
+        Scalar varianceDifference = denominator.variance - numerator.variance;
+        Scalar meanDifference = numerator.mean - denominator.mean;
         
-        double logSqrt2Pi = log(sqrt(2*M_PI));
+        Scalar logSqrt2Pi = log(sqrt(Scalar(2)*Scalar(M_PI)));
         
-        return log(denominator.variance) + logSqrt2Pi - log(varianceDifference)/2.0 + (meanDifference*meanDifference)/(2*varianceDifference);
+        return log(denominator.variance) + logSqrt2Pi - log(varianceDifference)/Scalar(2) + (meanDifference*meanDifference)/(Scalar(2)*varianceDifference);
     }
     
-    static double At(double x)
+    static Scalar At(Scalar x)
     {
         return At(x, 0, 1);
     }
     
-    static double At(double x, double mean, double standardDeviation)
+    static Scalar At(Scalar x, Scalar mean, Scalar standardDeviation)
     {
         // See http://mathworld.wolfram.com/NormalDistribution.html
         //                1              -(x-mean)^2 / (2*stdDev^2)
         // P(x) = ------------------- * e
         //        stdDev * sqrt(2*pi)
         
-        double multiplier = 1.0/(standardDeviation * sqrt(2.0 * M_PI));
-        double expPart = exp((-1.0*pow(x - mean, 2.0))/(2*(standardDeviation*standardDeviation)));
-        double result = multiplier*expPart;
+        Scalar multiplier = Scalar(1)/(standardDeviation * sqrt(Scalar(2) * Scalar(M_PI)));
+        Scalar expPart = exp((Scalar(-1)*pow(x - mean, Scalar(2)))/(Scalar(2)*(standardDeviation*standardDeviation)));
+        Scalar result = multiplier*expPart;
         return result;
     }
     
-    static double CumulativeTo(double x, double mean, double standardDeviation)
+    static Scalar CumulativeTo(Scalar x, Scalar mean, Scalar standardDeviation)
     {
-        double invsqrt2 = -0.707106781186547524400844362104;
-        double result = ErrorFunctionCumulativeTo(invsqrt2*x);
-        return 0.5*result;
+        Scalar invsqrt2 = Scalar(-0.707106781186547524400844362104);
+        Scalar result = ErrorFunctionCumulativeTo(invsqrt2*x);
+        return Scalar(0.5)*result;
     }
     
-    static double CumulativeTo(double x)
+    static Scalar CumulativeTo(Scalar x)
     {
         return CumulativeTo(x, 0, 1);
     }
     
-    static double ErrorFunctionCumulativeTo(double x)
+    // Standard normal distribution at the given accuracy tier, see GaussianAccuracy
+    static Scalar CumulativeTo(Scalar x, GaussianAccuracy accuracy)
+    {
+        Scalar invsqrt2 = Scalar(-0.707106781186547524400844362104);
+        Scalar result = ErrorFunctionCumulativeTo(invsqrt2*x, accuracy);
+        return Scalar(0.5)*result;
+    }
+    
+    static Scalar ErrorFunctionCumulativeTo(Scalar x)
+    {
+        return ErrorFunctionCumulativeTo(x, GAUSSIAN_ACCURACY_FULL);
+    }
+    
+    static Scalar ErrorFunctionCumulativeTo(Scalar x, GaussianAccuracy accuracy)
     {
-        // Derived from page 265 of Numerical Recipes 3rd Edition
-        double z = fabs(x);
+        // Derived from page 265 of Numerical Recipes 3rd Edition, the lower tiers drop the smallest coefficients
+        Scalar z = fabs(x);
         
-        double t = 2.0/(2.0 + z);
-        double ty = 4*t - 2;
+        Scalar t = Scalar(2)/(Scalar(2) + z);
+        Scalar ty = Scalar(4)*t - Scalar(2);
         
-        double coefficients[28] = {
+        Scalar coefficients[28] = {
             -1.3026537197817094, 6.4196979235649026e-1,
             1.9476473204185836e-2, -9.561514786808631e-3, -9.46595344482036e-4,
             3.66839497852761e-4, 4.2523324806907e-5, -2.0278578112534e-5,
@@ -123,75 +141,91 @@ struct GaussianDistribution
             -1.12708e-13, 3.81e-16, 7.106e-15, -1.523e-15, -9.4e-17, 1.21e-16, -2.8e-17
         };
         
-        int ncof = 28;
-        double d = 0.0;
-        double dd = 0.0;
+        int ncof = GaussianAccuracyTiers::ErrorFunctionCoefficientCount(accuracy);
+        Scalar d = 0.0;
+        Scalar dd = 0.0;
         
         
         for (int j = ncof - 1; j > 0; j--)
         {
-            double tmp = d;
+            Scalar tmp = d;
             d = ty*d - dd + coefficients[j];
             dd = tmp;
         }
         
-        double ans = t*exp(-z*z + 0.5*(coefficients[0] + ty*d) - dd);
-        return x >= 0.0 ? ans : (2.0 - ans);
+        Scalar ans = t*exp(-z*z + Scalar(0.5)*(coefficients[0] + ty*d) - dd);
+        return x >= Scalar(0) ? ans : (Scalar(2) - ans);
     }
     
     
-    static double InverseErrorFunctionCumulativeTo(double p)
+    static Scalar InverseErrorFunctionCumulativeTo(Scalar p)
+    {
+        return InverseErrorFunctionCumulativeTo(p, GAUSSIAN_ACCURACY_FULL);
+    }
+    
+    static Scalar InverseErrorFunctionCumulativeTo(Scalar p, GaussianAccuracy accuracy)
     {
         // From page 265 of numerical recipes
         
-        if (p >= 2.0)
+        if (p >= Scalar(2))
         {
+            SKILLS_COUNT(COUNTER_INVERSE_ERROR_FUNCTION_CLAMP);
             return -100;
         }
-        if (p <= 0.0)
+        if (p <= Scalar(0))
         {
+            SKILLS_COUNT(COUNTER_INVERSE_ERROR_FUNCTION_CLAMP);
             return 100;
         }
         
-        double pp = (p < 1.0) ? p : 2 - p;
-        double t = sqrt(-2*log(pp/2.0)); // Initial guess
-        double x = -0.70711*((2.30753 + t*0.27061)/(1.0 + t*(0.99229 + t*0.04481)) - t);
+        Scalar pp = (p < Scalar(1)) ? p : Scalar(2) - p;
+        Scalar t = sqrt(Scalar(-2)*log(pp/Scalar(2))); // Initial guess
+        Scalar x = Scalar(-0.70711)*((Scalar(2.30753) + t*Scalar(0.27061))/(Scalar(1) + t*(Scalar(0.99229) + t*Scalar(0.04481))) - t);
         
-        for (int j = 0; j < 2; j++)
+        int steps = GaussianAccuracyTiers::HalleyStepCount(accuracy);
+        for (int j = 0; j < steps; j++)
         {
-            double err = ErrorFunctionCumulativeTo(x) - pp;
-            x += err/(1.12837916709551257*exp(-(x*x)) - x*err); // Halley
+            Scalar err = ErrorFunctionCumulativeTo(x, accuracy) - pp;
+            x += err/(Scalar(1.12837916709551257)*exp(-(x*x)) - x*err); // Halley
         }
         
-        return p < 1.0 ? x : -x;
+        return p < Scalar(1) ? x : -x;
     }
     
-    static double InverseCumulativeTo(double x, double mean, double standardDeviation)
+    static Scalar InverseCumulativeTo(Scalar x, Scalar mean, Scalar standardDeviation)
     {
         // From numerical recipes, page 320
-        return mean - sqrt(2)*standardDeviation*InverseErrorFunctionCumulativeTo(2*x);
+        return mean - sqrt(Scalar(2))*standardDeviation*InverseErrorFunctionCumulativeTo(Scalar(2)*x);
     }
     
-    static double InverseCumulativeTo(double x)
+    static Scalar InverseCumulativeTo(Scalar x)
     {
         return InverseCumulativeTo(x, 0, 1);
     }
     
-    friend GaussianDistribution operator * (const GaussianDistribution left, const GaussianDistribution right)
+    static Scalar InverseCumulativeTo(Scalar x, GaussianAccuracy accuracy)
+    {
+        return -sqrt(Scalar(2))*InverseErrorFunctionCumulativeTo(Scalar(2)*x, accuracy);
+    }
+    
+    friend BasicGaussianDistribution operator * (const BasicGaussianDistribution left, const BasicGaussianDistribution right)
     {
         return FromPrecisionMean(left.precisionMean + right.precisionMean, left.precision + right.precision);
     }
     
-    friend double operator - (const GaussianDistribution left, const GaussianDistribution right)
+    friend Scalar operator - (const BasicGaussianDistribution left, const BasicGaussianDistribution right)
     {
-        double a = fabs(left.precisionMean - right.precisionMean);
-        double b = sqrt(fabs(left.precision - right.precision));
+        Scalar a = fabs(left.precisionMean - right.precisionMean);
+        Scalar b = sqrt(fabs(left.precision - right.precision));
         return a > b ? a : b;
     }
     
-    friend GaussianDistribution operator /(const GaussianDistribution numerator, const  GaussianDistribution denominator)
+    friend BasicGaussianDistribution operator /(const BasicGaussianDistribution numerator, const  BasicGaussianDistribution denominator)
     {
         return FromPrecisionMean(numerator.precisionMean - denominator.precisionMean,
                                  numerator.precision - denominator.precision);
     }
-};
\ No newline at end of file
+};
+
+typedef BasicGaussianDistribution<double> GaussianDistribution;
+typedef BasicGaussianDistribution<float> FloatGaussianDistribution;
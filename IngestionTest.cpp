@@ -0,0 +1,313 @@
+//
+//  IngestionTest.cpp
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "MatchIngestion.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Drives MatchIngestion from several producer threads and checks the ratings against a ConcurrentRatingStore
+// updated sequentially, bit for bit: the store after the last result and every rating a callback hands out.
+// Every producer has players of its own, so whatever the interleaving each player sees their results in the
+// producer's order and the sequential replay is the exact answer. Covers backpressure on a small queue,
+// TrySubmit on a full one, the deadline, Flush and the destructor applying what is still queued. Exits with 1
+// on any difference, run by ctest.
+
+namespace
+{
+    const int PRODUCER_COUNT = 4;
+    const size_t PLAYERS_PER_PRODUCER = 200;
+    const size_t MATCHES_PER_PRODUCER = 20000;
+    const size_t STORE_CAPACITY = 4096;
+    const uint64_t SEED = 20140420;
+
+    // the deadline test fails after this, far above the deadline itself
+    const int DEADLINE_TIMEOUT_MILLISECONDS = 5000;
+
+    struct Match
+    {
+        uint64_t player1;
+        uint64_t player2;
+        int rank1;
+        int rank2;
+        Rating expected1;   // ratings the sequential store gave after this match
+        Rating expected2;
+    };
+
+    typedef std::vector<std::vector<Match> > Histories;
+
+    // sparse ids so the store has to hash, producer k owns the ids of players j * PRODUCER_COUNT + k
+    uint64_t PlayerId(int producer, size_t player)
+    {
+        return (player * PRODUCER_COUNT + producer) * 7919 + 1;
+    }
+
+    void MakeHistories(const GameModel& model, Histories& histories)
+    {
+        ConcurrentRatingStore reference(model, STORE_CAPACITY);
+        histories.resize(PRODUCER_COUNT);
+        for (int producer = 0; producer < PRODUCER_COUNT; producer++)
+        {
+            std::mt19937_64 random(SEED + producer);
+            std::vector<Match>& history = histories[producer];
+            while (history.size() < MATCHES_PER_PRODUCER)
+            {
+                size_t player1 = random() % PLAYERS_PER_PRODUCER;
+                size_t player2 = random() % PLAYERS_PER_PRODUCER;
+                if (player1 == player2)
+                {
+                    continue;
+                }
+
+                Match match;
+                match.player1 = PlayerId(producer, player1);
+                match.player2 = PlayerId(producer, player2);
+                match.rank1 = (int) (random() % 3);
+                match.rank2 = 1;
+                reference.CalculateNewRatings(match.player1, match.player2, match.rank1, match.rank2, match.expected1, match.expected2);
+                history.push_back(match);
+            }
+        }
+    }
+
+    bool SameBits(const Rating& a, const Rating& b)
+    {
+        return memcmp(&a.mean, &b.mean, sizeof(double)) == 0 && memcmp(&a.standardDeviation, &b.standardDeviation, sizeof(double)) == 0;
+    }
+
+    // Counts callbacks whose ratings differ from the sequential ones
+    struct Checker
+    {
+        std::atomic<size_t> mismatches;
+        std::atomic<size_t> callbacks;
+
+        Checker() : mismatches(0), callbacks(0) { }
+
+        MatchIngestion::Callback For(const Match& match)
+        {
+            return [this, &match](const MatchIngestion::Result& result)
+            {
+                if (!result.applied || !SameBits(result.player1, match.expected1) || !SameBits(result.player2, match.expected2))
+                {
+                    mismatches.fetch_add(1);
+                }
+                callbacks.fetch_add(1);
+            };
+        }
+    };
+
+    void Produce(MatchIngestion& ingestion, const std::vector<Match>& history, Checker& checker, bool trySubmit,
+                 std::atomic<size_t>& rejected)
+    {
+        for (size_t i = 0; i < history.size(); i++)
+        {
+            const Match& match = history[i];
+            if (!trySubmit)
+            {
+                ingestion.Submit(match.player1, match.player2, match.rank1, match.rank2, checker.For(match));
+                continue;
+            }
+
+            while (!ingestion.TrySubmit(match.player1, match.player2, match.rank1, match.rank2, checker.For(match)))
+            {
+                rejected.fetch_add(1);
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // The final state of the store against the last expected rating of every player
+    size_t CountStoreMismatches(const ConcurrentRatingStore& store, const Histories& histories)
+    {
+        size_t mismatches = 0;
+        for (size_t producer = 0; producer < histories.size(); producer++)
+        {
+            std::vector<Rating> last(PLAYERS_PER_PRODUCER);
+            std::vector<bool> played(PLAYERS_PER_PRODUCER, false);
+            const std::vector<Match>& history = histories[producer];
+            for (size_t i = 0; i < history.size(); i++)
+            {
+                size_t player1 = (size_t) ((history[i].player1 - 1) / 7919 / PRODUCER_COUNT);
+                size_t player2 = (size_t) ((history[i].player2 - 1) / 7919 / PRODUCER_COUNT);
+                last[player1] = history[i].expected1;
+                last[player2] = history[i].expected2;
+                played[player1] = played[player2] = true;
+            }
+
+            for (size_t player = 0; player < PLAYERS_PER_PRODUCER; player++)
+            {
+                Rating rating;
+                bool found = store.Get(PlayerId((int) producer, player), rating);
+                if (found != played[player] || (found && !SameBits(rating, last[player])))
+                {
+                    mismatches++;
+                }
+            }
+        }
+        return mismatches;
+    }
+
+    bool Report(const char* name, bool passed, const char* detail)
+    {
+        printf("%-44s %s%s%s\n", name, passed ? "passed" : "FAILED", detail[0] ? ", " : "", detail);
+        return passed;
+    }
+
+    // Every producer submits its history at once. With flush the ingestion is flushed and checked while it
+    // still runs, otherwise it is destroyed by the caller right after the producers finish and has to apply the rest.
+    bool ProduceAll(MatchIngestion& ingestion, const Histories& histories, Checker& checker, bool trySubmit, bool flush,
+                    std::atomic<size_t>& rejected)
+    {
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < PRODUCER_COUNT; producer++)
+        {
+            producers.push_back(std::thread(Produce, std::ref(ingestion), std::cref(histories[producer]), std::ref(checker),
+                                            trySubmit, std::ref(rejected)));
+        }
+        for (size_t i = 0; i < producers.size(); i++)
+        {
+            producers[i].join();
+        }
+
+        if (!flush)
+        {
+            return true;
+        }
+
+        size_t total = PRODUCER_COUNT * MATCHES_PER_PRODUCER;
+        ingestion.Flush();
+        return ingestion.Processed() == total && ingestion.Pending() == 0 && checker.callbacks.load() == total;
+    }
+
+    // MatchIngestion is cache line aligned, so it lives on the stack rather than behind new
+    bool RunProducers(const char* name, const GameModel& model, const Histories& histories, size_t queueCapacity, size_t batchSize,
+                      ThreadPool* pool, bool trySubmit, bool flush)
+    {
+        ConcurrentRatingStore store(model, STORE_CAPACITY);
+        Checker checker;
+        std::atomic<size_t> rejected(0);
+        size_t total = PRODUCER_COUNT * MATCHES_PER_PRODUCER;
+        bool consistent;
+        if (pool)
+        {
+            MatchIngestion ingestion(store, queueCapacity, batchSize, 1000, *pool);
+            consistent = ProduceAll(ingestion, histories, checker, trySubmit, flush, rejected);
+        }
+        else
+        {
+            MatchIngestion ingestion(store, queueCapacity, batchSize, 1000);
+            consistent = ProduceAll(ingestion, histories, checker, trySubmit, flush, rejected);
+        }
+
+        size_t storeMismatches = CountStoreMismatches(store, histories);
+        char detail[160];
+        snprintf(detail, sizeof(detail), "%zu callbacks, %zu differ, %zu players differ, %zu rejected submits", checker.callbacks.load(),
+                 checker.mismatches.load(), storeMismatches, rejected.load());
+        return Report(name, consistent && checker.callbacks.load() == total && checker.mismatches.load() == 0 && storeMismatches == 0, detail);
+    }
+
+    // The consumer is held in a callback, TrySubmit must fill the ring exactly and then fail
+    bool RunFullQueue(const GameModel& model, const Histories& histories)
+    {
+        const size_t capacity = 16;
+        const std::vector<Match>& history = histories[0];
+
+        ConcurrentRatingStore store(model, STORE_CAPACITY);
+        MatchIngestion ingestion(store, capacity, 1, 1000);
+        Checker checker;
+
+        std::promise<void> entered;
+        std::promise<void> releasePromise;
+        std::shared_future<void> release = releasePromise.get_future().share();
+
+        MatchIngestion::Callback first = checker.For(history[0]);
+        ingestion.Submit(history[0].player1, history[0].player2, history[0].rank1, history[0].rank2, [&](const MatchIngestion::Result& result)
+        {
+            first(result);
+            entered.set_value();
+            release.wait();
+        });
+        entered.get_future().wait();
+
+        size_t accepted = 0;
+        while (accepted + 1 < history.size() &&
+               ingestion.TrySubmit(history[accepted + 1].player1, history[accepted + 1].player2, history[accepted + 1].rank1,
+                                   history[accepted + 1].rank2, checker.For(history[accepted + 1])))
+        {
+            accepted++;
+        }
+
+        releasePromise.set_value();
+        ingestion.Flush();
+
+        bool identical = checker.mismatches.load() == 0 && checker.callbacks.load() == accepted + 1 && ingestion.Processed() == accepted + 1;
+        char detail[128];
+        snprintf(detail, sizeof(detail), "%zu accepted before TrySubmit failed, queue of %zu", accepted, capacity);
+        return Report("TrySubmit on a full queue", identical && accepted == capacity, detail);
+    }
+
+    // A batch that never fills up has to be applied once its first result waited the deadline, nobody flushes
+    bool RunDeadline(const GameModel& model, const Histories& histories)
+    {
+        const size_t count = 5;
+        const std::vector<Match>& history = histories[0];
+
+        ConcurrentRatingStore store(model, STORE_CAPACITY);
+        MatchIngestion ingestion(store, 1024, 1000, 2000);
+
+        std::vector<std::future<MatchIngestion::Result> > futures;
+        for (size_t i = 0; i < count; i++)
+        {
+            futures.push_back(ingestion.SubmitWithFuture(history[i].player1, history[i].player2, history[i].rank1, history[i].rank2));
+        }
+
+        bool identical = true;
+        bool inTime = true;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (futures[i].wait_for(std::chrono::milliseconds(DEADLINE_TIMEOUT_MILLISECONDS)) != std::future_status::ready)
+            {
+                inTime = false;
+                break;
+            }
+            MatchIngestion::Result result = futures[i].get();
+            identical = identical && result.applied && SameBits(result.player1, history[i].expected1) &&
+                        SameBits(result.player2, history[i].expected2);
+        }
+
+        return Report("deadline applies a partial batch", inTime && identical, inTime ? "" : "results never arrived");
+    }
+}
+
+int main()
+{
+    GameModel model;
+    Histories histories;
+    MakeHistories(model, histories);
+    printf("%d producers, %zu matches each\n\n", PRODUCER_COUNT, MATCHES_PER_PRODUCER);
+
+    ThreadPool pool(4);
+    bool success = true;
+
+    success = RunProducers("Submit, small queue, Flush", model, histories, 64, 256, NULL, false, true) && success;
+    success = RunProducers("Submit, small queue, destructor drains", model, histories, 64, 256, NULL, false, false) && success;
+    success = RunProducers("Submit with pool, Flush", model, histories, 1024, 512, &pool, false, true) && success;
+    success = RunProducers("TrySubmit retries, destructor drains", model, histories, 32, 16, NULL, true, false) && success;
+    success = RunProducers("TrySubmit with pool, batch of 1, Flush", model, histories, 8, 1, &pool, true, true) && success;
+    success = RunFullQueue(model, histories) && success;
+    success = RunDeadline(model, histories) && success;
+
+    printf("\n%s\n", success ? "all ingestion results identical" : "ingestion results differ");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,283 @@
+//
+//  Instrumentation.cpp
+//  Skills
+//
+//  Created by KleMiX on 06/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "Instrumentation.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef SKILLS_INSTRUMENTATION
+#include <mutex>
+#include <vector>
+#endif
+
+uint64_t Instrumentation::Histogram::PercentileNanoseconds(double percentile) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t) ceil(percentile / 100.0 * count);
+    target = target == 0 ? 1 : target;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKET_COUNT; b++)
+    {
+        seen += buckets[b];
+        if (seen >= target)
+        {
+            return std::min(((uint64_t) 2 << b) - 1, maximumNanoseconds);
+        }
+    }
+    return maximumNanoseconds;
+}
+
+const char* Instrumentation::CounterName(InstrumentationCounter counter)
+{
+    switch (counter)
+    {
+        case COUNTER_V_EXCEEDS_MARGIN_FALLBACK:
+            return "VExceedsMargin fallback";
+        case COUNTER_W_EXCEEDS_MARGIN_FALLBACK:
+            return "WExceedsMargin fallback";
+        case COUNTER_V_WITHIN_MARGIN_FALLBACK:
+            return "VWithinMargin fallback";
+        case COUNTER_W_WITHIN_MARGIN_FALLBACK:
+            return "WWithinMargin fallback";
+        case COUNTER_INVERSE_ERROR_FUNCTION_CLAMP:
+            return "InverseErrorFunctionCumulativeTo clamp";
+        case COUNTER_INGESTION_QUEUE_FULL:
+            return "MatchIngestion queue full";
+        default:
+            return "unknown";
+    }
+}
+
+const char* Instrumentation::TimerName(InstrumentationTimer timer)
+{
+    switch (timer)
+    {
+        case TIMER_CALCULATE_NEW_RATINGS:
+            return "RatingCalculator::CalculateNewRatings";
+        case TIMER_CALCULATE_NEW_RATINGS_BATCH:
+            return "RatingCalculator::CalculateNewRatings table";
+        case TIMER_TEAM_CALCULATE_NEW_RATINGS:
+            return "TeamRatingCalculator::CalculateNewRatings";
+        case TIMER_INGESTION_BATCH:
+            return "MatchIngestion batch";
+        default:
+            return "unknown";
+    }
+}
+
+#ifdef SKILLS_INSTRUMENTATION
+
+namespace
+{
+    // Blocks of the live threads plus everything threads that exited left behind
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<Instrumentation::ThreadStatistics*> threads;
+        Instrumentation::Snapshot retired;
+
+        Registry()
+        {
+            memset(&retired, 0, sizeof(retired));
+        }
+    };
+
+    Registry& GlobalRegistry()
+    {
+        // never destroyed, threads may exit after static destruction started
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    void Clear(Instrumentation::ThreadStatistics& statistics)
+    {
+        for (int c = 0; c < COUNTER_COUNT; c++)
+        {
+            statistics.counters[c].store(0, std::memory_order_relaxed);
+        }
+        for (int t = 0; t < TIMER_COUNT; t++)
+        {
+            statistics.timerTotals[t].store(0, std::memory_order_relaxed);
+            statistics.timerMaximums[t].store(0, std::memory_order_relaxed);
+            for (int b = 0; b < Instrumentation::HISTOGRAM_BUCKET_COUNT; b++)
+            {
+                statistics.timerBuckets[t][b].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Accumulate(const Instrumentation::ThreadStatistics& statistics, Instrumentation::Snapshot& snapshot)
+    {
+        for (int c = 0; c < COUNTER_COUNT; c++)
+        {
+            snapshot.counters[c] += statistics.counters[c].load(std::memory_order_relaxed);
+        }
+        for (int t = 0; t < TIMER_COUNT; t++)
+        {
+            Instrumentation::Histogram& histogram = snapshot.timers[t];
+            histogram.totalNanoseconds += statistics.timerTotals[t].load(std::memory_order_relaxed);
+            histogram.maximumNanoseconds = std::max(histogram.maximumNanoseconds, statistics.timerMaximums[t].load(std::memory_order_relaxed));
+            for (int b = 0; b < Instrumentation::HISTOGRAM_BUCKET_COUNT; b++)
+            {
+                uint64_t bucket = statistics.timerBuckets[t][b].load(std::memory_order_relaxed);
+                histogram.buckets[b] += bucket;
+                histogram.count += bucket;
+            }
+        }
+    }
+
+    void Accumulate(const Instrumentation::Snapshot& source, Instrumentation::Snapshot& snapshot)
+    {
+        for (int c = 0; c < COUNTER_COUNT; c++)
+        {
+            snapshot.counters[c] += source.counters[c];
+        }
+        for (int t = 0; t < TIMER_COUNT; t++)
+        {
+            snapshot.timers[t].count += source.timers[t].count;
+            snapshot.timers[t].totalNanoseconds += source.timers[t].totalNanoseconds;
+            snapshot.timers[t].maximumNanoseconds = std::max(snapshot.timers[t].maximumNanoseconds, source.timers[t].maximumNanoseconds);
+            for (int b = 0; b < Instrumentation::HISTOGRAM_BUCKET_COUNT; b++)
+            {
+                snapshot.timers[t].buckets[b] += source.timers[t].buckets[b];
+            }
+        }
+    }
+
+    // Registers the block of its thread and hands the numbers over to the registry when the thread exits
+    struct ThreadSlot
+    {
+        Instrumentation::ThreadStatistics statistics;
+
+        ThreadSlot()
+        {
+            Clear(statistics);
+            Registry& registry = GlobalRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.threads.push_back(&statistics);
+        }
+
+        ~ThreadSlot()
+        {
+            Registry& registry = GlobalRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            Accumulate(statistics, registry.retired);
+            registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), &statistics));
+        }
+    };
+
+    int BucketOf(uint64_t nanoseconds)
+    {
+        int bucket = 0;
+        while (nanoseconds > 1 && bucket < Instrumentation::HISTOGRAM_BUCKET_COUNT - 1)
+        {
+            nanoseconds >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+}
+
+Instrumentation::ThreadStatistics& Instrumentation::ForCurrentThread()
+{
+    static thread_local ThreadSlot slot;
+    return slot.statistics;
+}
+
+void Instrumentation::Record(InstrumentationTimer timer, uint64_t nanoseconds)
+{
+    ThreadStatistics& statistics = ForCurrentThread();
+    Add(statistics.timerTotals[timer], nanoseconds);
+    Add(statistics.timerBuckets[timer][BucketOf(nanoseconds)], 1);
+    if (nanoseconds > statistics.timerMaximums[timer].load(std::memory_order_relaxed))
+    {
+        statistics.timerMaximums[timer].store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+bool Instrumentation::Enabled()
+{
+    return true;
+}
+
+void Instrumentation::GetSnapshot(Snapshot& snapshot)
+{
+    memset(&snapshot, 0, sizeof(snapshot));
+
+    Registry& registry = GlobalRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Accumulate(registry.retired, snapshot);
+    for (size_t i = 0; i < registry.threads.size(); i++)
+    {
+        Accumulate(*registry.threads[i], snapshot);
+    }
+}
+
+// Other threads may be counting at the same time, their increments in flight can survive the reset
+void Instrumentation::Reset()
+{
+    Registry& registry = GlobalRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    memset(&registry.retired, 0, sizeof(registry.retired));
+    for (size_t i = 0; i < registry.threads.size(); i++)
+    {
+        Clear(*registry.threads[i]);
+    }
+}
+
+#else
+
+bool Instrumentation::Enabled()
+{
+    return false;
+}
+
+void Instrumentation::GetSnapshot(Snapshot& snapshot)
+{
+    memset(&snapshot, 0, sizeof(snapshot));
+}
+
+void Instrumentation::Reset()
+{
+}
+
+#endif
+
+void Instrumentation::Dump(FILE* file)
+{
+    if (!Enabled())
+    {
+        fprintf(file, "instrumentation disabled, build with SKILLS_INSTRUMENTATION\n");
+        return;
+    }
+
+    Snapshot snapshot;
+    GetSnapshot(snapshot);
+
+    for (int c = 0; c < COUNTER_COUNT; c++)
+    {
+        fprintf(file, "%-48s %16llu\n", CounterName((InstrumentationCounter) c), (unsigned long long) snapshot.counters[c]);
+    }
+
+    for (int t = 0; t < TIMER_COUNT; t++)
+    {
+        const Histogram& histogram = snapshot.timers[t];
+        double average = histogram.count ? (double) histogram.totalNanoseconds / histogram.count : 0.0;
+        fprintf(file, "%-48s %16llu calls, average %.1f ns, p50 %llu ns, p99 %llu ns, max %llu ns\n",
+                TimerName((InstrumentationTimer) t), (unsigned long long) histogram.count, average,
+                (unsigned long long) histogram.PercentileNanoseconds(50), (unsigned long long) histogram.PercentileNanoseconds(99),
+                (unsigned long long) histogram.maximumNanoseconds);
+    }
+}
@@ -0,0 +1,130 @@
+//
+//  Instrumentation.h
+//  Skills
+//
+//  Created by KleMiX on 06/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef SKILLS_INSTRUMENTATION
+#include <atomic>
+#include <chrono>
+#endif
+
+// Counters of the numerical fallbacks and latency histograms of the rating updates. Only compiled in when
+// SKILLS_INSTRUMENTATION is defined (the CMake option of the same name), otherwise SKILLS_COUNT and
+// SKILLS_TIME expand to nothing and the snapshot stays zero.
+//
+// Every thread writes its own block of counters, so the hot path never shares a cache line. GetSnapshot
+// sums the blocks of all threads, threads that already exited included.
+enum InstrumentationCounter
+{
+    COUNTER_V_EXCEEDS_MARGIN_FALLBACK = 0,
+    COUNTER_W_EXCEEDS_MARGIN_FALLBACK,
+    COUNTER_V_WITHIN_MARGIN_FALLBACK,
+    COUNTER_W_WITHIN_MARGIN_FALLBACK,
+    COUNTER_INVERSE_ERROR_FUNCTION_CLAMP,
+    COUNTER_INGESTION_QUEUE_FULL,
+    COUNTER_COUNT,
+};
+
+enum InstrumentationTimer
+{
+    TIMER_CALCULATE_NEW_RATINGS = 0,
+    TIMER_CALCULATE_NEW_RATINGS_BATCH,
+    TIMER_TEAM_CALCULATE_NEW_RATINGS,
+    TIMER_INGESTION_BATCH,
+    TIMER_COUNT,
+};
+
+namespace Instrumentation
+{
+    // bucket b holds durations in [2^b, 2^(b+1)) ns, bucket 0 also holds 0
+    const int HISTOGRAM_BUCKET_COUNT = 40;
+
+    struct Histogram
+    {
+        uint64_t count;
+        uint64_t totalNanoseconds;
+        uint64_t maximumNanoseconds;
+        uint64_t buckets[HISTOGRAM_BUCKET_COUNT];
+
+        // Upper bound of the bucket the percentile (0, 100] falls in, 0 when empty
+        uint64_t PercentileNanoseconds(double percentile) const;
+    };
+
+    struct Snapshot
+    {
+        uint64_t counters[COUNTER_COUNT];
+        Histogram timers[TIMER_COUNT];
+    };
+
+    // False when built without SKILLS_INSTRUMENTATION
+    bool        Enabled();
+
+    void        GetSnapshot(Snapshot& snapshot);
+    void        Reset();
+    void        Dump(FILE* file);
+
+    const char* CounterName(InstrumentationCounter counter);
+    const char* TimerName(InstrumentationTimer timer);
+
+#ifdef SKILLS_INSTRUMENTATION
+    // Written by the owning thread only, atomics so GetSnapshot can read them at any time
+    struct ThreadStatistics
+    {
+        std::atomic<uint64_t> counters[COUNTER_COUNT];
+        std::atomic<uint64_t> timerTotals[TIMER_COUNT];
+        std::atomic<uint64_t> timerMaximums[TIMER_COUNT];
+        std::atomic<uint64_t> timerBuckets[TIMER_COUNT][HISTOGRAM_BUCKET_COUNT];
+    };
+
+    ThreadStatistics& ForCurrentThread();
+
+    inline void Add(std::atomic<uint64_t>& value, uint64_t amount)
+    {
+        // single writer, a plain load and store is enough and avoids the locked add
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    inline void Increment(InstrumentationCounter counter)
+    {
+        Add(ForCurrentThread().counters[counter], 1);
+    }
+
+    void Record(InstrumentationTimer timer, uint64_t nanoseconds);
+
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(InstrumentationTimer timer) : timer(timer), start(std::chrono::steady_clock::now()) { }
+
+        ~ScopedTimer()
+        {
+            std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+            Record(timer, (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+    private:
+        ScopedTimer(const ScopedTimer&);
+        ScopedTimer& operator = (const ScopedTimer&);
+
+        InstrumentationTimer timer;
+        std::chrono::steady_clock::time_point start;
+    };
+#endif
+}
+
+#ifdef SKILLS_INSTRUMENTATION
+#define SKILLS_COUNT(counter) Instrumentation::Increment(counter)
+#define SKILLS_TIME(timer) Instrumentation::ScopedTimer scopedTimer(timer)
+#else
+#define SKILLS_COUNT(counter) ((void) 0)
+#define SKILLS_TIME(timer) ((void) 0)
+#endif
@@ -0,0 +1,333 @@
+//
+//  Leaderboard.cpp
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "Leaderboard.h"
+
+#include <math.h>
+
+Leaderboard::Leaderboard(size_t expectedPlayerCount) : root(NO_NODE), randomState(2463534242u)
+{
+    nodes.reserve(expectedPlayerCount);
+    players.reserve(expectedPlayerCount);
+}
+
+uint32_t Leaderboard::NextPriority()
+{
+    // xorshift32, the treap only needs priorities that don't follow the ratings
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+void Leaderboard::Resize(uint32_t node)
+{
+    nodes[node].size = 1 + SizeOf(nodes[node].left) + SizeOf(nodes[node].right);
+}
+
+void Leaderboard::Split(uint32_t root, const Node& key, uint32_t& ahead, uint32_t& behind)
+{
+    if (root == NO_NODE)
+    {
+        ahead = NO_NODE;
+        behind = NO_NODE;
+        return;
+    }
+
+    if (IsAhead(nodes[root], key.conservativeRating, key.playerId))
+    {
+        Split(nodes[root].right, key, nodes[root].right, behind);
+        ahead = root;
+    }
+    else
+    {
+        Split(nodes[root].left, key, ahead, nodes[root].left);
+        behind = root;
+    }
+    Resize(root);
+}
+
+uint32_t Leaderboard::Merge(uint32_t ahead, uint32_t behind)
+{
+    if (ahead == NO_NODE)
+    {
+        return behind;
+    }
+    if (behind == NO_NODE)
+    {
+        return ahead;
+    }
+
+    if (nodes[ahead].priority > nodes[behind].priority)
+    {
+        nodes[ahead].right = Merge(nodes[ahead].right, behind);
+        Resize(ahead);
+        return ahead;
+    }
+    else
+    {
+        nodes[behind].left = Merge(ahead, nodes[behind].left);
+        Resize(behind);
+        return behind;
+    }
+}
+
+void Leaderboard::Insert(uint32_t& root, uint32_t node)
+{
+    if (root == NO_NODE)
+    {
+        root = node;
+        return;
+    }
+
+    if (nodes[node].priority > nodes[root].priority)
+    {
+        Split(root, nodes[node], nodes[node].left, nodes[node].right);
+        Resize(node);
+        root = node;
+        return;
+    }
+
+    if (IsAhead(nodes[node], nodes[root].conservativeRating, nodes[root].playerId))
+    {
+        Insert(nodes[root].left, node);
+    }
+    else
+    {
+        Insert(nodes[root].right, node);
+    }
+    Resize(root);
+}
+
+void Leaderboard::Erase(uint32_t& root, const Node& key)
+{
+    if (nodes[root].playerId == key.playerId)
+    {
+        root = Merge(nodes[root].left, nodes[root].right);
+        return;
+    }
+
+    if (IsAhead(key, nodes[root].conservativeRating, nodes[root].playerId))
+    {
+        Erase(nodes[root].left, key);
+    }
+    else
+    {
+        Erase(nodes[root].right, key);
+    }
+    Resize(root);
+}
+
+void Leaderboard::Update(uint64_t playerId, double conservativeRating)
+{
+    uint32_t node;
+    std::unordered_map<uint64_t, uint32_t>::iterator player = players.find(playerId);
+    if (player != players.end())
+    {
+        node = player->second;
+        if (nodes[node].conservativeRating == conservativeRating)
+        {
+            return;
+        }
+
+        Node key = nodes[node];
+        Erase(root, key);
+    }
+    else
+    {
+        if (freeNodes.empty())
+        {
+            node = (uint32_t) nodes.size();
+            nodes.push_back(Node());
+        }
+        else
+        {
+            node = freeNodes.back();
+            freeNodes.pop_back();
+        }
+        nodes[node].playerId = playerId;
+        nodes[node].priority = NextPriority();
+        players[playerId] = node;
+    }
+
+    nodes[node].conservativeRating = conservativeRating;
+    nodes[node].size = 1;
+    nodes[node].left = NO_NODE;
+    nodes[node].right = NO_NODE;
+    Insert(root, node);
+}
+
+void Leaderboard::Update(uint64_t playerId, Rating rating)
+{
+    Update(playerId, rating.ConservativeRating());
+}
+
+bool Leaderboard::Remove(uint64_t playerId)
+{
+    std::unordered_map<uint64_t, uint32_t>::iterator player = players.find(playerId);
+    if (player == players.end())
+    {
+        return false;
+    }
+
+    Node key = nodes[player->second];
+    Erase(root, key);
+    freeNodes.push_back(player->second);
+    players.erase(player);
+    return true;
+}
+
+bool Leaderboard::Contains(uint64_t playerId) const
+{
+    return players.find(playerId) != players.end();
+}
+
+size_t Leaderboard::Size() const
+{
+    return players.size();
+}
+
+bool Leaderboard::Rank(uint64_t playerId, size_t& rank) const
+{
+    std::unordered_map<uint64_t, uint32_t>::const_iterator player = players.find(playerId);
+    if (player == players.end())
+    {
+        return false;
+    }
+
+    const Node& key = nodes[player->second];
+    rank = 0;
+    uint32_t node = root;
+    while (node != player->second)
+    {
+        if (IsAhead(key, nodes[node].conservativeRating, nodes[node].playerId))
+        {
+            node = nodes[node].left;
+        }
+        else
+        {
+            rank += SizeOf(nodes[node].left) + 1;
+            node = nodes[node].right;
+        }
+    }
+    rank += SizeOf(nodes[node].left);
+    return true;
+}
+
+bool Leaderboard::Get(size_t rank, Entry& entry) const
+{
+    if (rank >= Size())
+    {
+        return false;
+    }
+
+    uint32_t node = root;
+    for (;;)
+    {
+        size_t leftSize = SizeOf(nodes[node].left);
+        if (rank < leftSize)
+        {
+            node = nodes[node].left;
+        }
+        else if (rank == leftSize)
+        {
+            break;
+        }
+        else
+        {
+            rank -= leftSize + 1;
+            node = nodes[node].right;
+        }
+    }
+
+    entry.playerId = nodes[node].playerId;
+    entry.conservativeRating = nodes[node].conservativeRating;
+    return true;
+}
+
+// offset is the rank of the first player under root
+void Leaderboard::Collect(uint32_t root, size_t first, size_t last, size_t offset, std::vector<Entry>& result) const
+{
+    if (root == NO_NODE || offset >= last || offset + nodes[root].size <= first)
+    {
+        return;
+    }
+
+    const Node& node = nodes[root];
+    size_t rank = offset + SizeOf(node.left);
+    Collect(node.left, first, last, offset, result);
+    if (rank >= first && rank < last)
+    {
+        Entry entry;
+        entry.playerId = node.playerId;
+        entry.conservativeRating = node.conservativeRating;
+        result.push_back(entry);
+    }
+    Collect(node.right, first, last, rank + 1, result);
+}
+
+void Leaderboard::GetRange(size_t first, size_t last, std::vector<Entry>& result) const
+{
+    result.clear();
+    if (last > Size())
+    {
+        last = Size();
+    }
+    if (first >= last)
+    {
+        return;
+    }
+
+    result.reserve(last - first);
+    Collect(root, first, last, 0, result);
+}
+
+size_t Leaderboard::CountAbove(double conservativeRating) const
+{
+    size_t count = 0;
+    uint32_t node = root;
+    while (node != NO_NODE)
+    {
+        if (nodes[node].conservativeRating > conservativeRating)
+        {
+            count += SizeOf(nodes[node].left) + 1;
+            node = nodes[node].right;
+        }
+        else
+        {
+            node = nodes[node].left;
+        }
+    }
+    return count;
+}
+
+bool Leaderboard::Percentile(uint64_t playerId, double& percentile) const
+{
+    size_t rank;
+    if (!Rank(playerId, rank))
+    {
+        return false;
+    }
+
+    size_t size = Size();
+    percentile = size > 1 ? (double) (size - 1 - rank) / (size - 1) : 1.0;
+    return true;
+}
+
+bool Leaderboard::GetAtPercentile(double percentile, Entry& entry) const
+{
+    size_t size = Size();
+    if (size == 0)
+    {
+        return false;
+    }
+
+    percentile = percentile < 0 ? 0 : (percentile > 1 ? 1 : percentile);
+    size_t rank = (size_t) floor((1 - percentile) * (size - 1) + 0.5);
+    return Get(rank, entry);
+}
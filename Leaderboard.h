@@ -0,0 +1,95 @@
+//
+//  Leaderboard.h
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "Rating.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Players ordered by conservative rating, kept up to date one rating change at a time instead of sorting
+// everybody again. Higher ratings rank first, equal ratings by player id, rank 0 is the best player.
+//
+// It's a treap with subtree sizes in the nodes, so updates and rank queries are O(log n) expected. Nodes
+// live in one pool and are reused, an update of a known player allocates nothing.
+class Leaderboard
+{
+public:
+    struct Entry
+    {
+        uint64_t playerId;
+        double conservativeRating;
+    };
+
+    explicit Leaderboard(size_t expectedPlayerCount = 0);
+
+    // Adds the player or moves it to its new place
+    void    Update(uint64_t playerId, double conservativeRating);
+    void    Update(uint64_t playerId, Rating rating);
+    bool    Remove(uint64_t playerId);
+    bool    Contains(uint64_t playerId) const;
+    size_t  Size() const;
+
+    // False when the player isn't on the leaderboard
+    bool    Rank(uint64_t playerId, size_t& rank) const;
+    bool    Get(size_t rank, Entry& entry) const;
+
+    // Players ranked [first, last), best first, clamped to the size
+    void    GetRange(size_t first, size_t last, std::vector<Entry>& result) const;
+
+    // Players with a strictly higher rating, which is the rank a new player with this rating would get
+    // before id ordering among equal ratings
+    size_t  CountAbove(double conservativeRating) const;
+
+    // Fraction of the other players ranked below the player, 1 is the best and 0 the worst
+    bool    Percentile(uint64_t playerId, double& percentile) const;
+
+    // The player at a percentile in [0, 1] as Percentile measures it, false when empty
+    bool    GetAtPercentile(double percentile, Entry& entry) const;
+
+private:
+    static const uint32_t NO_NODE = ~0u;
+
+    struct Node
+    {
+        double conservativeRating;
+        uint64_t playerId;
+        uint32_t priority;
+        uint32_t size;
+        uint32_t left;
+        uint32_t right;
+    };
+
+    static bool IsAhead(const Node& node, double conservativeRating, uint64_t playerId)
+    {
+        return node.conservativeRating > conservativeRating || (node.conservativeRating == conservativeRating && node.playerId < playerId);
+    }
+
+    uint32_t SizeOf(uint32_t node) const
+    {
+        return node == NO_NODE ? 0 : nodes[node].size;
+    }
+
+    void    Resize(uint32_t node);
+    void    Insert(uint32_t& root, uint32_t node);
+    void    Erase(uint32_t& root, const Node& key);
+    void    Split(uint32_t root, const Node& key, uint32_t& ahead, uint32_t& behind);
+    uint32_t Merge(uint32_t ahead, uint32_t behind);
+    void    Collect(uint32_t root, size_t first, size_t last, size_t offset, std::vector<Entry>& result) const;
+
+    uint32_t NextPriority();
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    std::unordered_map<uint64_t, uint32_t> players;
+    uint32_t root;
+    uint32_t randomState;
+};
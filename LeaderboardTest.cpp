@@ -0,0 +1,227 @@
+//
+//  LeaderboardTest.cpp
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "Leaderboard.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+// Runs random updates and removals on a Leaderboard and after them asks every query of the treap and of a
+// plain vector sorted the way the leaderboard promises, best rating first and equal ratings by id. Ratings
+// come from a handful of values so ties are everywhere, and players are removed and new ones added all the
+// time so freed nodes get reused. Exits with 1 on the first answer that differs, run by ctest.
+
+namespace
+{
+    const size_t ID_COUNT = 600;
+    const size_t OPERATION_COUNT = 40000;
+    const size_t CHECK_EVERY = 8;
+    const int RATING_LEVELS = 12;
+    const uint64_t SEED = 20140330;
+
+    typedef std::map<uint64_t, double> Players;
+
+    bool Ahead(const Leaderboard::Entry& a, const Leaderboard::Entry& b)
+    {
+        return a.conservativeRating > b.conservativeRating || (a.conservativeRating == b.conservativeRating && a.playerId < b.playerId);
+    }
+
+    bool Same(const Leaderboard::Entry& a, const Leaderboard::Entry& b)
+    {
+        return a.playerId == b.playerId && a.conservativeRating == b.conservativeRating;
+    }
+
+    void Sort(const Players& players, std::vector<Leaderboard::Entry>& sorted)
+    {
+        sorted.clear();
+        for (Players::const_iterator player = players.begin(); player != players.end(); ++player)
+        {
+            Leaderboard::Entry entry;
+            entry.playerId = player->first;
+            entry.conservativeRating = player->second;
+            sorted.push_back(entry);
+        }
+        std::sort(sorted.begin(), sorted.end(), Ahead);
+    }
+
+    uint64_t PlayerId(size_t index)
+    {
+        return index * 0x9E3779B97F4A7C15ull;
+    }
+
+    // Every query against the sorted players, prints the first difference
+    bool Check(const Leaderboard& leaderboard, const Players& players, std::mt19937_64& random, size_t operation)
+    {
+        std::vector<Leaderboard::Entry> sorted;
+        Sort(players, sorted);
+        size_t size = sorted.size();
+
+        const char* failed = NULL;
+        if (leaderboard.Size() != size)
+        {
+            failed = "Size";
+        }
+
+        Leaderboard::Entry entry;
+        for (size_t rank = 0; !failed && rank < size; rank++)
+        {
+            size_t measured;
+            double percentile;
+            double expectedPercentile = size > 1 ? (double) (size - 1 - rank) / (size - 1) : 1.0;
+            if (!leaderboard.Get(rank, entry) || !Same(entry, sorted[rank]))
+            {
+                failed = "Get";
+            }
+            else if (!leaderboard.Contains(sorted[rank].playerId) || !leaderboard.Rank(sorted[rank].playerId, measured) || measured != rank)
+            {
+                failed = "Rank";
+            }
+            else if (!leaderboard.Percentile(sorted[rank].playerId, percentile) || percentile != expectedPercentile)
+            {
+                failed = "Percentile";
+            }
+            else if (!leaderboard.GetAtPercentile(expectedPercentile, entry) || !Same(entry, sorted[rank]))
+            {
+                failed = "GetAtPercentile";
+            }
+        }
+
+        if (!failed && (leaderboard.Get(size, entry) || (size == 0 && leaderboard.GetAtPercentile(0.5, entry))))
+        {
+            failed = "Get past the end";
+        }
+
+        for (int level = -1; !failed && level <= RATING_LEVELS; level++)
+        {
+            // on every rating value and between them
+            for (int half = 0; half < 2 && !failed; half++)
+            {
+                double rating = level + half * 0.5;
+                size_t above = 0;
+                while (above < size && sorted[above].conservativeRating > rating)
+                {
+                    above++;
+                }
+                if (leaderboard.CountAbove(rating) != above)
+                {
+                    failed = "CountAbove";
+                }
+            }
+        }
+
+        for (int range = 0; !failed && range < 8; range++)
+        {
+            size_t first = random() % (size + 4);
+            size_t last = random() % (size + 4);
+            std::vector<Leaderboard::Entry> result;
+            leaderboard.GetRange(first, last, result);
+
+            size_t end = std::min(last, size);
+            size_t expected = first < end ? end - first : 0;
+            bool same = result.size() == expected;
+            for (size_t i = 0; same && i < expected; i++)
+            {
+                same = Same(result[i], sorted[first + i]);
+            }
+            if (!same)
+            {
+                failed = "GetRange";
+            }
+        }
+
+        for (size_t i = 0; !failed && i < ID_COUNT; i++)
+        {
+            size_t rank;
+            double percentile;
+            bool known = players.count(PlayerId(i)) != 0;
+            if (!known && (leaderboard.Contains(PlayerId(i)) || leaderboard.Rank(PlayerId(i), rank) ||
+                           leaderboard.Percentile(PlayerId(i), percentile)))
+            {
+                failed = "removed player still found";
+            }
+        }
+
+        if (failed)
+        {
+            printf("%s differs after operation %zu with %zu players\n", failed, operation, size);
+        }
+        return !failed;
+    }
+
+    double RandomRating(std::mt19937_64& random)
+    {
+        return (double) (random() % RATING_LEVELS);
+    }
+}
+
+int main()
+{
+    std::mt19937_64 random(SEED);
+    Leaderboard leaderboard(ID_COUNT / 2);
+    Players players;
+    bool success = Check(leaderboard, players, random, 0);
+
+    size_t updates = 0;
+    size_t removals = 0;
+    for (size_t operation = 1; success && operation <= OPERATION_COUNT; operation++)
+    {
+        uint64_t playerId = PlayerId(random() % ID_COUNT);
+        int kind = (int) (random() % 10);
+        if (kind < 3)
+        {
+            bool known = players.erase(playerId) != 0;
+            if (leaderboard.Remove(playerId) != known)
+            {
+                printf("Remove differs after operation %zu\n", operation);
+                success = false;
+            }
+            removals += known;
+        }
+        else if (kind < 4)
+        {
+            // through the Rating overload, which ranks by ConservativeRating
+            Rating rating(RandomRating(random) + 3 * 2.0, 2.0);
+            leaderboard.Update(playerId, rating);
+            players[playerId] = rating.ConservativeRating();
+            updates++;
+        }
+        else
+        {
+            double rating = RandomRating(random);
+            leaderboard.Update(playerId, rating);
+            players[playerId] = rating;
+            updates++;
+        }
+
+        if (success && (operation % CHECK_EVERY == 0 || players.size() < 4))
+        {
+            success = Check(leaderboard, players, random, operation);
+        }
+    }
+
+    // empty it, then refill from the freed nodes only
+    for (size_t i = 0; success && i < ID_COUNT; i++)
+    {
+        leaderboard.Remove(PlayerId(i));
+        players.erase(PlayerId(i));
+    }
+    success = success && Check(leaderboard, players, random, OPERATION_COUNT);
+    for (size_t i = 0; success && i < ID_COUNT; i += 2)
+    {
+        double rating = RandomRating(random);
+        leaderboard.Update(PlayerId(i), rating);
+        players[PlayerId(i)] = rating;
+    }
+    success = success && Check(leaderboard, players, random, OPERATION_COUNT);
+
+    printf("%zu updates, %zu removals, %s\n", updates, removals, success ? "every query agrees" : "FAILED");
+    return success ? 0 : 1;
+}
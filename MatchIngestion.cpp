@@ -0,0 +1,379 @@
+//
+//  MatchIngestion.cpp
+//  Skills
+//
+//  Created by KleMiX on 13/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "MatchIngestion.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace
+{
+    // results per pool task when a wave is spread over the pool
+    const size_t RESULTS_PER_TASK = 64;
+
+    // Submit yields this many times before it starts sleeping
+    const int SUBMIT_SPIN_COUNT = 16;
+    const int SUBMIT_SLEEP_MICROSECONDS = 50;
+
+    // the consumer looks at the queue at least this often even when nobody woke it
+    const int IDLE_WAIT_MILLISECONDS = 10;
+}
+
+MatchIngestion::MatchIngestion(ConcurrentRatingStore& store, size_t queueCapacity, size_t batchSize, uint64_t maximumDelayMicroseconds) :
+    store(store), pool(NULL), batchSize(std::max(batchSize, (size_t) 1)), maximumDelayMicroseconds(maximumDelayMicroseconds)
+{
+    Start(queueCapacity);
+}
+
+MatchIngestion::MatchIngestion(ConcurrentRatingStore& store, size_t queueCapacity, size_t batchSize, uint64_t maximumDelayMicroseconds,
+                               ThreadPool& pool) :
+    store(store), pool(&pool), batchSize(std::max(batchSize, (size_t) 1)), maximumDelayMicroseconds(maximumDelayMicroseconds)
+{
+    Start(queueCapacity);
+}
+
+MatchIngestion::~MatchIngestion()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping.store(true);
+    }
+    wakeUp.notify_one();
+    consumer.join();
+
+    delete[] cells;
+}
+
+void MatchIngestion::Start(size_t queueCapacity)
+{
+    size_t cellCount = 2;
+    while (cellCount < queueCapacity)
+    {
+        cellCount *= 2;
+    }
+    mask = cellCount - 1;
+
+    // a cell can be written when its sequence equals the position, read when it is one more
+    cells = new Cell[cellCount];
+    for (size_t i = 0; i < cellCount; i++)
+    {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    enqueuePosition.store(0, std::memory_order_relaxed);
+    dequeuePosition.store(0, std::memory_order_relaxed);
+    processed.store(0, std::memory_order_relaxed);
+    consumerSleeping.store(false, std::memory_order_relaxed);
+    wakeThreshold.store(1, std::memory_order_relaxed);
+    flushWaiters.store(0, std::memory_order_relaxed);
+    stopping.store(false, std::memory_order_relaxed);
+
+    batch.reserve(batchSize);
+    consumer = std::thread(&MatchIngestion::ConsumerLoop, this);
+}
+
+bool MatchIngestion::Push(uint64_t player1, uint64_t player2, int rank1, int rank2, Callback& callback)
+{
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;)
+    {
+        cell = &cells[position & mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        ptrdiff_t difference = (ptrdiff_t) sequence - (ptrdiff_t) position;
+        if (difference == 0)
+        {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // the consumer hasn't freed the cell of the previous round yet
+            return false;
+        }
+        else
+        {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->item.player1 = player1;
+    cell->item.player2 = player2;
+    cell->item.rank1 = rank1;
+    cell->item.rank2 = rank2;
+    cell->item.callback = std::move(callback);
+    cell->sequence.store(position + 1, std::memory_order_release);
+
+    // pairs with the fence in ConsumerLoop, either the consumer sees this result or we see it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumerSleeping.load(std::memory_order_relaxed))
+    {
+        size_t queued = position + 1 - dequeuePosition.load(std::memory_order_relaxed);
+        if (queued >= wakeThreshold.load(std::memory_order_relaxed))
+        {
+            WakeConsumer();
+        }
+    }
+    return true;
+}
+
+bool MatchIngestion::TrySubmit(uint64_t player1, uint64_t player2, int rank1, int rank2, Callback callback)
+{
+    if (Push(player1, player2, rank1, rank2, callback))
+    {
+        return true;
+    }
+
+    SKILLS_COUNT(COUNTER_INGESTION_QUEUE_FULL);
+    return false;
+}
+
+void MatchIngestion::Submit(uint64_t player1, uint64_t player2, int rank1, int rank2, Callback callback)
+{
+    for (int attempt = 0; !Push(player1, player2, rank1, rank2, callback); attempt++)
+    {
+        if (attempt == 0)
+        {
+            SKILLS_COUNT(COUNTER_INGESTION_QUEUE_FULL);
+            WakeConsumer();
+        }
+
+        if (attempt < SUBMIT_SPIN_COUNT)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(SUBMIT_SLEEP_MICROSECONDS));
+        }
+    }
+}
+
+std::future<MatchIngestion::Result> MatchIngestion::SubmitWithFuture(uint64_t player1, uint64_t player2, int rank1, int rank2)
+{
+    std::shared_ptr<std::promise<Result> > promise = std::make_shared<std::promise<Result> >();
+    std::future<Result> future = promise->get_future();
+    Submit(player1, player2, rank1, rank2, [promise](const Result& result)
+    {
+        promise->set_value(result);
+    });
+    return future;
+}
+
+void MatchIngestion::Flush()
+{
+    // every result that got a position before this one, published or about to be
+    uint64_t target = enqueuePosition.load(std::memory_order_acquire);
+
+    flushWaiters.fetch_add(1);
+    WakeConsumer();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        batchDone.wait(lock, [&]() { return processed.load() >= target; });
+    }
+    flushWaiters.fetch_sub(1);
+}
+
+size_t MatchIngestion::Pending() const
+{
+    return enqueuePosition.load(std::memory_order_relaxed) - (size_t) processed.load(std::memory_order_relaxed);
+}
+
+uint64_t MatchIngestion::Processed() const
+{
+    return processed.load(std::memory_order_relaxed);
+}
+
+bool MatchIngestion::TryPop(Item& item)
+{
+    // single consumer, nobody else moves dequeuePosition
+    size_t position = dequeuePosition.load(std::memory_order_relaxed);
+    Cell& cell = cells[position & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+    {
+        return false;
+    }
+
+    item.player1 = cell.item.player1;
+    item.player2 = cell.item.player2;
+    item.rank1 = cell.item.rank1;
+    item.rank2 = cell.item.rank2;
+    item.callback = std::move(cell.item.callback);
+    cell.item.callback = nullptr;
+
+    dequeuePosition.store(position + 1, std::memory_order_relaxed);
+    cell.sequence.store(position + mask + 1, std::memory_order_release);
+    return true;
+}
+
+bool MatchIngestion::HasQueued() const
+{
+    size_t position = dequeuePosition.load(std::memory_order_relaxed);
+    return cells[position & mask].sequence.load(std::memory_order_acquire) == position + 1;
+}
+
+void MatchIngestion::WakeConsumer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        consumerSleeping.store(false, std::memory_order_relaxed);
+    }
+    wakeUp.notify_one();
+}
+
+void MatchIngestion::ConsumerLoop()
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point deadline;
+    Item item;
+
+    for (;;)
+    {
+        while (batch.size() < batchSize && TryPop(item))
+        {
+            if (batch.empty())
+            {
+                deadline = Clock::now() + std::chrono::microseconds(maximumDelayMicroseconds);
+            }
+            batch.push_back(std::move(item));
+        }
+
+        bool stop = stopping.load();
+        if (!batch.empty() && (batch.size() == batchSize || stop || flushWaiters.load() > 0 || Clock::now() >= deadline))
+        {
+            ProcessBatch();
+            continue;
+        }
+        if (stop)
+        {
+            // producers are gone and everything they queued is applied
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeThreshold.store(batch.empty() ? 1 : batchSize - batch.size(), std::memory_order_relaxed);
+        consumerSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // a partial batch only waits for the rest of it, the deadline or a flush
+        bool ready = batch.empty() ? HasQueued() : (enqueuePosition.load() - dequeuePosition.load() >= batchSize - batch.size());
+        if (!ready && !stopping.load() && flushWaiters.load() == 0)
+        {
+            if (batch.empty())
+            {
+                wakeUp.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MILLISECONDS));
+            }
+            else
+            {
+                wakeUp.wait_until(lock, deadline);
+            }
+        }
+        consumerSleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void MatchIngestion::ProcessBatch()
+{
+    SKILLS_TIME(TIMER_INGESTION_BATCH);
+
+    size_t count = batch.size();
+    if (!pool || count <= RESULTS_PER_TASK)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            Apply(batch[i]);
+        }
+    }
+    else
+    {
+        // wave after the last one either player appeared in, counting sorted by wave
+        lastWave.clear();
+        waveOf.resize(count);
+        size_t waveCount = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t wave = 0;
+            std::unordered_map<uint64_t, size_t>::iterator found = lastWave.find(batch[i].player1);
+            if (found != lastWave.end())
+            {
+                wave = found->second + 1;
+            }
+            found = lastWave.find(batch[i].player2);
+            if (found != lastWave.end())
+            {
+                wave = std::max(wave, found->second + 1);
+            }
+            lastWave[batch[i].player1] = wave;
+            lastWave[batch[i].player2] = wave;
+            waveOf[i] = wave;
+            waveCount = std::max(waveCount, wave + 1);
+        }
+
+        waveOffsets.assign(waveCount + 1, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            waveOffsets[waveOf[i] + 1]++;
+        }
+        for (size_t w = 0; w < waveCount; w++)
+        {
+            waveOffsets[w + 1] += waveOffsets[w];
+        }
+        ordered.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            ordered[waveOffsets[waveOf[i]]++] = &batch[i];
+        }
+        for (size_t w = waveCount; w > 0; w--)
+        {
+            waveOffsets[w] = waveOffsets[w - 1];
+        }
+        waveOffsets[0] = 0;
+
+        for (size_t w = 0; w < waveCount; w++)
+        {
+            Item** wave = &ordered[waveOffsets[w]];
+            pool->ParallelFor(waveOffsets[w + 1] - waveOffsets[w], RESULTS_PER_TASK, [this, wave](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    Apply(*wave[i]);
+                }
+            });
+        }
+    }
+
+    batch.clear();
+    processed.fetch_add(count);
+
+    if (flushWaiters.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batchDone.notify_all();
+    }
+}
+
+void MatchIngestion::Apply(Item& item)
+{
+    Result result;
+    result.applied = store.CalculateNewRatings(item.player1, item.player2, item.rank1, item.rank2, result.player1, result.player2);
+    if (!result.applied)
+    {
+        result.player1 = store.Get(item.player1);
+        result.player2 = store.Get(item.player2);
+    }
+
+    if (item.callback)
+    {
+        item.callback(result);
+        item.callback = nullptr;
+    }
+}
@@ -0,0 +1,123 @@
+//
+//  MatchIngestion.h
+//  Skills
+//
+//  Created by KleMiX on 13/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "ConcurrentRatingStore.h"
+#include "ThreadPool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Takes match results off the threads that finish the matches and rates them on a thread of its own.
+//
+// Producers put results into a bounded lock-free ring (a compare-and-swap on the ring position and a couple
+// of stores, nothing is allocated unless the callback needs it), a consumer thread takes them out in batches
+// of up to batchSize and applies them to the store. A batch is cut short once its first result waited
+// maximumDelayMicroseconds. When the ring is full TrySubmit fails and Submit waits for room, that's the
+// backpressure. With a pool every batch is split into waves like ParallelReplay, no player twice in a wave
+// and every player's results in submission order, and the waves are spread over the pool.
+//
+// Callbacks run on the consumer thread (or the pool) after the update, keep them short. Readers can keep
+// using the store directly, it is safe to read while the consumer writes.
+class MatchIngestion
+{
+public:
+    struct Result
+    {
+        bool applied;       // false when the store was full, the ratings are then the current ones
+        Rating player1;
+        Rating player2;
+    };
+
+    typedef std::function<void(const Result& result)> Callback;
+
+    // queueCapacity is rounded up to a power of two
+    MatchIngestion(ConcurrentRatingStore& store, size_t queueCapacity, size_t batchSize, uint64_t maximumDelayMicroseconds);
+    MatchIngestion(ConcurrentRatingStore& store, size_t queueCapacity, size_t batchSize, uint64_t maximumDelayMicroseconds,
+                   ThreadPool& pool);
+    // Applies everything still queued before returning
+    ~MatchIngestion();
+
+    // Ranks follow RatingCalculator::CalculateNewRatings. False when the queue is full.
+    bool    TrySubmit(uint64_t player1, uint64_t player2, int rank1, int rank2, Callback callback = Callback());
+    // Waits for room when the queue is full
+    void    Submit(uint64_t player1, uint64_t player2, int rank1, int rank2, Callback callback = Callback());
+    std::future<Result> SubmitWithFuture(uint64_t player1, uint64_t player2, int rank1, int rank2);
+
+    // Returns once everything submitted before the call is applied, doesn't wait for the deadline
+    void    Flush();
+
+    size_t  Pending() const;
+    uint64_t Processed() const;
+
+private:
+    struct Item
+    {
+        uint64_t player1;
+        uint64_t player2;
+        int rank1;
+        int rank2;
+        Callback callback;
+    };
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Item item;
+    };
+
+    MatchIngestion(const MatchIngestion&);
+    MatchIngestion& operator = (const MatchIngestion&);
+
+    void    Start(size_t queueCapacity);
+    bool    Push(uint64_t player1, uint64_t player2, int rank1, int rank2, Callback& callback);
+    bool    TryPop(Item& item);
+    bool    HasQueued() const;
+    void    WakeConsumer();
+    void    ConsumerLoop();
+    void    ProcessBatch();
+    void    Apply(Item& item);
+
+    ConcurrentRatingStore& store;
+    ThreadPool* pool;
+    size_t batchSize;
+    uint64_t maximumDelayMicroseconds;
+
+    Cell* cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePosition;
+    alignas(64) std::atomic<size_t> dequeuePosition;
+    alignas(64) std::atomic<uint64_t> processed;
+
+    // the consumer only sleeps with this set, so producers skip the lock otherwise. It wants to be woken
+    // once wakeThreshold results are queued, 1 while idle and the rest of the batch while one is filling up.
+    std::atomic<bool> consumerSleeping;
+    std::atomic<size_t> wakeThreshold;
+    std::atomic<size_t> flushWaiters;
+    std::atomic<bool> stopping;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable batchDone;
+    std::thread consumer;
+
+    // consumer thread only
+    std::vector<Item> batch;
+    std::vector<size_t> waveOf;
+    std::vector<size_t> waveOffsets;
+    std::vector<Item*> ordered;
+    std::unordered_map<uint64_t, size_t> lastWave;
+};
@@ -0,0 +1,302 @@
+//
+//  MatchLog.cpp
+//  Skills
+//
+//  Created by KleMiX on 16/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "MatchLog.h"
+#include "RatingCalculatorCore.h"
+#include "TimeDynamics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MATCH_LOG_MAGIC[8] = {'S', 'K', 'L', 'M', 'A', 'T', 'C', 'H'};
+static const size_t WRITER_BUFFER_SIZE = 1024 * 1024;
+
+static_assert(sizeof(MatchLog::Header) == 32, "match log header layout changed");
+static_assert(sizeof(MatchLog::Record) == 24, "match log record layout changed");
+static_assert(sizeof(MatchLog::WeightedRecord) == 32, "match log record layout changed");
+
+MatchLog::Writer::Writer() : file(NULL), buffer(NULL), partialPlay(false), recordCount(0)
+{
+}
+
+MatchLog::Writer::~Writer()
+{
+    Close();
+}
+
+bool MatchLog::Writer::Open(const char* path, bool partialPlay)
+{
+    Close();
+
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    buffer = (char*) malloc(WRITER_BUFFER_SIZE);
+    if (buffer)
+    {
+        setvbuf(file, buffer, _IOFBF, WRITER_BUFFER_SIZE);
+    }
+
+    this->partialPlay = partialPlay;
+    recordCount = 0;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATCH_LOG_MAGIC, sizeof(header.magic));
+    header.version = MATCH_LOG_VERSION;
+    header.flags = partialPlay ? MATCH_LOG_FLAG_PARTIAL_PLAY : 0;
+    header.recordSize = partialPlay ? sizeof(WeightedRecord) : sizeof(Record);
+
+    return fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+bool MatchLog::Writer::Append(uint64_t timestamp, uint32_t player1, uint32_t player2, int32_t rank1, int32_t rank2)
+{
+    return Append(timestamp, player1, player2, rank1, rank2, 1.0f, 1.0f);
+}
+
+bool MatchLog::Writer::Append(uint64_t timestamp, uint32_t player1, uint32_t player2, int32_t rank1, int32_t rank2, float weight1, float weight2)
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    WeightedRecord record;
+    record.match.timestamp = timestamp;
+    record.match.player1 = player1;
+    record.match.player2 = player2;
+    record.match.rank1 = rank1;
+    record.match.rank2 = rank2;
+    record.weight1 = weight1;
+    record.weight2 = weight2;
+
+    size_t size = partialPlay ? sizeof(WeightedRecord) : sizeof(Record);
+    if (fwrite(&record, size, 1, file) != 1)
+    {
+        return false;
+    }
+
+    recordCount++;
+    return true;
+}
+
+bool MatchLog::Writer::Flush()
+{
+    return file && fflush(file) == 0;
+}
+
+bool MatchLog::Writer::Close()
+{
+    if (!file)
+    {
+        return true;
+    }
+
+    bool success = fflush(file) == 0;
+
+    // count goes in last, readers don't depend on it
+    if (success && fseek(file, offsetof(Header, recordCount), SEEK_SET) == 0)
+    {
+        success = fwrite(&recordCount, sizeof(recordCount), 1, file) == 1;
+    }
+
+    success = fclose(file) == 0 && success;
+    file = NULL;
+
+    free(buffer);
+    buffer = NULL;
+    return success;
+}
+
+MatchLog::Reader::Reader(size_t windowBytes) : file(-1), windowBytes(windowBytes), recordCount(0), mapping(NULL), mappingSize(0)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+MatchLog::Reader::~Reader()
+{
+    Close();
+}
+
+bool MatchLog::Reader::Open(const char* path)
+{
+    Close();
+
+    file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+    bool valid = fstat(file, &status) == 0 &&
+                 pread(file, &header, sizeof(header), 0) == (ssize_t) sizeof(header) &&
+                 memcmp(header.magic, MATCH_LOG_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == MATCH_LOG_VERSION &&
+                 header.recordSize == (HasPartialPlay() ? sizeof(WeightedRecord) : sizeof(Record));
+    if (!valid)
+    {
+        Close();
+        return false;
+    }
+
+    // a torn record at the end is left out
+    recordCount = (size_t) (status.st_size - sizeof(header)) / header.recordSize;
+    return true;
+}
+
+void MatchLog::Reader::Close()
+{
+    Unmap();
+
+    if (file >= 0)
+    {
+        close(file);
+        file = -1;
+    }
+
+    recordCount = 0;
+}
+
+void MatchLog::Reader::Unmap()
+{
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        mapping = NULL;
+        mappingSize = 0;
+    }
+}
+
+bool MatchLog::Reader::Map(size_t first, size_t maximumCount, Window& window)
+{
+    if (file < 0 || first >= recordCount)
+    {
+        return false;
+    }
+
+    Unmap();
+
+    size_t stride = header.recordSize;
+    size_t count = std::min(maximumCount, recordCount - first);
+    count = std::min(count, std::max(windowBytes / stride, (size_t) 1));
+
+    // mappings start on a page boundary
+    size_t offset = sizeof(Header) + first * stride;
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t mappingOffset = offset & ~(pageSize - 1);
+
+    mappingSize = offset - mappingOffset + count * stride;
+    mapping = mmap(NULL, mappingSize, PROT_READ, MAP_SHARED, file, (off_t) mappingOffset);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = NULL;
+        mappingSize = 0;
+        return false;
+    }
+
+    // read ahead aggressively and drop pages behind us
+    madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+    window.data = static_cast<const char*>(mapping) + (offset - mappingOffset);
+    window.first = first;
+    window.count = count;
+    window.stride = stride;
+    window.partialPlay = HasPartialPlay();
+    return true;
+}
+
+bool MatchLog::Replay(const GameModel& model, RatingTable& table, Reader& reader, size_t maximumPlayerCount)
+{
+    size_t first = 0;
+    Window window;
+
+    bool timed = TimeDynamics::NeedsTimestamps(model, table);
+    if (timed)
+    {
+        table.TrackLastPlayed();
+    }
+
+    while (first < reader.RecordCount())
+    {
+        if (!reader.Map(first, reader.RecordCount() - first, window))
+        {
+            return false;
+        }
+
+        double* mean = table.mean.data();
+        double* standardDeviation = table.standardDeviation.data();
+
+        for (size_t i = 0; i < window.count; i++)
+        {
+            const Record& match = window.RecordAt(i);
+
+            size_t highestPlayer = std::max(match.player1, match.player2);
+            if (highestPlayer >= maximumPlayerCount || match.player1 == match.player2)
+            {
+                return false;
+            }
+            if (highestPlayer >= table.Size())
+            {
+                table.Resize(highestPlayer + 1, model.initialMean, model.initialStandardDeviation);
+                mean = table.mean.data();
+                standardDeviation = table.standardDeviation.data();
+            }
+
+            if (timed)
+            {
+                uint64_t* lastPlayed = table.lastPlayed.data();
+                standardDeviation[match.player1] = TimeDynamics::InflatedStandardDeviation(model, standardDeviation[match.player1],
+                                                                                           lastPlayed[match.player1], match.timestamp);
+                standardDeviation[match.player2] = TimeDynamics::InflatedStandardDeviation(model, standardDeviation[match.player2],
+                                                                                           lastPlayed[match.player2], match.timestamp);
+                lastPlayed[match.player1] = match.timestamp;
+                lastPlayed[match.player2] = match.timestamp;
+            }
+
+            float weight1 = window.Weight1(i);
+            float weight2 = window.Weight2(i);
+            if (weight1 >= 1.0f && weight2 >= 1.0f)
+            {
+                RatingCalculator::UpdateRatings(model, mean, standardDeviation, match.player1, match.player2, match.rank1, match.rank2);
+                continue;
+            }
+
+            Rating prior1(mean[match.player1], standardDeviation[match.player1]);
+            Rating prior2(mean[match.player2], standardDeviation[match.player2]);
+
+            RatingCalculator::UpdateRatings(model, mean, standardDeviation, match.player1, match.player2, match.rank1, match.rank2);
+
+            if (weight1 < 1.0f)
+            {
+                Rating partial = Rating::GetPartialUpdate(prior1, Rating(mean[match.player1], standardDeviation[match.player1]), weight1);
+                mean[match.player1] = partial.mean;
+                standardDeviation[match.player1] = partial.standardDeviation;
+            }
+            if (weight2 < 1.0f)
+            {
+                Rating partial = Rating::GetPartialUpdate(prior2, Rating(mean[match.player2], standardDeviation[match.player2]), weight2);
+                mean[match.player2] = partial.mean;
+                standardDeviation[match.player2] = partial.standardDeviation;
+            }
+        }
+
+        first += window.count;
+    }
+
+    return true;
+}
@@ -0,0 +1,161 @@
+//
+//  MatchLog.h
+//  Skills
+//
+//  Created by KleMiX on 16/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingTable.h"
+#include "GameModel.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Binary match history that is replayed straight from a memory mapping.
+//
+// A file is a 32 byte Header followed by fixed size records in time order, native byte order. Records are
+// a Record, or a WeightedRecord when the header has MATCH_LOG_FLAG_PARTIAL_PLAY. The record count is taken
+// from the file size, so a log whose writer died still replays everything that made it to disk.
+namespace MatchLog
+{
+    enum
+    {
+        MATCH_LOG_VERSION = 1,
+        MATCH_LOG_FLAG_PARTIAL_PLAY = 1,
+    };
+
+    struct Header
+    {
+        char magic[8];          // "SKLMATCH"
+        uint32_t version;
+        uint32_t flags;
+        uint32_t recordSize;
+        uint32_t reserved;
+        uint64_t recordCount;   // written on Close, informational
+    };
+
+    // Ranks follow RatingCalculator::CalculateNewRatings, players are indices into a RatingTable
+    struct Record
+    {
+        uint64_t timestamp;
+        uint32_t player1;
+        uint32_t player2;
+        int32_t rank1;
+        int32_t rank2;
+    };
+
+    // Fraction of the match each player took part in, (0, 1]
+    struct WeightedRecord
+    {
+        Record match;
+        float weight1;
+        float weight2;
+    };
+
+    // Appends records through a single buffer, nothing is allocated per record
+    class Writer
+    {
+    public:
+        Writer();
+        ~Writer();
+
+        bool    Open(const char* path, bool partialPlay);
+        bool    Append(uint64_t timestamp, uint32_t player1, uint32_t player2, int32_t rank1, int32_t rank2);
+        bool    Append(uint64_t timestamp, uint32_t player1, uint32_t player2, int32_t rank1, int32_t rank2, float weight1, float weight2);
+        bool    Flush();
+        bool    Close();
+
+        uint64_t RecordCount() const
+        {
+            return recordCount;
+        }
+
+    private:
+        Writer(const Writer&);
+        Writer& operator = (const Writer&);
+
+        FILE* file;
+        char* buffer;
+        bool partialPlay;
+        uint64_t recordCount;
+    };
+
+    // Records of the current window, valid until the reader maps another one
+    struct Window
+    {
+        const char* data;
+        size_t first;       // index of the first record in the file
+        size_t count;
+        size_t stride;
+        bool partialPlay;
+
+        const Record& RecordAt(size_t i) const
+        {
+            return *reinterpret_cast<const Record*>(data + i * stride);
+        }
+
+        float Weight1(size_t i) const
+        {
+            return partialPlay ? reinterpret_cast<const WeightedRecord*>(data + i * stride)->weight1 : 1.0f;
+        }
+
+        float Weight2(size_t i) const
+        {
+            return partialPlay ? reinterpret_cast<const WeightedRecord*>(data + i * stride)->weight2 : 1.0f;
+        }
+    };
+
+    // Maps a bounded window of the file at a time, so logs bigger than memory stream through the page cache
+    class Reader
+    {
+    public:
+        explicit Reader(size_t windowBytes = 64 * 1024 * 1024);
+        ~Reader();
+
+        bool    Open(const char* path);
+        void    Close();
+
+        // Maps records [first, first + maximumCount), clamped to the window size and the end of the file.
+        // False when first is past the end.
+        bool    Map(size_t first, size_t maximumCount, Window& window);
+
+        size_t  RecordCount() const
+        {
+            return recordCount;
+        }
+
+        bool    HasPartialPlay() const
+        {
+            return (header.flags & MATCH_LOG_FLAG_PARTIAL_PLAY) != 0;
+        }
+
+    private:
+        Reader(const Reader&);
+        Reader& operator = (const Reader&);
+
+        void    Unmap();
+
+        int file;
+        Header header;
+        size_t windowBytes;
+        size_t recordCount;
+
+        void* mapping;
+        size_t mappingSize;
+    };
+
+    // Applies every match of the log in order, the table grows to fit the player indices. Matches with full
+    // weights give exactly the ratings of RatingCalculator::CalculateNewRatings, partial ones are scaled down
+    // with Rating::GetPartialUpdate. When TimeDynamics::NeedsTimestamps both players are first inflated to the
+    // record's timestamp and marked as played then, like TimeDynamics::CalculateNewRatings.
+    //
+    // The file is not trusted: a record with a player index of maximumPlayerCount or more, or a player against
+    // themselves, is taken as corruption and stops the replay, so one bad index can't grow the table to
+    // gigabytes. On false (such a record or a window that couldn't be mapped) every match before the failing
+    // one has been applied and none after it, replay into a copy when the table must stay untouched.
+    bool    Replay(const GameModel& model, RatingTable& table, Reader& reader, size_t maximumPlayerCount);
+}
@@ -0,0 +1,235 @@
+//
+//  MatchLogTest.cpp
+//  Skills
+//
+//  Created by KleMiX on 16/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "MatchLog.h"
+#include "RatingCalculator.h"
+#include "TimeDynamics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Writes seeded histories with MatchLog::Writer, reads them back with a Reader whose window holds only a few
+// hundred records and replays them with MatchLog::Replay. The table must match, bit for bit, the ratings of
+// applying the same matches one by one: RatingCalculator::CalculateNewRatings, Rating::GetPartialUpdate for
+// partial play and the TimeDynamics inflation for timestamped logs. A torn record at the end must be left out,
+// and a corrupt player index must stop the replay with everything before it applied and the table not grown.
+// Exits with 1 on any difference, run by ctest.
+
+namespace
+{
+    const char* LOG_PATH = "MatchLogTest.skl";
+    const size_t PLAYER_COUNT = 500;
+    const size_t MATCH_COUNT = 20000;
+    const size_t WINDOW_BYTES = 4096;
+    const uint64_t SEED = 20140316;
+
+    struct Match
+    {
+        uint64_t timestamp;
+        uint32_t player1;
+        uint32_t player2;
+        int32_t rank1;
+        int32_t rank2;
+        float weight1;
+        float weight2;
+    };
+
+    // Players join over time so the table grows during the replay, a few hours between matches
+    void MakeHistory(bool partialPlay, std::vector<Match>& matches)
+    {
+        std::mt19937_64 random(SEED + partialPlay);
+        uint64_t timestamp = 1397952000;
+        matches.clear();
+        while (matches.size() < MATCH_COUNT)
+        {
+            size_t joined = 2 + matches.size() * (PLAYER_COUNT - 2) / MATCH_COUNT;
+            Match match;
+            match.timestamp = timestamp += random() % 20000;
+            match.player1 = (uint32_t) (random() % joined);
+            match.player2 = (uint32_t) (random() % joined);
+            match.rank1 = (int32_t) (random() % 3);
+            match.rank2 = 1;
+            match.weight1 = partialPlay && random() % 3 == 0 ? (float) (random() % 100 + 1) / 100 : 1.0f;
+            match.weight2 = partialPlay && random() % 3 == 0 ? (float) (random() % 100 + 1) / 100 : 1.0f;
+            if (match.player1 != match.player2)
+            {
+                matches.push_back(match);
+            }
+        }
+    }
+
+    bool Write(const std::vector<Match>& matches, bool partialPlay)
+    {
+        MatchLog::Writer writer;
+        bool written = writer.Open(LOG_PATH, partialPlay);
+        for (size_t i = 0; written && i < matches.size(); i++)
+        {
+            const Match& match = matches[i];
+            written = partialPlay ? writer.Append(match.timestamp, match.player1, match.player2, match.rank1, match.rank2, match.weight1, match.weight2) :
+                                    writer.Append(match.timestamp, match.player1, match.player2, match.rank1, match.rank2);
+        }
+        return writer.Close() && written;
+    }
+
+    // One match at a time through the public single match functions
+    void ReplayMatches(const GameModel& model, const std::vector<Match>& matches, size_t count, std::vector<Rating>& ratings)
+    {
+        bool timed = TimeDynamics::NeedsTimestamps(model);
+        ratings.clear();
+        std::vector<uint64_t> lastPlayed;
+        for (size_t i = 0; i < count; i++)
+        {
+            const Match& match = matches[i];
+            size_t highestPlayer = std::max(match.player1, match.player2);
+            if (highestPlayer >= ratings.size())
+            {
+                ratings.resize(highestPlayer + 1, Rating(model.initialMean, model.initialStandardDeviation));
+                lastPlayed.resize(highestPlayer + 1, NEVER_PLAYED);
+            }
+
+            Rating& rating1 = ratings[match.player1];
+            Rating& rating2 = ratings[match.player2];
+            if (timed)
+            {
+                rating1.standardDeviation = TimeDynamics::InflatedStandardDeviation(model, rating1.standardDeviation, lastPlayed[match.player1], match.timestamp);
+                rating2.standardDeviation = TimeDynamics::InflatedStandardDeviation(model, rating2.standardDeviation, lastPlayed[match.player2], match.timestamp);
+                lastPlayed[match.player1] = match.timestamp;
+                lastPlayed[match.player2] = match.timestamp;
+            }
+
+            Rating prior1 = rating1;
+            Rating prior2 = rating2;
+            RatingCalculator::CalculateNewRatings(model, rating1, rating2, match.rank1, match.rank2);
+            if (match.weight1 < 1.0f)
+            {
+                rating1 = Rating::GetPartialUpdate(prior1, rating1, match.weight1);
+            }
+            if (match.weight2 < 1.0f)
+            {
+                rating2 = Rating::GetPartialUpdate(prior2, rating2, match.weight2);
+            }
+        }
+    }
+
+    size_t CountDifferences(const std::vector<Rating>& expected, const RatingTable& table)
+    {
+        if (expected.size() != table.Size())
+        {
+            return expected.size() + table.Size();
+        }
+
+        size_t differing = 0;
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            if (memcmp(&expected[i].mean, &table.mean[i], sizeof(double)) != 0 ||
+                memcmp(&expected[i].standardDeviation, &table.standardDeviation[i], sizeof(double)) != 0)
+            {
+                differing++;
+            }
+        }
+        return differing;
+    }
+
+    bool Report(const char* name, bool passed, size_t differing)
+    {
+        printf("%-40s %s", name, passed ? "identical" : "FAILED");
+        if (differing > 0)
+        {
+            printf(", %zu players differ", differing);
+        }
+        printf("\n");
+        return passed;
+    }
+
+    bool CheckRoundTrip(const char* name, const GameModel& model, bool partialPlay)
+    {
+        std::vector<Match> matches;
+        MakeHistory(partialPlay, matches);
+
+        std::vector<Rating> expected;
+        ReplayMatches(model, matches, matches.size(), expected);
+
+        MatchLog::Reader reader(WINDOW_BYTES);
+        RatingTable table;
+        bool replayed = Write(matches, partialPlay) && reader.Open(LOG_PATH) && reader.HasPartialPlay() == partialPlay &&
+                        reader.RecordCount() == matches.size() && MatchLog::Replay(model, table, reader, PLAYER_COUNT);
+
+        size_t differing = replayed ? CountDifferences(expected, table) : 0;
+        return Report(name, replayed && differing == 0, differing);
+    }
+
+    // Half a record of garbage at the end is what a writer dying mid-record leaves behind
+    bool CheckTornRecord(const GameModel& model)
+    {
+        std::vector<Match> matches;
+        MakeHistory(false, matches);
+
+        bool written = Write(matches, false);
+        FILE* file = fopen(LOG_PATH, "ab");
+        char garbage[sizeof(MatchLog::Record) / 2];
+        memset(garbage, 0xFF, sizeof(garbage));
+        written = file && fwrite(garbage, sizeof(garbage), 1, file) == 1 && fclose(file) == 0 && written;
+
+        std::vector<Rating> expected;
+        ReplayMatches(model, matches, matches.size(), expected);
+
+        MatchLog::Reader reader(WINDOW_BYTES);
+        RatingTable table;
+        bool replayed = written && reader.Open(LOG_PATH) && reader.RecordCount() == matches.size() &&
+                        MatchLog::Replay(model, table, reader, PLAYER_COUNT);
+
+        size_t differing = replayed ? CountDifferences(expected, table) : 0;
+        return Report("torn record at the end", replayed && differing == 0, differing);
+    }
+
+    // The corrupt record comes after the table reached its final size, Replay has to stop at it
+    bool CheckCorruptRecord(const char* name, const GameModel& model, uint32_t player1, uint32_t player2)
+    {
+        std::vector<Match> matches;
+        MakeHistory(false, matches);
+
+        size_t corrupt = matches.size() * 3 / 4;
+        matches[corrupt].player1 = player1;
+        matches[corrupt].player2 = player2;
+
+        std::vector<Rating> expected;
+        ReplayMatches(model, matches, corrupt, expected);
+
+        MatchLog::Reader reader(WINDOW_BYTES);
+        RatingTable table;
+        bool refused = Write(matches, false) && reader.Open(LOG_PATH) && !MatchLog::Replay(model, table, reader, PLAYER_COUNT);
+
+        size_t differing = refused ? CountDifferences(expected, table) : 0;
+        return Report(name, refused && differing == 0, differing);
+    }
+}
+
+int main()
+{
+    GameModel model;
+    GameModel timedModel;
+    timedModel.UseTimeDynamics(0.01, timedModel.initialStandardDeviation);
+    printf("%zu players, %zu matches\n\n", PLAYER_COUNT, MATCH_COUNT);
+
+    bool success = true;
+    success = CheckRoundTrip("full weights", model, false) && success;
+    success = CheckRoundTrip("partial play", model, true) && success;
+    success = CheckRoundTrip("timestamped, time dynamics", timedModel, false) && success;
+    success = CheckRoundTrip("timestamped, partial play", timedModel, true) && success;
+    success = CheckTornRecord(model) && success;
+    success = CheckCorruptRecord("player 0xFFFFFFFF refused", model, 0xFFFFFFFFu, 1) && success;
+    success = CheckCorruptRecord("player at the limit refused", model, 3, (uint32_t) PLAYER_COUNT) && success;
+    success = CheckCorruptRecord("player against themselves refused", model, 7, 7) && success;
+
+    remove(LOG_PATH);
+    printf("\n%s\n", success ? "all replays identical" : "replays differ");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,247 @@
+//
+//  MatchmakingIndex.cpp
+//  Skills
+//
+//  Created by KleMiX on 09/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "MatchmakingIndex.h"
+#include "RatingCalculator.h"
+
+#include <math.h>
+#include <algorithm>
+
+// Widens the mean bounds so rounding never drops a candidate the exact formula accepts
+static const double BOUND_RELATIVE_SLACK = 1e-9;
+static const double BOUND_ABSOLUTE_SLACK = 1e-9;
+
+static inline bool IsBetter(const MatchmakingIndex::Candidate& left, const MatchmakingIndex::Candidate& right)
+{
+    return left.quality > right.quality || (left.quality == right.quality && left.playerId < right.playerId);
+}
+
+static inline bool IsBetterPair(const MatchmakingIndex::Pair& left, const MatchmakingIndex::Pair& right)
+{
+    if (left.quality != right.quality)
+    {
+        return left.quality > right.quality;
+    }
+    return left.player1 < right.player1 || (left.player1 == right.player1 && left.player2 < right.player2);
+}
+
+MatchmakingIndex::MatchmakingIndex(const GameModel& model, double bandWidth) : model(model), bandWidth(bandWidth)
+{
+    if (this->bandWidth <= 0)
+    {
+        this->bandWidth = model.initialStandardDeviation / 16.0;
+    }
+}
+
+int MatchmakingIndex::BandOf(double standardDeviation) const
+{
+    return (int) floor(standardDeviation / bandWidth);
+}
+
+void MatchmakingIndex::Add(uint64_t playerId, Rating rating)
+{
+    Remove(playerId);
+
+    players[playerId] = rating;
+    bands[BandOf(rating.standardDeviation)].players.insert(Key(rating.mean, playerId));
+}
+
+bool MatchmakingIndex::Remove(uint64_t playerId)
+{
+    std::unordered_map<uint64_t, Rating>::iterator player = players.find(playerId);
+    if (player == players.end())
+    {
+        return false;
+    }
+
+    std::map<int, Band>::iterator band = bands.find(BandOf(player->second.standardDeviation));
+    band->second.players.erase(Key(player->second.mean, playerId));
+    if (band->second.players.empty())
+    {
+        bands.erase(band);
+    }
+
+    players.erase(player);
+    return true;
+}
+
+bool MatchmakingIndex::Contains(uint64_t playerId) const
+{
+    return players.find(playerId) != players.end();
+}
+
+size_t MatchmakingIndex::Size() const
+{
+    return players.size();
+}
+
+double MatchmakingIndex::MeanDistanceBound(double standardDeviation, int band, double minimumQuality) const
+{
+    if (minimumQuality <= 0)
+    {
+        return INFINITY;
+    }
+
+    // largest f(S) = S*ln(2*beta^2/(q^2*S)) over the band, f peaks at S = 2*beta^2/(q^2*e)
+    double lowSigma = std::max(0.0, band * bandWidth);
+    double highSigma = (band + 1) * bandWidth;
+
+    double base = model.twoBetaSquared + standardDeviation * standardDeviation;
+    double lowS = base + lowSigma * lowSigma;
+    double highS = base + highSigma * highSigma;
+
+    double limit = model.twoBetaSquared / (minimumQuality * minimumQuality);
+    double peak = limit / M_E;
+    double s = std::min(std::max(peak, lowS), highS);
+    double bound = s * log(limit / s);
+
+    if (bound < 0)
+    {
+        return -1;
+    }
+
+    return sqrt(bound) * (1 + BOUND_RELATIVE_SLACK) + BOUND_ABSOLUTE_SLACK;
+}
+
+void MatchmakingIndex::FindOpponents(uint64_t playerId, double minimumQuality, size_t maximumCount, std::vector<Candidate>& result) const
+{
+    std::unordered_map<uint64_t, Rating>::const_iterator player = players.find(playerId);
+    if (player == players.end())
+    {
+        result.clear();
+        return;
+    }
+
+    FindOpponents(player->second, playerId, minimumQuality, maximumCount, result);
+}
+
+void MatchmakingIndex::FindOpponents(Rating rating, uint64_t excludedPlayerId, double minimumQuality, size_t maximumCount,
+                                     std::vector<Candidate>& result) const
+{
+    result.clear();
+    if (maximumCount == 0)
+    {
+        return;
+    }
+
+    // result is a heap with the worst candidate on top while searching, once it is full only better ones
+    // get in and the threshold rises with them
+    double threshold = minimumQuality;
+
+    for (std::map<int, Band>::const_iterator band = bands.begin(); band != bands.end(); ++band)
+    {
+        // bands go up in sigma, so the best quality any of them can reach only goes down
+        double lowSigma = std::max(0.0, band->first * bandWidth);
+        double bestQuality = sqrt(model.twoBetaSquared /
+                                  (model.twoBetaSquared + rating.standardDeviation * rating.standardDeviation + lowSigma * lowSigma));
+        if (bestQuality * (1 + BOUND_RELATIVE_SLACK) < threshold)
+        {
+            break;
+        }
+
+        double distance = MeanDistanceBound(rating.standardDeviation, band->first, threshold);
+        if (distance < 0)
+        {
+            continue;
+        }
+
+        const std::set<Key>& bandPlayers = band->second.players;
+        std::set<Key>::const_iterator end = bandPlayers.upper_bound(Key(rating.mean + distance, UINT64_MAX));
+        for (std::set<Key>::const_iterator it = bandPlayers.lower_bound(Key(rating.mean - distance, 0)); it != end; ++it)
+        {
+            if (it->second == excludedPlayerId)
+            {
+                continue;
+            }
+
+            Candidate candidate;
+            candidate.playerId = it->second;
+            candidate.quality = RatingCalculator::CalculateMatchQuality(model, rating, players.find(it->second)->second);
+            if (candidate.quality < minimumQuality)
+            {
+                continue;
+            }
+
+            if (result.size() < maximumCount)
+            {
+                result.push_back(candidate);
+                std::push_heap(result.begin(), result.end(), IsBetter);
+            }
+            else if (IsBetter(candidate, result.front()))
+            {
+                std::pop_heap(result.begin(), result.end(), IsBetter);
+                result.back() = candidate;
+                std::push_heap(result.begin(), result.end(), IsBetter);
+            }
+            else
+            {
+                continue;
+            }
+
+            if (result.size() == maximumCount)
+            {
+                threshold = std::max(minimumQuality, result.front().quality);
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end(), IsBetter);
+}
+
+void MatchmakingIndex::FindAllPairs(double minimumQuality, std::vector<Pair>& result) const
+{
+    result.clear();
+
+    for (std::map<int, Band>::const_iterator band = bands.begin(); band != bands.end(); ++band)
+    {
+        for (std::set<Key>::const_iterator player = band->second.players.begin(); player != band->second.players.end(); ++player)
+        {
+            const Rating& rating = players.find(player->second)->second;
+
+            // every pair once: later bands, and later players of the same band
+            for (std::map<int, Band>::const_iterator other = band; other != bands.end(); ++other)
+            {
+                double lowSigma = std::max(0.0, other->first * bandWidth);
+                double bestQuality = sqrt(model.twoBetaSquared /
+                                          (model.twoBetaSquared + rating.standardDeviation * rating.standardDeviation + lowSigma * lowSigma));
+                if (bestQuality * (1 + BOUND_RELATIVE_SLACK) < minimumQuality)
+                {
+                    break;
+                }
+
+                double distance = MeanDistanceBound(rating.standardDeviation, other->first, minimumQuality);
+                if (distance < 0)
+                {
+                    continue;
+                }
+
+                // inside the own band everybody below is already paired, and the player itself is within the bound
+                const std::set<Key>& otherPlayers = other->second.players;
+                std::set<Key>::const_iterator it = other == band ? std::next(player) : otherPlayers.lower_bound(Key(rating.mean - distance, 0));
+                std::set<Key>::const_iterator end = otherPlayers.upper_bound(Key(rating.mean + distance, UINT64_MAX));
+
+                for (; it != end; ++it)
+                {
+                    Pair pair;
+                    pair.player1 = std::min(player->second, it->second);
+                    pair.player2 = std::max(player->second, it->second);
+                    // always in id order, the formula isn't bit-for-bit symmetric
+                    const Rating& otherRating = players.find(it->second)->second;
+                    pair.quality = player->second < it->second ? RatingCalculator::CalculateMatchQuality(model, rating, otherRating)
+                                                               : RatingCalculator::CalculateMatchQuality(model, otherRating, rating);
+                    if (pair.quality >= minimumQuality)
+                    {
+                        result.push_back(pair);
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end(), IsBetterPair);
+}
@@ -0,0 +1,81 @@
+//
+//  MatchmakingIndex.h
+//  Skills
+//
+//  Created by KleMiX on 09/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "Rating.h"
+#include "GameModel.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Players waiting for a match, indexed so that opponents above a match quality can be found without
+// trying everybody.
+//
+// With S = 2*beta^2 + sigma1^2 + sigma2^2 the quality of RatingCalculator::CalculateMatchQuality is
+// sqrt(2*beta^2/S) * exp(-deltaMean^2/(2*S)), so quality >= q means deltaMean^2 <= S*ln(2*beta^2/(q^2*S)).
+// Players are grouped in bands of standard deviation and kept sorted by mean inside a band, for every band
+// the largest S*ln(...) over its sigma range bounds the means worth looking at. Candidates inside the bound
+// are checked with the exact formula, so the results are the same a scan over every player gives.
+class MatchmakingIndex
+{
+public:
+    struct Candidate
+    {
+        uint64_t playerId;
+        double quality;
+    };
+
+    struct Pair
+    {
+        uint64_t player1;   // always the smaller id
+        uint64_t player2;
+        double quality;
+    };
+
+    // bandWidth is the standard deviation range of a band, 0 picks one from the model
+    explicit MatchmakingIndex(const GameModel& model, double bandWidth = 0);
+
+    // Adding a player that is already in replaces the rating
+    void    Add(uint64_t playerId, Rating rating);
+    bool    Remove(uint64_t playerId);
+    bool    Contains(uint64_t playerId) const;
+    size_t  Size() const;
+
+    // Best maximumCount opponents with quality >= minimumQuality, best first, equal qualities by id.
+    // The player itself is never returned.
+    void    FindOpponents(uint64_t playerId, double minimumQuality, size_t maximumCount, std::vector<Candidate>& result) const;
+    void    FindOpponents(Rating rating, uint64_t excludedPlayerId, double minimumQuality, size_t maximumCount,
+                          std::vector<Candidate>& result) const;
+
+    // Every pair with quality >= minimumQuality, best first, equal qualities by ids. Quality is computed with
+    // the smaller id as player1.
+    void    FindAllPairs(double minimumQuality, std::vector<Pair>& result) const;
+
+private:
+    typedef std::pair<double, uint64_t> Key;    // mean, id
+
+    struct Band
+    {
+        std::set<Key> players;
+    };
+
+    int     BandOf(double standardDeviation) const;
+    double  MeanDistanceBound(double standardDeviation, int band, double minimumQuality) const;
+
+    GameModel model;
+    double bandWidth;
+
+    std::map<int, Band> bands;
+    std::unordered_map<uint64_t, Rating> players;
+};
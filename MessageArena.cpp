@@ -0,0 +1,81 @@
+//
+//  MessageArena.cpp
+//  Skills
+//
+//  Created by KleMiX on 23/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "MessageArena.h"
+
+#include <stdlib.h>
+#include <new>
+
+// enough for doubles and SSE/AVX loads
+static const size_t ARENA_ALIGNMENT = 32;
+
+MessageArena::MessageArena(size_t blockSize) : blockSize(blockSize), currentBlock(0), offset(0)
+{
+}
+
+MessageArena::~MessageArena()
+{
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        free(blocks[i].data);
+    }
+}
+
+void* MessageArena::AllocateBytes(size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    while (currentBlock < blocks.size())
+    {
+        Block& block = blocks[currentBlock];
+        if (offset + size <= block.size)
+        {
+            void* result = block.data + offset;
+            offset += size;
+            return result;
+        }
+
+        currentBlock++;
+        offset = 0;
+    }
+
+    Block block;
+    block.size = size > blockSize ? size : blockSize;
+    block.data = NULL;
+    if (posix_memalign((void**) &block.data, ARENA_ALIGNMENT, block.size) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    blocks.push_back(block);
+
+    currentBlock = blocks.size() - 1;
+    offset = size;
+    return block.data;
+}
+
+void MessageArena::Reset()
+{
+    currentBlock = 0;
+    offset = 0;
+}
+
+size_t MessageArena::AllocatedBytes() const
+{
+    size_t result = 0;
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        result += blocks[i].size;
+    }
+    return result;
+}
+
+MessageArena& MessageArena::ForCurrentThread()
+{
+    static thread_local MessageArena arena;
+    return arena;
+}
@@ -0,0 +1,52 @@
+//
+//  MessageArena.h
+//  Skills
+//
+//  Created by KleMiX on 23/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Bump allocator for factor graph nodes and messages. Memory is handed out from large blocks and only
+// given back all at once by Reset, which keeps the blocks, so once an arena has seen the biggest match
+// it never touches the heap again. Only for trivially destructible types, nothing is ever destroyed.
+class MessageArena
+{
+public:
+    explicit MessageArena(size_t blockSize = 64 * 1024);
+    ~MessageArena();
+
+    template <class T>
+    T* Allocate(size_t count)
+    {
+        return static_cast<T*>(AllocateBytes(count * sizeof(T)));
+    }
+
+    void Reset();
+
+    size_t AllocatedBytes() const;
+
+    // One arena per thread, reused by every calculation running on it
+    static MessageArena& ForCurrentThread();
+
+private:
+    struct Block
+    {
+        char* data;
+        size_t size;
+    };
+
+    MessageArena(const MessageArena&);
+    MessageArena& operator = (const MessageArena&);
+
+    void* AllocateBytes(size_t size);
+
+    std::vector<Block> blocks;
+    size_t blockSize;
+    size_t currentBlock;
+    size_t offset;
+};
@@ -0,0 +1,244 @@
+//
+//  ModelFitting.cpp
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "ModelFitting.h"
+#include "RatingCalculatorCore.h"
+#include "TimeDynamics.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+    const int PARAMETER_COUNT = 3;
+
+    // Search coordinates, the logarithms of the parameters
+    struct Point
+    {
+        double value[PARAMETER_COUNT];
+    };
+
+    Point ToPoint(const ModelFitting::Parameters& parameters)
+    {
+        Point point;
+        point.value[0] = log(parameters.beta);
+        point.value[1] = log(parameters.drawProbability);
+        point.value[2] = log(parameters.dynamicsFactor);
+        return point;
+    }
+
+    ModelFitting::Parameters ToParameters(const Point& point)
+    {
+        return ModelFitting::Parameters(exp(point.value[0]), exp(point.value[1]), exp(point.value[2]));
+    }
+
+    // log P(result) of a match predicted from the ratings before it, as seen by the update
+    double LogProbability(const GameModel& model, double mean1, double standardDeviation1, double mean2, double standardDeviation2,
+                          int rank1, int rank2)
+    {
+        double c = sqrt(standardDeviation1 * standardDeviation1 + standardDeviation2 * standardDeviation2 + model.twoBetaSquared);
+        double margin = model.drawMargin / c;
+        double delta = (mean1 - mean2) / c;
+        GaussianAccuracy accuracy = model.Accuracy();
+
+        double probability;
+        if (rank1 != rank2)
+        {
+            double winnerAdvantage = rank1 > rank2 ? delta : -delta;
+            probability = GaussianDistribution::CumulativeTo(winnerAdvantage - margin, accuracy);
+        }
+        else
+        {
+            // Phi(margin - |delta|) - Phi(-margin - |delta|), mirrored into the lower tail where the cumulative
+            // keeps its relative precision
+            double distance = fabs(delta);
+            probability = GaussianDistribution::CumulativeTo(margin - distance, accuracy) -
+                          GaussianDistribution::CumulativeTo(-margin - distance, accuracy);
+        }
+
+        // a certain loss would end the search, give it a very bad but finite score
+        return log(std::max(probability, DBL_MIN));
+    }
+}
+
+ModelFitting::SearchOptions::SearchOptions(const GameModel& base) :
+    lower(base.initialMean / 30.0, 0.001, base.initialMean / 3000.0),
+    upper(base.initialMean / 1.5, 0.5, base.initialMean / 30.0),
+    gridSteps(4), maximumIterations(30), tolerance(0.02), firstScoredMatch(0)
+{
+}
+
+GameModel ModelFitting::MakeModel(const GameModel& base, const Parameters& parameters)
+{
+    GameModel model(base.initialMean, base.initialStandardDeviation, parameters.beta, parameters.drawProbability, parameters.dynamicsFactor);
+    model.UseTimeDynamics(base.timeDynamicsFactor, base.maximumStandardDeviation);
+    model.UseAccuracy(base.Accuracy());
+    if (base.CorrectionTables())
+    {
+        // the tables depend on the margin and beta, they have to be built again
+        model.UseCorrectionTables();
+    }
+    return model;
+}
+
+double ModelFitting::LogLikelihood(const GameModel& model, const MatchRecord* matches, const uint64_t* timestamps, size_t matchCount,
+                                   size_t playerCount, size_t firstScoredMatch)
+{
+    bool timed = TimeDynamics::NeedsTimestamps(model);
+    if (timed && !timestamps)
+    {
+        return NAN;
+    }
+
+    RatingTable table(playerCount, model.initialMean, model.initialStandardDeviation);
+    double* mean = table.mean.data();
+    double* standardDeviation = table.standardDeviation.data();
+    std::vector<uint64_t> lastPlayed(timed ? playerCount : 0, NEVER_PLAYED);
+
+    double logLikelihood = 0;
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        const MatchRecord& match = matches[i];
+        if (timed)
+        {
+            // predicted and applied with the inflated deviations, as MatchLog::Replay does
+            standardDeviation[match.player1] = TimeDynamics::InflatedStandardDeviation(model, standardDeviation[match.player1],
+                                                                                       lastPlayed[match.player1], timestamps[i]);
+            standardDeviation[match.player2] = TimeDynamics::InflatedStandardDeviation(model, standardDeviation[match.player2],
+                                                                                       lastPlayed[match.player2], timestamps[i]);
+            lastPlayed[match.player1] = timestamps[i];
+            lastPlayed[match.player2] = timestamps[i];
+        }
+
+        if (i >= firstScoredMatch)
+        {
+            logLikelihood += LogProbability(model, mean[match.player1], standardDeviation[match.player1],
+                                            mean[match.player2], standardDeviation[match.player2], match.rank1, match.rank2);
+        }
+        RatingCalculator::UpdateRatings(model, mean, standardDeviation, match.player1, match.player2, match.rank1, match.rank2);
+    }
+    return logLikelihood;
+}
+
+void ModelFitting::Evaluate(const GameModel& base, const Parameters* candidates, size_t candidateCount, const MatchRecord* matches,
+                            const uint64_t* timestamps, size_t matchCount, size_t playerCount, size_t firstScoredMatch,
+                            double* logLikelihoods, ThreadPool& pool)
+{
+    // without timestamps there is nothing to inflate by, the candidates go without time dynamics
+    GameModel candidateBase = base;
+    if (!timestamps)
+    {
+        candidateBase.UseTimeDynamics(0, base.maximumStandardDeviation);
+    }
+
+    // a candidate is a whole replay, one per task is plenty to keep the pool busy
+    pool.ParallelFor(candidateCount, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            GameModel model = MakeModel(candidateBase, candidates[i]);
+            logLikelihoods[i] = LogLikelihood(model, matches, timestamps, matchCount, playerCount, firstScoredMatch);
+        }
+    });
+}
+
+ModelFitting::Fit ModelFitting::Search(const GameModel& base, const MatchRecord* matches, const uint64_t* timestamps, size_t matchCount,
+                                       size_t playerCount, const SearchOptions& options, ThreadPool& pool)
+{
+    Point lower = ToPoint(options.lower);
+    Point upper = ToPoint(options.upper);
+    int gridSteps = std::max(options.gridSteps, 1);
+
+    std::vector<Parameters> candidates;
+    std::vector<double> logLikelihoods;
+    Fit fit;
+    fit.evaluations = 0;
+    fit.scoredMatches = matchCount > options.firstScoredMatch ? matchCount - options.firstScoredMatch : 0;
+
+    // grid, a single step is the middle of the range
+    Point step;
+    for (int p = 0; p < PARAMETER_COUNT; p++)
+    {
+        step.value[p] = gridSteps > 1 ? (upper.value[p] - lower.value[p]) / (gridSteps - 1) : (upper.value[p] - lower.value[p]) / 2;
+    }
+
+    for (int i = 0; i < gridSteps * gridSteps * gridSteps; i++)
+    {
+        Point point;
+        int index = i;
+        for (int p = 0; p < PARAMETER_COUNT; p++)
+        {
+            int position = gridSteps > 1 ? index % gridSteps : 1;
+            point.value[p] = lower.value[p] + position * step.value[p];
+            index /= gridSteps;
+        }
+        candidates.push_back(ToParameters(point));
+    }
+
+    logLikelihoods.resize(candidates.size());
+    Evaluate(base, candidates.data(), candidates.size(), matches, timestamps, matchCount, playerCount, options.firstScoredMatch,
+             logLikelihoods.data(), pool);
+    fit.evaluations += candidates.size();
+
+    size_t best = std::max_element(logLikelihoods.begin(), logLikelihoods.end()) - logLikelihoods.begin();
+    Point current = ToPoint(candidates[best]);
+    fit.logLikelihood = logLikelihoods[best];
+
+    // pattern search around the best grid point: one step up and down every parameter, all six at once.
+    // Move to the best one that improves, halve the steps when none does.
+    for (int p = 0; p < PARAMETER_COUNT; p++)
+    {
+        step.value[p] /= 2;
+    }
+
+    for (int iteration = 0; iteration < options.maximumIterations; iteration++)
+    {
+        double largestStep = 0;
+        candidates.clear();
+        for (int p = 0; p < PARAMETER_COUNT; p++)
+        {
+            largestStep = std::max(largestStep, step.value[p]);
+            for (int direction = -1; direction <= 1; direction += 2)
+            {
+                Point point = current;
+                point.value[p] = std::min(std::max(point.value[p] + direction * step.value[p], lower.value[p]), upper.value[p]);
+                if (point.value[p] != current.value[p])
+                {
+                    candidates.push_back(ToParameters(point));
+                }
+            }
+        }
+        if (largestStep < options.tolerance || candidates.empty())
+        {
+            break;
+        }
+
+        logLikelihoods.resize(candidates.size());
+        Evaluate(base, candidates.data(), candidates.size(), matches, timestamps, matchCount, playerCount, options.firstScoredMatch,
+                 logLikelihoods.data(), pool);
+        fit.evaluations += candidates.size();
+
+        best = std::max_element(logLikelihoods.begin(), logLikelihoods.end()) - logLikelihoods.begin();
+        if (logLikelihoods[best] > fit.logLikelihood)
+        {
+            current = ToPoint(candidates[best]);
+            fit.logLikelihood = logLikelihoods[best];
+        }
+        else
+        {
+            for (int p = 0; p < PARAMETER_COUNT; p++)
+            {
+                step.value[p] /= 2;
+            }
+        }
+    }
+
+    fit.parameters = ToParameters(current);
+    return fit;
+}
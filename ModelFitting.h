@@ -0,0 +1,98 @@
+//
+//  ModelFitting.h
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingTable.h"
+#include "GameModel.h"
+#include "ThreadPool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Tunes beta, drawProbability and dynamicsFactor of a game mode against its match history.
+//
+// A candidate is scored by the predictive log-likelihood of the history: every match is predicted from the
+// ratings before it and then applied, the score is the sum of log P(actual result). With
+// c = sqrt(sigma1^2 + sigma2^2 + 2 beta^2), the c of the update, and the draw margin e of the candidate:
+//   P(player1 wins) = Phi((mu1 - mu2 - e) / c), P(player2 wins) = Phi((mu2 - mu1 - e) / c), P(draw) the rest.
+// The initial rating, accuracy tier and correction tables are taken from the base model.
+//
+// Time dynamics of the base model need the match timestamps: with them every match first inflates both
+// players to its timestamp like TimeDynamics::CalculateNewRatings, so the candidates are scored as the mode
+// runs. Without timestamps Evaluate and Search fit the candidates without time dynamics, and LogLikelihood
+// refuses a model that has them.
+//
+// Every candidate replays the whole history on a RatingTable of its own, the matches are shared read-only,
+// so a pool works on as many candidates at once as it has threads. The search is a grid followed by a
+// pattern search, both in log space of the three parameters.
+namespace ModelFitting
+{
+    struct Parameters
+    {
+        double beta;
+        double drawProbability;
+        double dynamicsFactor;
+
+        Parameters() : beta(0), drawProbability(0), dynamicsFactor(0) { }
+        Parameters(double beta, double drawProbability, double dynamicsFactor)
+        : beta(beta), drawProbability(drawProbability), dynamicsFactor(dynamicsFactor) { }
+
+        static Parameters FromModel(const GameModel& model)
+        {
+            return Parameters(model.beta, model.drawProbability, model.dynamicsFactor);
+        }
+    };
+
+    struct SearchOptions
+    {
+        // inclusive bounds, all positive
+        Parameters lower;
+        Parameters upper;
+
+        int gridSteps;                  // per parameter, gridSteps^3 candidates
+        int maximumIterations;          // of the pattern search
+        double tolerance;               // the pattern search stops once its step in log space is below this
+        size_t firstScoredMatch;        // earlier matches only warm the ratings up
+
+        // Wide bounds around the proportions of GameModel::FromInitialMean
+        explicit SearchOptions(const GameModel& base);
+    };
+
+    struct Fit
+    {
+        Parameters parameters;
+        double logLikelihood;
+        size_t scoredMatches;
+        size_t evaluations;             // replays of the whole history
+
+        // Per scored match, exp of it is the geometric mean of the predicted probabilities
+        double AverageLogLikelihood() const
+        {
+            return scoredMatches > 0 ? logLikelihood / scoredMatches : 0;
+        }
+    };
+
+    // base with the three parameters replaced
+    GameModel   MakeModel(const GameModel& base, const Parameters& parameters);
+
+    // Predicts and applies the matches in order, players must be below playerCount. Matches before
+    // firstScoredMatch are applied without being scored. timestamps is NULL or timestamps[i] belongs to matches[i],
+    // NaN when the model has time dynamics and there are no timestamps.
+    double      LogLikelihood(const GameModel& model, const MatchRecord* matches, const uint64_t* timestamps, size_t matchCount,
+                              size_t playerCount, size_t firstScoredMatch);
+
+    // One replay per candidate, spread over the pool
+    void        Evaluate(const GameModel& base, const Parameters* candidates, size_t candidateCount, const MatchRecord* matches,
+                         const uint64_t* timestamps, size_t matchCount, size_t playerCount, size_t firstScoredMatch,
+                         double* logLikelihoods, ThreadPool& pool);
+
+    Fit         Search(const GameModel& base, const MatchRecord* matches, const uint64_t* timestamps, size_t matchCount,
+                       size_t playerCount, const SearchOptions& options, ThreadPool& pool);
+}
@@ -0,0 +1,93 @@
+//
+//  NaturalGaussian.h
+//  Skills
+//
+//  Created by KleMiX on 13/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "GaussianDistribution.h"
+
+#include <math.h>
+
+// Gaussian stored only by its natural parameters, two scalars instead of the five of BasicGaussianDistribution.
+// Products and quotients, the bulk of message passing, only touch these, mean and deviation are derived on
+// demand. Derived values use the same formulas as BasicGaussianDistribution, so converting back and forth
+// gives the same bits. Default constructed it is the uniform distribution (precision 0).
+template <class Scalar>
+struct BasicNaturalGaussian
+{
+    Scalar precisionMean;
+    Scalar precision;
+
+    BasicNaturalGaussian() : precisionMean(0), precision(0) { }
+
+    static BasicNaturalGaussian FromPrecisionMean(Scalar precisionMean, Scalar precision)
+    {
+        BasicNaturalGaussian result;
+        result.precisionMean = precisionMean;
+        result.precision = precision;
+        return result;
+    }
+
+    static BasicNaturalGaussian FromMeanStandardDeviation(Scalar mean, Scalar standardDeviation)
+    {
+        return FromMeanVariance(mean, standardDeviation * standardDeviation);
+    }
+
+    static BasicNaturalGaussian FromMeanVariance(Scalar mean, Scalar variance)
+    {
+        Scalar precision = Scalar(1) / variance;
+        return FromPrecisionMean(precision * mean, precision);
+    }
+
+    static BasicNaturalGaussian FromGaussian(const BasicGaussianDistribution<Scalar>& gaussian)
+    {
+        return FromPrecisionMean(gaussian.precisionMean, gaussian.precision);
+    }
+
+    Scalar Mean() const
+    {
+        return precisionMean / precision;
+    }
+
+    Scalar Variance() const
+    {
+        return Scalar(1) / precision;
+    }
+
+    Scalar StandardDeviation() const
+    {
+        return sqrt(Variance());
+    }
+
+    BasicGaussianDistribution<Scalar> ToGaussian() const
+    {
+        return BasicGaussianDistribution<Scalar>::FromPrecisionMean(precisionMean, precision);
+    }
+
+    friend BasicNaturalGaussian operator * (const BasicNaturalGaussian left, const BasicNaturalGaussian right)
+    {
+        return FromPrecisionMean(left.precisionMean + right.precisionMean, left.precision + right.precision);
+    }
+
+    friend BasicNaturalGaussian operator / (const BasicNaturalGaussian numerator, const BasicNaturalGaussian denominator)
+    {
+        return FromPrecisionMean(numerator.precisionMean - denominator.precisionMean, numerator.precision - denominator.precision);
+    }
+
+    // Same distance as BasicGaussianDistribution
+    friend Scalar operator - (const BasicNaturalGaussian left, const BasicNaturalGaussian right)
+    {
+        Scalar a = fabs(left.precisionMean - right.precisionMean);
+        Scalar b = sqrt(fabs(left.precision - right.precision));
+        return a > b ? a : b;
+    }
+};
+
+static_assert(sizeof(BasicNaturalGaussian<double>) == 2 * sizeof(double), "natural Gaussian must stay two scalars");
+
+typedef BasicNaturalGaussian<double> NaturalGaussian;
+typedef BasicNaturalGaussian<float> FloatNaturalGaussian;
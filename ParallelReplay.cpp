@@ -0,0 +1,215 @@
+//
+//  ParallelReplay.cpp
+//  Skills
+//
+//  Created by KleMiX on 02/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "ParallelReplay.h"
+#include "RatingCalculator.h"
+#include "TimeDynamics.h"
+#include "Instrumentation.h"
+#include "SimdKernels.h"
+
+#include <math.h>
+#include <algorithm>
+
+// Below this many matches a wave isn't worth waking the pool for
+static const size_t MINIMUM_PARALLEL_WAVE = 4096;
+static const size_t MATCHES_PER_TASK = 1024;
+// Matches per SimdKernels call of the vectorized kernel, the block arrays stay on the stack
+static const size_t VECTORIZED_BLOCK = 256;
+
+void ParallelReplay::BuildSchedule(const MatchRecord* matches, size_t matchCount, size_t playerCount, Schedule& schedule)
+{
+    BuildSchedule(matches, NULL, matchCount, playerCount, schedule);
+}
+
+void ParallelReplay::BuildSchedule(const MatchRecord* matches, const uint64_t* timestamps, size_t matchCount, size_t playerCount, Schedule& schedule)
+{
+    // wave of every match, counting sort keeps the original order inside a wave
+    std::vector<int> lastWave(playerCount, -1);
+    std::vector<int> matchWave(matchCount);
+    std::vector<size_t> waveSizes;
+
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        const MatchRecord& match = matches[i];
+        int wave = std::max(lastWave[match.player1], lastWave[match.player2]) + 1;
+        lastWave[match.player1] = wave;
+        lastWave[match.player2] = wave;
+
+        matchWave[i] = wave;
+        if ((size_t) wave == waveSizes.size())
+        {
+            waveSizes.push_back(0);
+        }
+        waveSizes[wave]++;
+    }
+
+    schedule.waveOffsets.resize(waveSizes.size() + 1);
+    schedule.waveOffsets[0] = 0;
+    for (size_t w = 0; w < waveSizes.size(); w++)
+    {
+        schedule.waveOffsets[w + 1] = schedule.waveOffsets[w] + waveSizes[w];
+    }
+
+    std::vector<size_t> position(schedule.waveOffsets.begin(), schedule.waveOffsets.end() - 1);
+    schedule.matches.resize(matchCount);
+    schedule.timestamps.resize(timestamps ? matchCount : 0);
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        size_t slot = position[matchWave[i]]++;
+        schedule.matches[slot] = matches[i];
+        if (timestamps)
+        {
+            schedule.timestamps[slot] = timestamps[i];
+        }
+    }
+}
+
+// Matches that share no player with the V/W corrections of a block of matches evaluated at once by
+// SimdKernels. The corrections are within 1e-9 of the scalar ones whatever the accuracy tier, so the ratings
+// are close to but not bit-identical with RatingCalculator::CalculateNewRatings. Models with correction
+// tables take the scalar path. The caller has refused models and tables that need timestamps.
+static void ReplayWaveVectorized(const GameModel& model, RatingTable& table, const MatchRecord* matches, size_t matchCount)
+{
+    if (model.CorrectionTables())
+    {
+        RatingCalculator::CalculateNewRatings(model, table, matches, matchCount);
+        return;
+    }
+
+    SKILLS_TIME(TIMER_CALCULATE_NEW_RATINGS_BATCH);
+    double* mean = table.mean.data();
+    double* standardDeviation = table.standardDeviation.data();
+
+    // Both sides of a match share c and the performance difference seen from the winner, the loser's V is
+    // the negated one: for a win it is scaled by rank multiplier -1, for a draw V is odd and W even in the
+    // difference. So one correction per match is enough. Decisive matches fill the block from the front,
+    // draws from the back, every slot remembers its match.
+    size_t slotMatch[VECTORIZED_BLOCK];
+    double c[VECTORIZED_BLOCK];
+    double difference[VECTORIZED_BLOCK];
+    double margin[VECTORIZED_BLOCK];
+    double v[VECTORIZED_BLOCK];
+    double w[VECTORIZED_BLOCK];
+
+    for (size_t first = 0; first < matchCount; first += VECTORIZED_BLOCK)
+    {
+        size_t count = std::min(VECTORIZED_BLOCK, matchCount - first);
+        size_t decisive = 0;
+        size_t draws = count;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const MatchRecord& match = matches[first + i];
+            int winner = match.rank1 > match.rank2 ? match.player1 : match.player2;
+            int loser = match.rank1 <= match.rank2 ? match.player1 : match.player2;
+
+            size_t slot = match.rank1 != match.rank2 ? decisive++ : --draws;
+            slotMatch[slot] = first + i;
+            c[slot] = sqrt(standardDeviation[winner] * standardDeviation[winner] + standardDeviation[loser] * standardDeviation[loser] +
+                           model.twoBetaSquared);
+            difference[slot] = (mean[winner] - mean[loser]) / c[slot];
+            margin[slot] = model.drawMargin / c[slot];
+        }
+
+        SimdKernels::ExceedsMargin(difference, margin, v, w, decisive);
+        SimdKernels::WithinMargin(difference + decisive, margin + decisive, v + decisive, w + decisive, count - decisive);
+
+        for (size_t slot = 0; slot < count; slot++)
+        {
+            const MatchRecord& match = matches[slotMatch[slot]];
+            int players[2] = { match.rank1 > match.rank2 ? match.player1 : match.player2, match.rank1 <= match.rank2 ? match.player1 : match.player2 };
+            double sign[2] = { 1, -1 };
+
+            for (int side = 0; side < 2; side++)
+            {
+                int player = players[side];
+                double varianceWithDynamics = standardDeviation[player] * standardDeviation[player] + model.dynamicsFactorSquared;
+                mean[player] += sign[side] * (varianceWithDynamics / c[slot]) * v[slot];
+                standardDeviation[player] = sqrt(varianceWithDynamics * (1 - w[slot] * (varianceWithDynamics / (c[slot] * c[slot]))));
+            }
+        }
+    }
+}
+
+static void ReplayWave(const GameModel& model, RatingTable& table, const MatchRecord* wave, const uint64_t* timestamps, size_t count,
+                       ParallelReplay::Kernel kernel)
+{
+    if (timestamps)
+    {
+        TimeDynamics::CalculateNewRatings(model, table, wave, timestamps, count);
+    }
+    else if (kernel == ParallelReplay::REPLAY_KERNEL_VECTORIZED)
+    {
+        // no player appears twice in a wave
+        ReplayWaveVectorized(model, table, wave, count);
+    }
+    else
+    {
+        RatingCalculator::CalculateNewRatings(model, table, wave, count);
+    }
+}
+
+bool ParallelReplay::CalculateNewRatings(const GameModel& model, RatingTable& table, const Schedule& schedule, ThreadPool& pool, Kernel kernel)
+{
+    bool timed = !schedule.timestamps.empty();
+    if (!timed && TimeDynamics::NeedsTimestamps(model, table))
+    {
+        return false;
+    }
+    if (timed)
+    {
+        // before the waves, the tasks only read the flag
+        table.TrackLastPlayed();
+    }
+
+    for (size_t w = 0; w < schedule.WaveCount(); w++)
+    {
+        const MatchRecord* wave = schedule.matches.data() + schedule.waveOffsets[w];
+        const uint64_t* timestamps = timed ? schedule.timestamps.data() + schedule.waveOffsets[w] : NULL;
+        size_t waveSize = schedule.waveOffsets[w + 1] - schedule.waveOffsets[w];
+
+        if (waveSize < MINIMUM_PARALLEL_WAVE)
+        {
+            ReplayWave(model, table, wave, timestamps, waveSize, kernel);
+            continue;
+        }
+
+        // players are disjoint inside a wave, so the chunks never write the same entry
+        pool.ParallelFor(waveSize, MATCHES_PER_TASK, [&](size_t begin, size_t end)
+        {
+            ReplayWave(model, table, wave + begin, timestamps ? timestamps + begin : NULL, end - begin, kernel);
+        });
+    }
+    return true;
+}
+
+bool ParallelReplay::CalculateNewRatings(const GameModel& model, RatingTable& table, const MatchRecord* matches, size_t matchCount, ThreadPool& pool,
+                                         Kernel kernel)
+{
+    if (TimeDynamics::NeedsTimestamps(model, table))
+    {
+        return false;
+    }
+
+    Schedule schedule;
+    BuildSchedule(matches, matchCount, table.Size(), schedule);
+    return CalculateNewRatings(model, table, schedule, pool, kernel);
+}
+
+bool ParallelReplay::CalculateNewRatings(const GameModel& model, RatingTable& table, const MatchRecord* matches, const uint64_t* timestamps,
+                                         size_t matchCount, ThreadPool& pool)
+{
+    if (!timestamps && TimeDynamics::NeedsTimestamps(model, table))
+    {
+        return false;
+    }
+
+    Schedule schedule;
+    BuildSchedule(matches, timestamps, matchCount, table.Size(), schedule);
+    return CalculateNewRatings(model, table, schedule, pool);
+}
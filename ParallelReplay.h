@@ -0,0 +1,59 @@
+//
+//  ParallelReplay.h
+//  Skills
+//
+//  Created by KleMiX on 02/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingTable.h"
+#include "GameModel.h"
+#include "ThreadPool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Multi-core replay of a time ordered match history.
+//
+// Matches are split into waves: a match goes to the wave after the last one any of its players appeared in,
+// so no player appears twice in a wave and every player still sees their matches in the original order.
+// Waves run one after another, the matches inside a wave are spread over the pool. The ratings are exactly
+// the ones RatingCalculator::CalculateNewRatings gives for the same matches, or TimeDynamics::CalculateNewRatings
+// when the schedule carries timestamps.
+namespace ParallelReplay
+{
+    enum Kernel
+    {
+        REPLAY_KERNEL_SCALAR = 0,       // exactly the ratings of RatingCalculator::CalculateNewRatings
+        REPLAY_KERNEL_VECTORIZED = 1,   // V/W corrections of a block at once through SimdKernels, within 1e-9 of the scalar ones
+    };
+
+    struct Schedule
+    {
+        std::vector<MatchRecord> matches;   // wave after wave, original order inside a wave
+        std::vector<size_t> waveOffsets;    // wave i is matches[waveOffsets[i], waveOffsets[i + 1])
+        std::vector<uint64_t> timestamps;   // empty, or timestamps[i] belongs to matches[i]
+
+        size_t WaveCount() const
+        {
+            return waveOffsets.empty() ? 0 : waveOffsets.size() - 1;
+        }
+    };
+
+    // Players must be below playerCount. Build once and replay many times when the history doesn't change.
+    void    BuildSchedule(const MatchRecord* matches, size_t matchCount, size_t playerCount, Schedule& schedule);
+    // Keeps timestamps[i] with matches[i], for models with time dynamics
+    void    BuildSchedule(const MatchRecord* matches, const uint64_t* timestamps, size_t matchCount, size_t playerCount, Schedule& schedule);
+
+    // False and nothing applied when the schedule has no timestamps but TimeDynamics::NeedsTimestamps.
+    // Timestamped schedules always use the scalar kernel.
+    bool    CalculateNewRatings(const GameModel& model, RatingTable& table, const Schedule& schedule, ThreadPool& pool,
+                                Kernel kernel = REPLAY_KERNEL_SCALAR);
+    bool    CalculateNewRatings(const GameModel& model, RatingTable& table, const MatchRecord* matches, size_t matchCount, ThreadPool& pool,
+                                Kernel kernel = REPLAY_KERNEL_SCALAR);
+    bool    CalculateNewRatings(const GameModel& model, RatingTable& table, const MatchRecord* matches, const uint64_t* timestamps,
+                                size_t matchCount, ThreadPool& pool);
+}
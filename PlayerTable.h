@@ -0,0 +1,198 @@
+//
+//  PlayerTable.h
+//  Skills
+//
+//  Created by KleMiX on 13/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingCalculator.h"
+#include "RatingTable.h"
+#include "GameModel.h"
+#include "TimeDynamics.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Every player of one game mode, indexed by id. The hot columns are a plain RatingTable the calculator
+// reads and writes in place, the match statistics live in separate cold columns that the rating updates
+// never touch. Everything that is the same for the whole mode (the model and the conservative multiplier)
+// is stored once instead of per player.
+//
+// Hot data is 2 * sizeof(Scalar) bytes per player (plus 8 with lastPlayed tracking), 100M players are
+// 800MB as FloatPlayerTable and 1.6GB as PlayerTable. The cold columns add 12 bytes per player.
+//
+// A model with time dynamics needs the timestamped CalculateNewRatings and the reads that take now, the
+// plain reads return the standard deviation as of the player's last match.
+template <class Scalar>
+struct BasicPlayerTable
+{
+    // per mode
+    GameModel model;
+    Scalar conservativeMultiplier;
+
+    // hot, ids index the columns
+    BasicRatingTable<Scalar> ratings;
+
+    // cold
+    std::vector<uint32_t> gamesWon;
+    std::vector<uint32_t> gamesLost;
+    std::vector<uint32_t> gamesDrawn;
+
+    explicit BasicPlayerTable(const GameModel& model, Scalar conservativeMultiplier = Scalar(DEFAULT_CONSERVATIVE_MULTIPLIER))
+    : model(model), conservativeMultiplier(conservativeMultiplier) { }
+
+    size_t Size() const
+    {
+        return ratings.Size();
+    }
+
+    void Reserve(size_t playerCount)
+    {
+        ratings.mean.reserve(playerCount);
+        ratings.standardDeviation.reserve(playerCount);
+        if (ratings.tracksLastPlayed)
+        {
+            ratings.lastPlayed.reserve(playerCount);
+        }
+        gamesWon.reserve(playerCount);
+        gamesLost.reserve(playerCount);
+        gamesDrawn.reserve(playerCount);
+    }
+
+    // New players start with the model prior and no games
+    void Resize(size_t playerCount)
+    {
+        ratings.Resize(playerCount, Scalar(model.initialMean), Scalar(model.initialStandardDeviation));
+        gamesWon.resize(playerCount, 0);
+        gamesLost.resize(playerCount, 0);
+        gamesDrawn.resize(playerCount, 0);
+    }
+
+    int Add()
+    {
+        return Add(BasicRating<Scalar>(Scalar(model.initialMean), Scalar(model.initialStandardDeviation)));
+    }
+
+    int Add(BasicRating<Scalar> rating)
+    {
+        gamesWon.push_back(0);
+        gamesLost.push_back(0);
+        gamesDrawn.push_back(0);
+        return ratings.Add(rating);
+    }
+
+    // The multiplier of the table, whatever the rating passed to Add carried
+    BasicRating<Scalar> GetRating(int id) const
+    {
+        return BasicRating<Scalar>(ratings.mean[id], ratings.standardDeviation[id], conservativeMultiplier);
+    }
+
+    // Inflated for the time since the player's last match, see TimeDynamics
+    BasicRating<Scalar> GetRating(int id, uint64_t now) const
+    {
+        return BasicRating<Scalar>(ratings.mean[id], StandardDeviation(id, now), conservativeMultiplier);
+    }
+
+    void SetRating(int id, BasicRating<Scalar> rating)
+    {
+        ratings.Set(id, rating);
+    }
+
+    Scalar ConservativeRating(int id) const
+    {
+        return ratings.mean[id] - conservativeMultiplier * ratings.standardDeviation[id];
+    }
+
+    Scalar ConservativeRating(int id, uint64_t now) const
+    {
+        return ratings.mean[id] - conservativeMultiplier * StandardDeviation(id, now);
+    }
+
+    uint32_t GamesPlayed(int id) const
+    {
+        return gamesWon[id] + gamesLost[id] + gamesDrawn[id];
+    }
+
+    // Rates the matches in order with RatingCalculator, then counts them in a second pass so the update
+    // loop only streams through the hot columns. False and nothing changes when the model has time dynamics.
+    bool CalculateNewRatings(const MatchRecord* matches, size_t matchCount)
+    {
+        if (!RatingCalculator::CalculateNewRatings(model, ratings, matches, matchCount))
+        {
+            return false;
+        }
+        RecordResults(matches, matchCount);
+        return true;
+    }
+
+    // Matches in time order, timestamps[i] belongs to matches[i]. Both players are inflated to the timestamp
+    // and marked as played then, for PlayerTable exactly like TimeDynamics::CalculateNewRatings.
+    void CalculateNewRatings(const MatchRecord* matches, const uint64_t* timestamps, size_t matchCount)
+    {
+        ratings.TrackLastPlayed();
+        for (size_t i = 0; i < matchCount; i++)
+        {
+            const MatchRecord& match = matches[i];
+            BasicRating<Scalar> rating1(ratings.mean[match.player1], StandardDeviation(match.player1, timestamps[i]));
+            BasicRating<Scalar> rating2(ratings.mean[match.player2], StandardDeviation(match.player2, timestamps[i]));
+            RatingCalculator::CalculateNewRatings(model, rating1, rating2, match.rank1, match.rank2);
+
+            ratings.Set(match.player1, rating1);
+            ratings.Set(match.player2, rating2);
+            ratings.lastPlayed[match.player1] = timestamps[i];
+            ratings.lastPlayed[match.player2] = timestamps[i];
+        }
+        RecordResults(matches, matchCount);
+    }
+
+    // Statistics only, for matches rated some other way (ParallelReplay, TimeDynamics, ...)
+    void RecordResults(const MatchRecord* matches, size_t matchCount)
+    {
+        for (size_t i = 0; i < matchCount; i++)
+        {
+            const MatchRecord& match = matches[i];
+            if (match.rank1 == match.rank2)
+            {
+                gamesDrawn[match.player1]++;
+                gamesDrawn[match.player2]++;
+            }
+            else if (match.rank1 > match.rank2)
+            {
+                gamesWon[match.player1]++;
+                gamesLost[match.player2]++;
+            }
+            else
+            {
+                gamesWon[match.player2]++;
+                gamesLost[match.player1]++;
+            }
+        }
+    }
+
+    size_t HotBytes() const
+    {
+        return Size() * (2 * sizeof(Scalar) + (ratings.tracksLastPlayed ? sizeof(uint64_t) : 0));
+    }
+
+    size_t ColdBytes() const
+    {
+        return Size() * 3 * sizeof(uint32_t);
+    }
+
+private:
+    Scalar StandardDeviation(int id, uint64_t now) const
+    {
+        if (!ratings.tracksLastPlayed)
+        {
+            return ratings.standardDeviation[id];
+        }
+        return Scalar(TimeDynamics::InflatedStandardDeviation(model, ratings.standardDeviation[id], ratings.lastPlayed[id], now));
+    }
+};
+
+typedef BasicPlayerTable<double> PlayerTable;
+typedef BasicPlayerTable<float> FloatPlayerTable;
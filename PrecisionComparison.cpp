@@ -0,0 +1,109 @@
+//
+//  PrecisionComparison.cpp
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "PrecisionComparison.h"
+#include "RatingCalculator.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+    template <class Scalar>
+    void RankPlayers(const BasicRatingTable<Scalar>& table, std::vector<int>& order, std::vector<size_t>& place)
+    {
+        order.resize(table.Size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = (int) i;
+        }
+
+        // ties by index so both leaderboards are total orders
+        std::sort(order.begin(), order.end(), [&table](int left, int right)
+        {
+            Scalar leftRating = table.Get(left).ConservativeRating();
+            Scalar rightRating = table.Get(right).ConservativeRating();
+            return leftRating > rightRating || (leftRating == rightRating && left < right);
+        });
+
+        place.resize(order.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            place[order[i]] = i;
+        }
+    }
+
+    PrecisionComparison::Checkpoint Measure(const RatingTable& reference, const FloatRatingTable& table, size_t matchCount)
+    {
+        PrecisionComparison::Checkpoint checkpoint;
+        checkpoint.matchCount = matchCount;
+        checkpoint.maximumMeanError = 0;
+        checkpoint.averageMeanError = 0;
+        checkpoint.maximumStandardDeviationError = 0;
+        checkpoint.maximumConservativeRatingError = 0;
+
+        size_t playerCount = reference.Size();
+        for (size_t i = 0; i < playerCount; i++)
+        {
+            Rating expected = reference.Get((int) i);
+            FloatRating actual = table.Get((int) i);
+
+            double meanError = fabs(expected.mean - actual.mean);
+            checkpoint.maximumMeanError = std::max(checkpoint.maximumMeanError, meanError);
+            checkpoint.averageMeanError += meanError;
+            checkpoint.maximumStandardDeviationError = std::max(checkpoint.maximumStandardDeviationError,
+                                                                fabs(expected.standardDeviation - actual.standardDeviation));
+            checkpoint.maximumConservativeRatingError = std::max(checkpoint.maximumConservativeRatingError,
+                                                                 fabs(expected.ConservativeRating() - actual.ConservativeRating()));
+        }
+        checkpoint.averageMeanError /= std::max(playerCount, (size_t) 1);
+
+        std::vector<int> expectedOrder, actualOrder;
+        std::vector<size_t> expectedPlace, actualPlace;
+        RankPlayers(reference, expectedOrder, expectedPlace);
+        RankPlayers(table, actualOrder, actualPlace);
+
+        size_t samePlace = 0;
+        checkpoint.maximumRankDisplacement = 0;
+        for (size_t i = 0; i < playerCount; i++)
+        {
+            size_t displacement = expectedPlace[i] > actualPlace[i] ? expectedPlace[i] - actualPlace[i] : actualPlace[i] - expectedPlace[i];
+            samePlace += displacement == 0 ? 1 : 0;
+            checkpoint.maximumRankDisplacement = std::max(checkpoint.maximumRankDisplacement, displacement);
+        }
+        checkpoint.rankAgreement = playerCount ? (double) samePlace / playerCount : 1.0;
+
+        return checkpoint;
+    }
+}
+
+bool PrecisionComparison::Compare(const GameModel& model, const MatchRecord* matches, size_t matchCount, size_t playerCount,
+                                  size_t checkpointInterval, std::vector<Checkpoint>& checkpoints)
+{
+    RatingTable reference(playerCount, model.initialMean, model.initialStandardDeviation);
+    FloatRatingTable table(playerCount, (float) model.initialMean, (float) model.initialStandardDeviation);
+
+    checkpoints.clear();
+    if (checkpointInterval == 0)
+    {
+        checkpointInterval = std::max(matchCount, (size_t) 1);
+    }
+
+    for (size_t first = 0; first < matchCount; first += checkpointInterval)
+    {
+        size_t count = std::min(checkpointInterval, matchCount - first);
+        if (!RatingCalculator::CalculateNewRatings(model, reference, matches + first, count) ||
+            !RatingCalculator::CalculateNewRatings(model, table, matches + first, count))
+        {
+            return false;
+        }
+
+        checkpoints.push_back(Measure(reference, table, first + count));
+    }
+    return true;
+}
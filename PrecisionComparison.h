@@ -0,0 +1,41 @@
+//
+//  PrecisionComparison.h
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingTable.h"
+#include "GameModel.h"
+
+#include <stddef.h>
+#include <vector>
+
+// Measures how far the float pipeline drifts from the double one over a match history. Both replay the
+// same matches side by side and are compared every checkpointInterval matches, the double ratings are
+// taken as the truth.
+//
+// Compare fails when either table refuses the batch, that is for models with time dynamics since the
+// history carries no timestamps. checkpoints then holds the checkpoints measured before.
+namespace PrecisionComparison
+{
+    struct Checkpoint
+    {
+        size_t matchCount;
+
+        double maximumMeanError;
+        double averageMeanError;
+        double maximumStandardDeviationError;
+        double maximumConservativeRatingError;
+
+        // leaderboards by conservative rating
+        double rankAgreement;               // fraction of players on the same place in both
+        size_t maximumRankDisplacement;
+    };
+
+    bool    Compare(const GameModel& model, const MatchRecord* matches, size_t matchCount, size_t playerCount,
+                    size_t checkpointInterval, std::vector<Checkpoint>& checkpoints);
+}
@@ -0,0 +1,182 @@
+//
+//  PrecisionDrift.cpp
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "PrecisionComparison.h"
+#include "RatingCalculator.h"
+#include "MatchLog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Prints how far float ratings drift from double ones along a match history, either a simple simulation
+// or a match log, and how much faster the float replay is.
+//
+//   PrecisionDrift [--players n] [--attacks n] [--log file] [--checkpoints n]
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        size_t playerCount;
+        size_t attacksPerPlayer;
+        size_t checkpointCount;
+        const char* log;
+
+        Options()
+        : playerCount(100000), attacksPerPlayer(100), checkpointCount(20), log(NULL)
+        {
+        }
+    };
+
+    // Simple simulation: every player attacks random opponents, the one with more luck wins
+    void MakeSimulation(const Options& options, std::vector<MatchRecord>& matches)
+    {
+        std::mt19937_64 random(options.playerCount);
+        std::vector<int> luck(options.playerCount);
+        for (size_t i = 0; i < options.playerCount; i++)
+        {
+            luck[i] = (int) (random() % 10);
+        }
+
+        matches.reserve(options.playerCount * options.attacksPerPlayer);
+        for (size_t j = 0; j < options.attacksPerPlayer; j++)
+        {
+            for (size_t i = 0; i < options.playerCount; i++)
+            {
+                size_t opponent = random() % options.playerCount;
+                if (opponent != i)
+                {
+                    bool won = luck[i] >= luck[opponent];
+                    matches.push_back(MatchRecord((int) i, (int) opponent, won ? 1 : 0, won ? 0 : 1));
+                }
+            }
+        }
+    }
+
+    // Partial play weights are dropped, both precisions see the same full matches anyway
+    bool LoadLog(const char* path, std::vector<MatchRecord>& matches, size_t& playerCount)
+    {
+        MatchLog::Reader reader;
+        if (!reader.Open(path))
+        {
+            return false;
+        }
+
+        matches.reserve(reader.RecordCount());
+        playerCount = 0;
+
+        MatchLog::Window window;
+        size_t first = 0;
+        while (reader.Map(first, reader.RecordCount() - first, window))
+        {
+            for (size_t i = 0; i < window.count; i++)
+            {
+                const MatchLog::Record& record = window.RecordAt(i);
+                matches.push_back(MatchRecord((int) record.player1, (int) record.player2, record.rank1, record.rank2));
+                playerCount = std::max(playerCount, (size_t) std::max(record.player1, record.player2) + 1);
+            }
+            first += window.count;
+        }
+        return true;
+    }
+
+    template <class Scalar>
+    double ReplaySeconds(const GameModel& model, const std::vector<MatchRecord>& matches, size_t playerCount)
+    {
+        BasicRatingTable<Scalar> table(playerCount, (Scalar) model.initialMean, (Scalar) model.initialStandardDeviation);
+
+        Clock::time_point start = Clock::now();
+        RatingCalculator::CalculateNewRatings(model, table, matches.data(), matches.size());
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    void PrintUsage()
+    {
+        printf("usage: PrecisionDrift [--players n] [--attacks n] [--log file] [--checkpoints n]\n");
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--players") == 0 && hasValue)
+        {
+            options.playerCount = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--attacks") == 0 && hasValue)
+        {
+            options.attacksPerPlayer = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--log") == 0 && hasValue)
+        {
+            options.log = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checkpoints") == 0 && hasValue)
+        {
+            options.checkpointCount = std::max((size_t) atol(argv[++i]), (size_t) 1);
+        }
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    std::vector<MatchRecord> matches;
+    size_t playerCount = options.playerCount;
+    if (options.log)
+    {
+        if (!LoadLog(options.log, matches, playerCount))
+        {
+            fprintf(stderr, "can't read match log %s\n", options.log);
+            return 2;
+        }
+    }
+    else
+    {
+        MakeSimulation(options, matches);
+    }
+
+    GameModel model;
+    size_t interval = std::max((matches.size() + options.checkpointCount - 1) / options.checkpointCount, (size_t) 1);
+
+    std::vector<PrecisionComparison::Checkpoint> checkpoints;
+    if (!PrecisionComparison::Compare(model, matches.data(), matches.size(), playerCount, interval, checkpoints))
+    {
+        fprintf(stderr, "the model can't replay matches without timestamps\n");
+        return 1;
+    }
+
+    printf("%zu players, %zu matches\n\n", playerCount, matches.size());
+    printf("%12s %12s %12s %12s %12s %10s %10s\n", "matches", "max mean", "avg mean", "max sd", "max cons", "same rank", "max shift");
+    for (size_t i = 0; i < checkpoints.size(); i++)
+    {
+        const PrecisionComparison::Checkpoint& checkpoint = checkpoints[i];
+        printf("%12zu %12.3e %12.3e %12.3e %12.3e %9.2f%% %10zu\n", checkpoint.matchCount,
+               checkpoint.maximumMeanError, checkpoint.averageMeanError, checkpoint.maximumStandardDeviationError,
+               checkpoint.maximumConservativeRatingError, checkpoint.rankAgreement * 100, checkpoint.maximumRankDisplacement);
+    }
+
+    double doubleSeconds = ReplaySeconds<double>(model, matches, playerCount);
+    double floatSeconds = ReplaySeconds<float>(model, matches, playerCount);
+    printf("\ndouble replay %.3f s, float replay %.3f s (%.2fx)\n", doubleSeconds, floatSeconds,
+           floatSeconds > 0 ? doubleSeconds / floatSeconds : 0.0);
+
+    return 0;
+}
@@ -8,45 +8,50 @@
 
 #pragma once
 
-#include "GaussianDistribution.h"
+#include "NaturalGaussian.h"
 
 // default one is 3
 #define DEFAULT_CONSERVATIVE_MULTIPLIER 3.0
 
-struct Rating
+// Scalar is the floating point type of the values, Rating is the double version
+template <class Scalar>
+struct BasicRating
 {
-    double conservativeMultiplier;
-    double mean;
-    double standardDeviation;
+    Scalar conservativeMultiplier;
+    Scalar mean;
+    Scalar standardDeviation;
     
-    Rating() : mean(0), standardDeviation(0), conservativeMultiplier(DEFAULT_CONSERVATIVE_MULTIPLIER) { }
-    Rating(double mean, double standardDeviation) : mean(mean), standardDeviation(standardDeviation), conservativeMultiplier(DEFAULT_CONSERVATIVE_MULTIPLIER) { }
-    Rating(double mean, double standardDeviation, double conservativeMultiplier) : mean(mean), standardDeviation(standardDeviation), conservativeMultiplier(conservativeMultiplier) { }
+    BasicRating() : mean(0), standardDeviation(0), conservativeMultiplier(DEFAULT_CONSERVATIVE_MULTIPLIER) { }
+    BasicRating(Scalar mean, Scalar standardDeviation) : mean(mean), standardDeviation(standardDeviation), conservativeMultiplier(DEFAULT_CONSERVATIVE_MULTIPLIER) { }
+    BasicRating(Scalar mean, Scalar standardDeviation, Scalar conservativeMultiplier) : mean(mean), standardDeviation(standardDeviation), conservativeMultiplier(conservativeMultiplier) { }
     
     // A conservative estimate of skill based on the mean and standard deviation
-    double ConservativeRating() const
+    Scalar ConservativeRating() const
     {
         return mean - conservativeMultiplier * standardDeviation;
     }
     
-    static Rating GetPartialUpdate(Rating prior, Rating fullPosterior, double updatePercentage)
+    static BasicRating GetPartialUpdate(BasicRating prior, BasicRating fullPosterior, Scalar updatePercentage)
     {
-        GaussianDistribution priorGaussian = GaussianDistribution(prior.mean, prior.standardDeviation);
-        GaussianDistribution posteriorGaussian = GaussianDistribution(fullPosterior.mean, fullPosterior.standardDeviation);
+        BasicNaturalGaussian<Scalar> priorGaussian = BasicNaturalGaussian<Scalar>::FromMeanStandardDeviation(prior.mean, prior.standardDeviation);
+        BasicNaturalGaussian<Scalar> posteriorGaussian = BasicNaturalGaussian<Scalar>::FromMeanStandardDeviation(fullPosterior.mean, fullPosterior.standardDeviation);
         
         // From a clarification email from Ralf Herbrich:
         // "the idea is to compute a linear interpolation between the prior and posterior skills of each player
         //  ... in the canonical space of parameters"
         
-        double precisionDifference = posteriorGaussian.precision - priorGaussian.precision;
-        double partialPrecisionDifference = updatePercentage*precisionDifference;
+        Scalar precisionDifference = posteriorGaussian.precision - priorGaussian.precision;
+        Scalar partialPrecisionDifference = updatePercentage*precisionDifference;
         
-        double precisionMeanDifference = posteriorGaussian.precisionMean - priorGaussian.precisionMean;
-        double partialPrecisionMeanDifference = updatePercentage*precisionMeanDifference;
+        Scalar precisionMeanDifference = posteriorGaussian.precisionMean - priorGaussian.precisionMean;
+        Scalar partialPrecisionMeanDifference = updatePercentage*precisionMeanDifference;
         
-        GaussianDistribution partialPosteriorGaussion = GaussianDistribution::FromPrecisionMean(priorGaussian.precisionMean + partialPrecisionMeanDifference, priorGaussian.precision + partialPrecisionDifference);
+        BasicNaturalGaussian<Scalar> partialPosteriorGaussion = BasicNaturalGaussian<Scalar>::FromPrecisionMean(priorGaussian.precisionMean + partialPrecisionMeanDifference, priorGaussian.precision + partialPrecisionDifference);
         
-        return Rating(partialPosteriorGaussion.mean, partialPosteriorGaussion.standardDeviation,
+        return BasicRating(partialPosteriorGaussion.Mean(), partialPosteriorGaussion.StandardDeviation(),
                           prior.conservativeMultiplier);
     }
-};
\ No newline at end of file
+};
+
+typedef BasicRating<double> Rating;
+typedef BasicRating<float> FloatRating;
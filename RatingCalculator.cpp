@@ -7,127 +7,95 @@
 //
 
 #include "RatingCalculator.h"
-#include "TruncatedGaussianCorrectionFunctions.h"
+#include "RatingCalculatorCore.h"
+#include "Instrumentation.h"
+#include "TimeDynamics.h"
 
-#include <stdio.h>
 #include <math.h>
+#include <algorithm>
 
-namespace GameInfo
+void RatingCalculator::CalculateNewRatings(const GameModel& model, Rating& player1, Rating& player2, int rank1, int rank2)
 {
-    // Default game values
-    const double initialMean = 25.0;
-    const double drawProbability = 0.10;
-    const double beta = initialMean / 6.0;
-    const double dynamicsFactor = initialMean / 300.0;
-    const double standardDeviation = initialMean / 3.0;
+    SKILLS_TIME(TIMER_CALCULATE_NEW_RATINGS);
+    CalculateNewRatings<GameModel>(model, player1, player2, rank1, rank2);
 }
 
-namespace RatingCalculator
+bool RatingCalculator::CalculateNewRatings(const GameModel& model, RatingTable& table, const MatchRecord* matches, size_t matchCount)
 {
-    Rating  CalculateNewRating(Rating selfRating, Rating opponentRating, GameResult result);
-    double  GetDrawMarginFromDrawProbability(double drawProbability, double beta);
+    if (TimeDynamics::NeedsTimestamps(model, table))
+    {
+        return false;
+    }
+
+    SKILLS_TIME(TIMER_CALCULATE_NEW_RATINGS_BATCH);
+    CalculateNewRatings<GameModel>(model, table, matches, matchCount);
+    return true;
 }
 
-void RatingCalculator::CalculateNewRatings(Rating& player1, Rating& player2, int rank1, int rank2)
+Rating RatingCalculator::CalculateNewRating(const GameModel& model, Rating selfRating, Rating opponentRating, GameResult result)
 {
-    Rating& winner = rank1 > rank2 ? player1 : player2;
-    Rating& loser = rank1 <= rank2 ? player1 : player2;
-    
-    Rating winnerPrevious = Rating(winner.mean, winner.standardDeviation, winner.conservativeMultiplier);
-    Rating loserPrevious = Rating(loser.mean, loser.standardDeviation, loser.conservativeMultiplier);
-    
-    bool wasDraw = rank1 == rank2;
-    
-    winner = CalculateNewRating(winnerPrevious, loserPrevious, wasDraw ? GAME_RESULT_DRAW : GAME_RESULT_WON);
-    loser = CalculateNewRating(loserPrevious, winnerPrevious, wasDraw ? GAME_RESULT_DRAW : GAME_RESULT_LOST);
+    return CalculateNewRating<GameModel>(model, selfRating, opponentRating, result);
 }
 
-Rating RatingCalculator::CalculateNewRating(Rating selfRating, Rating opponentRating, GameResult result)
+double RatingCalculator::CalculateMatchQuality(const GameModel& model, Rating player1Rating, Rating player2Rating)
 {
-    double drawMargin = GetDrawMarginFromDrawProbability(GameInfo::drawProbability, GameInfo::beta);
-    
-    double c = sqrt((selfRating.standardDeviation * selfRating.standardDeviation) + (opponentRating.standardDeviation * opponentRating.standardDeviation) + 2*(GameInfo::beta * GameInfo::beta));
-    
-    double winningMean = selfRating.mean;
-    double losingMean = opponentRating.mean;
-
-    if (result == GAME_RESULT_LOST)
-    {
-        winningMean = opponentRating.mean;
-        losingMean = selfRating.mean;
-    }
-    
-    double meanDelta = winningMean - losingMean;
-    
-    double v;
-    double w;
-    double rankMultiplier;
-    
-    if (result != GAME_RESULT_DRAW)
-    {
-        // non-draw case
-        v = TruncatedGaussianCorrectionFunctions::VExceedsMargin(meanDelta, drawMargin, c);
-        w = TruncatedGaussianCorrectionFunctions::WExceedsMargin(meanDelta, drawMargin, c);
-        rankMultiplier = (int) result;
-    }
-    else
+    return CalculateMatchQuality<GameModel>(model, player1Rating, player2Rating);
+}
+
+double RatingCalculator::CalculateWinChance(const GameModel& model, Rating player1, Rating player2)
+{
+    return CalculateWinChance<GameModel>(model, player1, player2);
+}
+
+void RatingCalculator::CalculateNewRatings(const GameModel& model, FloatRating& player1, FloatRating& player2, int rank1, int rank2)
+{
+    SKILLS_TIME(TIMER_CALCULATE_NEW_RATINGS);
+    CalculateNewRatings<GameModel>(model, player1, player2, rank1, rank2);
+}
+
+bool RatingCalculator::CalculateNewRatings(const GameModel& model, FloatRatingTable& table, const MatchRecord* matches, size_t matchCount)
+{
+    if (TimeDynamics::NeedsTimestamps(model, table))
     {
-        v = TruncatedGaussianCorrectionFunctions::VWithinMargin(meanDelta, drawMargin, c);
-        w = TruncatedGaussianCorrectionFunctions::WWithinMargin(meanDelta, drawMargin, c);
-        rankMultiplier = 1;
+        return false;
     }
-    
-    double meanMultiplier = ((selfRating.standardDeviation * selfRating.standardDeviation) + (GameInfo::dynamicsFactor * GameInfo::dynamicsFactor)) / c;
-    
-    double varianceWithDynamics = (selfRating.standardDeviation * selfRating.standardDeviation) + (GameInfo::dynamicsFactor * GameInfo::dynamicsFactor);
-    double stdDevMultiplier = varianceWithDynamics / (c * c);
-    
-    double newMean = selfRating.mean + (rankMultiplier*meanMultiplier*v);
-    double newStdDev = sqrt(varianceWithDynamics*(1 - w*stdDevMultiplier));
-    
-    return Rating(newMean, newStdDev);
+
+    SKILLS_TIME(TIMER_CALCULATE_NEW_RATINGS_BATCH);
+    CalculateNewRatings<GameModel>(model, table, matches, matchCount);
+    return true;
 }
 
-double RatingCalculator::CalculateMatchQuality(Rating player1Rating, Rating player2Rating)
+FloatRating RatingCalculator::CalculateNewRating(const GameModel& model, FloatRating selfRating, FloatRating opponentRating, GameResult result)
 {
-    // We just use equation 4.1 found on page 8 of the TrueSkill 2006 paper:
-    double betaSquared = GameInfo::beta * GameInfo::beta;
-    double player1SigmaSquared = player1Rating.standardDeviation * player1Rating.standardDeviation;
-    double player2SigmaSquared = player2Rating.standardDeviation * player2Rating.standardDeviation;
-    
-    // This is the square root part of the equation:
-    double sqrtPart = sqrt(
-              (2*betaSquared)
-              /
-              (2*betaSquared + player1SigmaSquared + player2SigmaSquared));
-    
-    // This is the exponent part of the equation:
-    double expPart = exp(
-             (-1*((player1Rating.mean - player2Rating.mean) * (player1Rating.mean - player2Rating.mean)))
-             /
-             (2*(2*betaSquared + player1SigmaSquared + player2SigmaSquared)));
-    
-    return sqrtPart*expPart;
+    return CalculateNewRating<GameModel>(model, selfRating, opponentRating, result);
 }
 
-double RatingCalculator::CalculateWinChance(Rating player1, Rating player2)
+float RatingCalculator::CalculateMatchQuality(const GameModel& model, FloatRating player1Rating, FloatRating player2Rating)
 {
-    double deltaMu = player1.mean - player2.mean;
-    double rsss = sqrt(player1.standardDeviation*player1.standardDeviation + player2.standardDeviation*player2.standardDeviation);
+    return CalculateMatchQuality<GameModel>(model, player1Rating, player2Rating);
+}
 
-    return GaussianDistribution::CumulativeTo(deltaMu / rsss);
+float RatingCalculator::CalculateWinChance(const GameModel& model, FloatRating player1, FloatRating player2)
+{
+    return CalculateWinChance<GameModel>(model, player1, player2);
 }
 
-double RatingCalculator::GetDrawMarginFromDrawProbability(double drawProbability, double beta)
+void RatingCalculator::CalculateNewRatings(Rating& player1, Rating& player2, int rank1, int rank2)
 {
-    // Derived from TrueSkill technical report (MSR-TR-2006-80), page 6
-    
-    // draw probability = 2 * CDF(margin/(sqrt(n1+n2)*beta)) -1
-    
-    // implies
-    //
-    // margin = inversecdf((draw probability + 1)/2) * sqrt(n1+n2) * beta
-    // n1 and n2 are the number of players on each team
-    double margin = GaussianDistribution::InverseCumulativeTo(.5*(drawProbability + 1), 0, 1) * sqrt(1 + 1) * beta;
-    return margin;
-}
\ No newline at end of file
+    CalculateNewRatings(GameModel::Default(), player1, player2, rank1, rank2);
+}
+
+bool RatingCalculator::CalculateNewRatings(RatingTable& table, const MatchRecord* matches, size_t matchCount)
+{
+    return CalculateNewRatings(GameModel::Default(), table, matches, matchCount);
+}
+
+double RatingCalculator::CalculateMatchQuality(Rating player1Rating, Rating player2Rating)
+{
+    return CalculateMatchQuality(GameModel::Default(), player1Rating, player2Rating);
+}
+
+double RatingCalculator::CalculateWinChance(Rating player1, Rating player2)
+{
+    return CalculateWinChance(GameModel::Default(), player1, player2);
+}
@@ -9,6 +9,8 @@
 #pragma once
 
 #include "Rating.h"
+#include "RatingTable.h"
+#include "GameModel.h"
 
 enum GameResult
 {
@@ -19,7 +21,31 @@ enum GameResult
 
 namespace RatingCalculator
 {
+    double  CalculateMatchQuality(const GameModel& model, Rating player1, Rating player2);
+    double  CalculateWinChance(const GameModel& model, Rating player1, Rating player2);
+    void    CalculateNewRatings(const GameModel& model, Rating& player1, Rating& player2, int rank1, int rank2);
+    
+    // One side of a match, for callers that only own one of the players (ShardedRatingService). Both sides
+    // with the priors of the match give exactly the ratings of CalculateNewRatings.
+    Rating  CalculateNewRating(const GameModel& model, Rating selfRating, Rating opponentRating, GameResult result);
+    
+    // Applies matches in order to the table, gives exactly the same ratings as calling
+    // CalculateNewRatings for every pair one after another (ReplayIdentityTest checks this and the other
+    // batch paths that promise it). Matches carry no timestamps, so a model with time
+    // dynamics or a table that tracks lastPlayed is refused (false, nothing applied), use TimeDynamics for those.
+    bool    CalculateNewRatings(const GameModel& model, RatingTable& table, const MatchRecord* matches, size_t matchCount);
+    
+    // Float versions, half the memory of the double ones for bulk work that can live with less precision.
+    // PrecisionComparison measures how far they drift from the double results.
+    float   CalculateMatchQuality(const GameModel& model, FloatRating player1, FloatRating player2);
+    float   CalculateWinChance(const GameModel& model, FloatRating player1, FloatRating player2);
+    void    CalculateNewRatings(const GameModel& model, FloatRating& player1, FloatRating& player2, int rank1, int rank2);
+    FloatRating CalculateNewRating(const GameModel& model, FloatRating selfRating, FloatRating opponentRating, GameResult result);
+    bool    CalculateNewRatings(const GameModel& model, FloatRatingTable& table, const MatchRecord* matches, size_t matchCount);
+    
+    // Same as above with GameModel::Default()
     double  CalculateMatchQuality(Rating player1, Rating player2);
     double  CalculateWinChance(Rating player1, Rating player2);
     void    CalculateNewRatings(Rating& player1, Rating& player2, int rank1, int rank2);
-}
\ No newline at end of file
+    bool    CalculateNewRatings(RatingTable& table, const MatchRecord* matches, size_t matchCount);
+}
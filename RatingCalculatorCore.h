@@ -0,0 +1,173 @@
+//
+//  RatingCalculatorCore.h
+//  Skills
+//
+//  Created by KleMiX on 09/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingCalculator.h"
+#include "TruncatedGaussianCorrectionFunctions.h"
+
+#include <math.h>
+
+// The calculator math templated on the game model and the scalar type. RatingCalculator.cpp instantiates it
+// for GameModel with float and double, include this header directly to use it with a FixedGameModel so the
+// model constants fold away.
+namespace RatingCalculator
+{
+    // Shared by every update path, so they all produce bit-identical results
+    template <class Model, class Scalar>
+    inline void UpdateRating(const Model& model, Scalar selfMean, Scalar selfStdDev, Scalar opponentMean, Scalar opponentStdDev,
+                             GameResult result, Scalar& newMean, Scalar& newStdDev)
+    {
+        Scalar c = sqrt((selfStdDev * selfStdDev) + (opponentStdDev * opponentStdDev) + Scalar(model.twoBetaSquared));
+        Scalar drawMargin = Scalar(model.drawMargin);
+        
+        Scalar winningMean = selfMean;
+        Scalar losingMean = opponentMean;
+        
+        if (result == GAME_RESULT_LOST)
+        {
+            winningMean = opponentMean;
+            losingMean = selfMean;
+        }
+        
+        Scalar meanDelta = winningMean - losingMean;
+        
+        Scalar v;
+        Scalar w;
+        Scalar rankMultiplier;
+        
+        const TruncatedGaussianCorrectionTables* tables = model.CorrectionTables();
+        GaussianAccuracy accuracy = model.Accuracy();
+        
+        if (result != GAME_RESULT_DRAW)
+        {
+            // non-draw case
+            if (tables)
+            {
+                tables->ExceedsMargin(meanDelta/c, drawMargin/c, v, w);
+            }
+            else
+            {
+                v = TruncatedGaussianCorrectionFunctions::VExceedsMargin(meanDelta, drawMargin, c, accuracy);
+                w = TruncatedGaussianCorrectionFunctions::WExceedsMargin(meanDelta, drawMargin, c, accuracy);
+            }
+            rankMultiplier = (int) result;
+        }
+        else
+        {
+            if (tables)
+            {
+                tables->WithinMargin(meanDelta/c, drawMargin/c, v, w);
+            }
+            else
+            {
+                v = TruncatedGaussianCorrectionFunctions::VWithinMargin(meanDelta, drawMargin, c, accuracy);
+                w = TruncatedGaussianCorrectionFunctions::WWithinMargin(meanDelta, drawMargin, c, accuracy);
+            }
+            rankMultiplier = 1;
+        }
+        
+        Scalar varianceWithDynamics = (selfStdDev * selfStdDev) + Scalar(model.dynamicsFactorSquared);
+        Scalar meanMultiplier = varianceWithDynamics / c;
+        Scalar stdDevMultiplier = varianceWithDynamics / (c * c);
+        
+        newMean = selfMean + (rankMultiplier*meanMultiplier*v);
+        newStdDev = sqrt(varianceWithDynamics*(1 - w*stdDevMultiplier));
+    }
+    
+    template <class Model, class Scalar>
+    inline BasicRating<Scalar> CalculateNewRating(const Model& model, BasicRating<Scalar> selfRating, BasicRating<Scalar> opponentRating, GameResult result)
+    {
+        Scalar newMean;
+        Scalar newStdDev;
+        UpdateRating(model, selfRating.mean, selfRating.standardDeviation, opponentRating.mean, opponentRating.standardDeviation,
+                     result, newMean, newStdDev);
+        
+        return BasicRating<Scalar>(newMean, newStdDev);
+    }
+    
+    template <class Model, class Scalar>
+    inline void CalculateNewRatings(const Model& model, BasicRating<Scalar>& player1, BasicRating<Scalar>& player2, int rank1, int rank2)
+    {
+        BasicRating<Scalar>& winner = rank1 > rank2 ? player1 : player2;
+        BasicRating<Scalar>& loser = rank1 <= rank2 ? player1 : player2;
+        
+        BasicRating<Scalar> winnerPrevious = BasicRating<Scalar>(winner.mean, winner.standardDeviation, winner.conservativeMultiplier);
+        BasicRating<Scalar> loserPrevious = BasicRating<Scalar>(loser.mean, loser.standardDeviation, loser.conservativeMultiplier);
+        
+        bool wasDraw = rank1 == rank2;
+        
+        winner = CalculateNewRating<Model>(model, winnerPrevious, loserPrevious, wasDraw ? GAME_RESULT_DRAW : GAME_RESULT_WON);
+        loser = CalculateNewRating<Model>(model, loserPrevious, winnerPrevious, wasDraw ? GAME_RESULT_DRAW : GAME_RESULT_LOST);
+    }
+    
+    // One match applied to rating columns, for batch paths that read their matches from something other than MatchRecord
+    template <class Model, class Scalar, class Index>
+    inline void UpdateRatings(const Model& model, Scalar* mean, Scalar* standardDeviation, Index player1, Index player2, int rank1, int rank2)
+    {
+        Index winner = rank1 > rank2 ? player1 : player2;
+        Index loser = rank1 <= rank2 ? player1 : player2;
+        
+        Scalar winnerMean = mean[winner];
+        Scalar winnerStdDev = standardDeviation[winner];
+        Scalar loserMean = mean[loser];
+        Scalar loserStdDev = standardDeviation[loser];
+        
+        bool wasDraw = rank1 == rank2;
+        
+        UpdateRating(model, winnerMean, winnerStdDev, loserMean, loserStdDev,
+                     wasDraw ? GAME_RESULT_DRAW : GAME_RESULT_WON, mean[winner], standardDeviation[winner]);
+        UpdateRating(model, loserMean, loserStdDev, winnerMean, winnerStdDev,
+                     wasDraw ? GAME_RESULT_DRAW : GAME_RESULT_LOST, mean[loser], standardDeviation[loser]);
+    }
+    
+    template <class Model, class Scalar>
+    inline void CalculateNewRatings(const Model& model, BasicRatingTable<Scalar>& table, const MatchRecord* matches, size_t matchCount)
+    {
+        Scalar* mean = table.mean.data();
+        Scalar* standardDeviation = table.standardDeviation.data();
+        
+        for (size_t i = 0; i < matchCount; i++)
+        {
+            const MatchRecord& match = matches[i];
+            UpdateRatings(model, mean, standardDeviation, match.player1, match.player2, match.rank1, match.rank2);
+        }
+    }
+    
+    template <class Model, class Scalar>
+    inline Scalar CalculateMatchQuality(const Model& model, BasicRating<Scalar> player1Rating, BasicRating<Scalar> player2Rating)
+    {
+        // We just use equation 4.1 found on page 8 of the TrueSkill 2006 paper:
+        Scalar twoBetaSquared = Scalar(model.twoBetaSquared);
+        Scalar player1SigmaSquared = player1Rating.standardDeviation * player1Rating.standardDeviation;
+        Scalar player2SigmaSquared = player2Rating.standardDeviation * player2Rating.standardDeviation;
+        
+        // This is the square root part of the equation:
+        Scalar sqrtPart = sqrt(
+                  twoBetaSquared
+                  /
+                  (twoBetaSquared + player1SigmaSquared + player2SigmaSquared));
+        
+        // This is the exponent part of the equation:
+        Scalar expPart = exp(
+                 (-1*((player1Rating.mean - player2Rating.mean) * (player1Rating.mean - player2Rating.mean)))
+                 /
+                 (2*(twoBetaSquared + player1SigmaSquared + player2SigmaSquared)));
+        
+        return sqrtPart*expPart;
+    }
+    
+    template <class Model, class Scalar>
+    inline Scalar CalculateWinChance(const Model& model, BasicRating<Scalar> player1, BasicRating<Scalar> player2)
+    {
+        Scalar deltaMu = player1.mean - player2.mean;
+        Scalar rsss = sqrt(player1.standardDeviation*player1.standardDeviation + player2.standardDeviation*player2.standardDeviation);
+        
+        return BasicGaussianDistribution<Scalar>::CumulativeTo(deltaMu / rsss, model.Accuracy());
+    }
+}
@@ -0,0 +1,185 @@
+//
+//  RatingHistory.cpp
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "RatingHistory.h"
+#include "RatingCalculatorCore.h"
+#include "TimeDynamics.h"
+
+#include <math.h>
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+    const uint32_t NO_MATCH = 0xffffffff;
+}
+
+RatingHistory::RatingHistory(const GameModel& model, size_t playerCount, double tolerance) :
+    model(model), tolerance(tolerance), ratings(playerCount, model.initialMean, model.initialStandardDeviation), lastMatch(playerCount, NO_MATCH)
+{
+    lastCorrection.recomputedMatches = 0;
+    lastCorrection.changedRatings = 0;
+}
+
+void RatingHistory::Grow(int player)
+{
+    if ((size_t) player >= ratings.Size())
+    {
+        ratings.Resize(player + 1, model.initialMean, model.initialStandardDeviation);
+        lastMatch.resize(player + 1, NO_MATCH);
+    }
+}
+
+bool RatingHistory::Add(int player1, int player2, int rank1, int rank2)
+{
+    if (player1 == player2 || player1 < 0 || player2 < 0 || matches.size() >= NO_MATCH || TimeDynamics::NeedsTimestamps(model))
+    {
+        return false;
+    }
+    Grow(std::max(player1, player2));
+
+    uint32_t match = (uint32_t) matches.size();
+    matches.push_back(MatchRecord(player1, player2, rank1, rank2));
+    voided.push_back(0);
+    queued.push_back(0);
+
+    int players[2] = { player1, player2 };
+    for (int side = 0; side < 2; side++)
+    {
+        int player = players[side];
+        Prior prior = { ratings.mean[player], ratings.standardDeviation[player] };
+        priors.push_back(prior);
+        nextMatch.push_back(NO_MATCH);
+
+        // link the player's previous match to this one
+        uint32_t previous = lastMatch[player];
+        if (previous != NO_MATCH)
+        {
+            nextMatch[2 * previous + (matches[previous].player1 == player ? 0 : 1)] = match;
+        }
+        lastMatch[player] = match;
+    }
+
+    RatingCalculator::UpdateRatings(model, ratings.mean.data(), ratings.standardDeviation.data(), player1, player2, rank1, rank2);
+    return true;
+}
+
+bool RatingHistory::Add(const MatchRecord* matches, size_t matchCount)
+{
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        if (!Add(matches[i].player1, matches[i].player2, matches[i].rank1, matches[i].rank2))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RatingHistory::Void(size_t match)
+{
+    if (match >= matches.size())
+    {
+        return false;
+    }
+
+    lastCorrection.recomputedMatches = 0;
+    lastCorrection.changedRatings = 0;
+    if (!voided[match])
+    {
+        voided[match] = 1;
+        Propagate(match);
+    }
+    return true;
+}
+
+bool RatingHistory::Amend(size_t match, int rank1, int rank2)
+{
+    if (match >= matches.size())
+    {
+        return false;
+    }
+
+    lastCorrection.recomputedMatches = 0;
+    lastCorrection.changedRatings = 0;
+    if (voided[match] || matches[match].rank1 != rank1 || matches[match].rank2 != rank2)
+    {
+        voided[match] = 0;
+        matches[match].rank1 = rank1;
+        matches[match].rank2 = rank2;
+        Propagate(match);
+    }
+    return true;
+}
+
+Rating RatingHistory::Get(int player) const
+{
+    if (player < 0 || (size_t) player >= ratings.Size())
+    {
+        return Rating(model.initialMean, model.initialStandardDeviation);
+    }
+    return ratings.Get(player);
+}
+
+void RatingHistory::Propagate(size_t match)
+{
+    // a match is recomputed once both of its priors are final, every prior comes from an earlier match, so
+    // taking the matches in history order is enough
+    std::greater<uint32_t> later;
+    heap.clear();
+    heap.push_back((uint32_t) match);
+    queued[match] = 1;
+
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        uint32_t current = heap.back();
+        heap.pop_back();
+        queued[current] = 0;
+        lastCorrection.recomputedMatches++;
+
+        const MatchRecord& record = matches[current];
+        Prior* prior = &priors[2 * current];
+        double mean[2] = { prior[0].mean, prior[1].mean };
+        double standardDeviation[2] = { prior[0].standardDeviation, prior[1].standardDeviation };
+        if (!voided[current])
+        {
+            RatingCalculator::UpdateRatings(model, mean, standardDeviation, 0, 1, record.rank1, record.rank2);
+        }
+
+        int players[2] = { record.player1, record.player2 };
+        for (int side = 0; side < 2; side++)
+        {
+            int player = players[side];
+            uint32_t next = nextMatch[2 * current + side];
+            if (next == NO_MATCH)
+            {
+                if (ratings.mean[player] != mean[side] || ratings.standardDeviation[player] != standardDeviation[side])
+                {
+                    ratings.mean[player] = mean[side];
+                    ratings.standardDeviation[player] = standardDeviation[side];
+                    lastCorrection.changedRatings++;
+                }
+                continue;
+            }
+
+            // the chain stops where the rating going into the next match comes out the same, or within the
+            // tolerance. A small change is still kept, the next match uses it if something else recomputes it.
+            Prior& nextPrior = priors[2 * next + (matches[next].player1 == player ? 0 : 1)];
+            double change = std::max(fabs(nextPrior.mean - mean[side]), fabs(nextPrior.standardDeviation - standardDeviation[side]));
+            nextPrior.mean = mean[side];
+            nextPrior.standardDeviation = standardDeviation[side];
+            if (change > tolerance && !queued[next])
+            {
+                queued[next] = 1;
+                heap.push_back(next);
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+        }
+    }
+}
@@ -0,0 +1,116 @@
+//
+//  RatingHistory.h
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingTable.h"
+#include "GameModel.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Ratings that keep enough of their history to void or amend a past result without replaying everything after it.
+//
+// Every match is stored with the ratings both players had before it (their checkpoint at that match) and a
+// link to each player's next match, so every player has a chain through the history. A correction recomputes
+// the changed match and pushes the new ratings along both chains. A later match is only recomputed when one of
+// its priors actually changed, and matches are taken in history order from a heap, so both priors are final
+// when a match is recomputed. The work is proportional to the matches downstream of the correction that involve
+// players whose ratings changed, not to the length of the history.
+//
+// With tolerance 0 the results are exactly the ones of RatingCalculator::CalculateNewRatings over the history
+// with the correction applied, a voided match leaves both players' ratings as they were before it. Exact
+// corrections can reach far: every rating a changed player met since differs in the last bits, so in a dense
+// history they touch most matches after the corrected one. A change shrinks with every match it passes
+// through, a tolerance stops the chains once the changes are below it and keeps corrections local, at the
+// price of ratings that are off by about the tolerance, a little more after many corrections as the changes
+// that weren't passed on add up. Costs 58 bytes per match.
+class RatingHistory
+{
+public:
+    struct Correction
+    {
+        size_t recomputedMatches;       // including the corrected one
+        size_t changedRatings;          // current ratings that changed
+    };
+
+    // The table grows to fit the players of later matches, new players start with the model's initial rating.
+    // Changes of mean and standard deviation up to tolerance aren't passed on by corrections.
+    RatingHistory(const GameModel& model, size_t playerCount, double tolerance = 0);
+
+    // Rates the match and remembers it as match MatchCount() - 1. False for a player playing themselves or a
+    // model with time dynamics (matches carry no timestamps), nothing is recorded then.
+    bool    Add(int player1, int player2, int rank1, int rank2);
+    // Stops at the first match that can't be added
+    bool    Add(const MatchRecord* matches, size_t matchCount);
+
+    // False when there is no such match. Voiding a voided match, or amending to the same ranks, changes nothing.
+    bool    Void(size_t match);
+    // Also brings back a voided match
+    bool    Amend(size_t match, int rank1, int rank2);
+
+    const RatingTable& Ratings() const
+    {
+        return ratings;
+    }
+
+    Rating  Get(int player) const;
+
+    size_t  MatchCount() const
+    {
+        return matches.size();
+    }
+
+    const MatchRecord& MatchAt(size_t match) const
+    {
+        return matches[match];
+    }
+
+    bool    IsVoided(size_t match) const
+    {
+        return voided[match] != 0;
+    }
+
+    const Correction& LastCorrection() const
+    {
+        return lastCorrection;
+    }
+
+private:
+    struct Prior
+    {
+        double mean;
+        double standardDeviation;
+    };
+
+    RatingHistory(const RatingHistory&);
+    RatingHistory& operator = (const RatingHistory&);
+
+    void    Grow(int player);
+    void    Propagate(size_t match);
+
+    GameModel model;
+    double tolerance;
+    RatingTable ratings;
+
+    // per player
+    std::vector<uint32_t> lastMatch;
+
+    // per match, two entries per match for the two sides
+    std::vector<MatchRecord> matches;
+    std::vector<Prior> priors;
+    std::vector<uint32_t> nextMatch;
+    std::vector<uint8_t> voided;
+
+    // matches waiting in the heap of the correction in progress
+    std::vector<uint8_t> queued;
+    std::vector<uint32_t> heap;
+
+    Correction lastCorrection;
+};
@@ -0,0 +1,119 @@
+//
+//  RatingMatrix.cpp
+//  Skills
+//
+//  Created by KleMiX on 06/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "RatingMatrix.h"
+#include "SimdKernels.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // 512 columns of mean and variance are 8 KB, leaving L1 room for the output row
+    const size_t COLUMN_TILE = 512;
+    const size_t ROWS_PER_TASK = 16;
+
+    // Per player terms, computed once instead of once per pair
+    struct Players
+    {
+        std::vector<double> mean;
+        std::vector<double> variance;
+
+        Players(const Rating* ratings, size_t count) : mean(count), variance(count)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                mean[i] = ratings[i].mean;
+                variance[i] = ratings[i].standardDeviation * ratings[i].standardDeviation;
+            }
+        }
+    };
+
+    // RatingCalculatorCore::CalculateWinChance doesn't use beta
+    struct WinChanceRow
+    {
+        void Fill(double rowMean, double rowVariance, const double* mean, const double* variance, double* result, size_t count) const
+        {
+            SimdKernels::WinChanceRow(rowMean, rowVariance, mean, variance, result, count);
+        }
+    };
+
+    struct MatchQualityRow
+    {
+        double twoBetaSquared;
+
+        void Fill(double rowMean, double rowVariance, const double* mean, const double* variance, double* result, size_t count) const
+        {
+            SimdKernels::MatchQualityRow(rowMean, rowVariance, mean, variance, twoBetaSquared, result, count);
+        }
+    };
+
+    template <class Row>
+    void FillRows(const Row& row, const Players& rows, const Players& columns, size_t begin, size_t end, double* result)
+    {
+        size_t columnCount = columns.mean.size();
+
+        for (size_t tile = 0; tile < columnCount; tile += COLUMN_TILE)
+        {
+            size_t tileCount = std::min(COLUMN_TILE, columnCount - tile);
+            for (size_t i = begin; i < end; i++)
+            {
+                row.Fill(rows.mean[i], rows.variance[i], columns.mean.data() + tile, columns.variance.data() + tile,
+                         result + i * columnCount + tile, tileCount);
+            }
+        }
+    }
+
+    template <class Row>
+    void FillMatrix(const Row& row, const Rating* rowRatings, size_t rowCount, const Rating* columnRatings, size_t columnCount,
+                    double* result, ThreadPool* pool)
+    {
+        Players rows(rowRatings, rowCount);
+        Players columns(columnRatings, columnCount);
+
+        if (!pool)
+        {
+            FillRows(row, rows, columns, 0, rowCount, result);
+            return;
+        }
+
+        pool->ParallelFor(rowCount, ROWS_PER_TASK, [&](size_t begin, size_t end)
+        {
+            FillRows(row, rows, columns, begin, end, result);
+        });
+    }
+}
+
+void RatingMatrix::CalculateWinChances(const GameModel&, const Rating* rows, size_t rowCount, const Rating* columns, size_t columnCount,
+                                       double* result)
+{
+    WinChanceRow row;
+    FillMatrix(row, rows, rowCount, columns, columnCount, result, NULL);
+}
+
+void RatingMatrix::CalculateWinChances(const GameModel&, const Rating* rows, size_t rowCount, const Rating* columns, size_t columnCount,
+                                       double* result, ThreadPool& pool)
+{
+    WinChanceRow row;
+    FillMatrix(row, rows, rowCount, columns, columnCount, result, &pool);
+}
+
+void RatingMatrix::CalculateMatchQualities(const GameModel& model, const Rating* rows, size_t rowCount, const Rating* columns, size_t columnCount,
+                                           double* result)
+{
+    MatchQualityRow row = { model.twoBetaSquared };
+    FillMatrix(row, rows, rowCount, columns, columnCount, result, NULL);
+}
+
+void RatingMatrix::CalculateMatchQualities(const GameModel& model, const Rating* rows, size_t rowCount, const Rating* columns, size_t columnCount,
+                                           double* result, ThreadPool& pool)
+{
+    MatchQualityRow row = { model.twoBetaSquared };
+    FillMatrix(row, rows, rowCount, columns, columnCount, result, &pool);
+}
@@ -0,0 +1,36 @@
+//
+//  RatingMatrix.h
+//  Skills
+//
+//  Created by KleMiX on 06/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "Rating.h"
+#include "GameModel.h"
+#include "ThreadPool.h"
+
+#include <stddef.h>
+
+// RatingCalculator::CalculateWinChance and CalculateMatchQuality for every pair of two player sets, for lobby
+// balancing, tournament seeding and the like. result is row major: result[i * columnCount + j] is rows[i]
+// against columns[j].
+//
+// Squared deviations are computed once per player, the pairs are processed in tiles of columns that stay in
+// L1 while every row runs over them, and the cumulative and exp go through SimdKernels. Values follow the
+// SimdKernels accuracy, not bit-identical to the scalar functions, RatingMatrixTest checks them against
+// the scalar ones. The pool versions split the rows over the pool.
+namespace RatingMatrix
+{
+    void    CalculateWinChances(const GameModel& model, const Rating* rows, size_t rowCount, const Rating* columns, size_t columnCount,
+                                double* result);
+    void    CalculateWinChances(const GameModel& model, const Rating* rows, size_t rowCount, const Rating* columns, size_t columnCount,
+                                double* result, ThreadPool& pool);
+
+    void    CalculateMatchQualities(const GameModel& model, const Rating* rows, size_t rowCount, const Rating* columns, size_t columnCount,
+                                    double* result);
+    void    CalculateMatchQualities(const GameModel& model, const Rating* rows, size_t rowCount, const Rating* columns, size_t columnCount,
+                                    double* result, ThreadPool& pool);
+}
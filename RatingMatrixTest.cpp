@@ -0,0 +1,123 @@
+//
+//  RatingMatrixTest.cpp
+//  Skills
+//
+//  Created by KleMiX on 06/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "RatingMatrix.h"
+#include "RatingCalculator.h"
+#include "SimdKernels.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <random>
+#include <vector>
+
+// Fills RatingMatrix win chances and match qualities on every instruction set the cpu supports, with and
+// without a pool, and compares every element with the scalar RatingCalculator::CalculateWinChance and
+// CalculateMatchQuality. Column counts leave vector tails and cross the column tiles, ratings range from
+// fresh players to settled ones far apart so the win chances reach into the tails. The tolerances are the
+// SimdKernels ones: 1e-13 relative for the cumulative, a few ulp for exp, sqrt and the divisions. Exits
+// with 1 when an element is further off, run by ctest.
+
+namespace
+{
+    const size_t ROW_COUNT = 37;
+    const size_t COLUMN_COUNTS[] = { 1, 7, 64, 1031 };
+    const uint64_t SEED = 20140406;
+
+    const double WIN_CHANCE_TOLERANCE = 1e-13;
+    const double MATCH_QUALITY_TOLERANCE = 1e-14;
+
+    void MakeRatings(std::mt19937_64& random, size_t count, std::vector<Rating>& ratings)
+    {
+        std::uniform_real_distribution<double> mean(-10.0, 60.0);
+        std::uniform_real_distribution<double> standardDeviation(0.5, 8.5);
+        ratings.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            ratings[i] = Rating(mean(random), standardDeviation(random));
+        }
+    }
+
+    // relative, down to values that are zero for every purpose
+    double Error(double value, double expected)
+    {
+        if (value == expected)
+        {
+            return 0;
+        }
+        return fabs(value - expected) / fmax(fabs(expected), 1e-300);
+    }
+
+    bool Check(const char* label, const char* name, size_t columnCount, double error, double tolerance)
+    {
+        bool within = error <= tolerance;
+        printf("%-8s %-16s %5zu columns %10.2e %10.2e%s\n", label, name, columnCount, error, tolerance, within ? "" : "  FAILED");
+        return within;
+    }
+}
+
+int main()
+{
+    GameModel model;
+    ThreadPool pool(4);
+    std::mt19937_64 random(SEED);
+    bool success = true;
+
+    printf("%-8s %-16s %13s %10s %10s\n", "", "", "", "error", "tolerance");
+    for (int set = SimdKernels::INSTRUCTION_SET_SCALAR; set <= SimdKernels::SupportedInstructionSet(); set++)
+    {
+        SimdKernels::SetInstructionSet((SimdKernels::InstructionSet) set);
+        const char* label = SimdKernels::InstructionSetName((SimdKernels::InstructionSet) set);
+
+        for (size_t c = 0; c < sizeof(COLUMN_COUNTS) / sizeof(COLUMN_COUNTS[0]); c++)
+        {
+            size_t columnCount = COLUMN_COUNTS[c];
+            std::vector<Rating> rows;
+            std::vector<Rating> columns;
+            MakeRatings(random, ROW_COUNT, rows);
+            MakeRatings(random, columnCount, columns);
+
+            std::vector<double> winChances(ROW_COUNT * columnCount);
+            std::vector<double> matchQualities(ROW_COUNT * columnCount);
+            std::vector<double> pooledWinChances(ROW_COUNT * columnCount);
+            std::vector<double> pooledMatchQualities(ROW_COUNT * columnCount);
+            RatingMatrix::CalculateWinChances(model, rows.data(), ROW_COUNT, columns.data(), columnCount, winChances.data());
+            RatingMatrix::CalculateMatchQualities(model, rows.data(), ROW_COUNT, columns.data(), columnCount, matchQualities.data());
+            RatingMatrix::CalculateWinChances(model, rows.data(), ROW_COUNT, columns.data(), columnCount, pooledWinChances.data(), pool);
+            RatingMatrix::CalculateMatchQualities(model, rows.data(), ROW_COUNT, columns.data(), columnCount, pooledMatchQualities.data(), pool);
+
+            double winChanceError = 0;
+            double matchQualityError = 0;
+            bool pooledSame = true;
+            for (size_t i = 0; i < ROW_COUNT; i++)
+            {
+                for (size_t j = 0; j < columnCount; j++)
+                {
+                    size_t index = i * columnCount + j;
+                    double winChance = RatingCalculator::CalculateWinChance(model, rows[i], columns[j]);
+                    double matchQuality = RatingCalculator::CalculateMatchQuality(model, rows[i], columns[j]);
+                    winChanceError = fmax(winChanceError, Error(winChances[index], winChance));
+                    matchQualityError = fmax(matchQualityError, Error(matchQualities[index], matchQuality));
+
+                    // same kernels on other threads, nothing may change
+                    pooledSame = pooledSame && pooledWinChances[index] == winChances[index] && pooledMatchQualities[index] == matchQualities[index];
+                }
+            }
+
+            success = Check(label, "win chance", columnCount, winChanceError, WIN_CHANCE_TOLERANCE) && success;
+            success = Check(label, "match quality", columnCount, matchQualityError, MATCH_QUALITY_TOLERANCE) && success;
+            if (!pooledSame)
+            {
+                printf("%-8s pool results differ from the single thread ones\n", label);
+                success = false;
+            }
+        }
+    }
+
+    printf("\n%s\n", success ? "all matrices within tolerance" : "matrices differ");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,372 @@
+//
+//  RatingSnapshot.cpp
+//  Skills
+//
+//  Created by KleMiX on 16/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "RatingSnapshot.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char SNAPSHOT_MAGIC[8] = {'S', 'K', 'L', 'S', 'N', 'A', 'P', 'S'};
+static const size_t COLUMN_ALIGNMENT = 64;
+static const size_t WRITE_CHUNK = 8192;
+static const double QUANTIZATION_LEVELS = 65535.0;
+
+static_assert(sizeof(RatingSnapshot::Header) == 128, "snapshot header layout changed");
+
+namespace
+{
+    // FNV-1a over 64 bit words, sections are padded to the column alignment so there is no tail
+    const uint64_t CHECKSUM_OFFSET = 0xcbf29ce484222325ULL;
+    const uint64_t CHECKSUM_PRIME = 0x100000001b3ULL;
+
+    uint64_t UpdateChecksum(uint64_t checksum, const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        for (size_t i = 0; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            checksum = (checksum ^ word) * CHECKSUM_PRIME;
+        }
+        return checksum;
+    }
+
+    size_t ElementSize(RatingSnapshot::Encoding encoding)
+    {
+        switch (encoding)
+        {
+            case RatingSnapshot::SNAPSHOT_ENCODING_FLOAT64: return sizeof(double);
+            case RatingSnapshot::SNAPSHOT_ENCODING_FLOAT32: return sizeof(float);
+            case RatingSnapshot::SNAPSHOT_ENCODING_UINT16:  return sizeof(uint16_t);
+        }
+        return 0;
+    }
+
+    size_t AlignColumn(size_t size)
+    {
+        return (size + COLUMN_ALIGNMENT - 1) & ~(COLUMN_ALIGNMENT - 1);
+    }
+
+    struct ColumnWriter
+    {
+        FILE* file;
+        uint64_t checksum;
+        bool success;
+
+        void Write(const void* data, size_t size)
+        {
+            success = success && fwrite(data, size, 1, file) == 1;
+            checksum = UpdateChecksum(checksum, data, size);
+        }
+
+        void WriteColumn(const double* values, size_t count, RatingSnapshot::Encoding encoding, double minimum, double step)
+        {
+            // chunks are a multiple of 8 bytes for every encoding, so the checksum sees whole words
+            char buffer[WRITE_CHUNK * sizeof(double)];
+            size_t elementSize = ElementSize(encoding);
+
+            for (size_t first = 0; first < count; first += WRITE_CHUNK)
+            {
+                size_t chunk = std::min(WRITE_CHUNK, count - first);
+                for (size_t i = 0; i < chunk; i++)
+                {
+                    double value = values[first + i];
+                    if (encoding == RatingSnapshot::SNAPSHOT_ENCODING_FLOAT64)
+                    {
+                        memcpy(buffer + i * elementSize, &value, sizeof(double));
+                    }
+                    else if (encoding == RatingSnapshot::SNAPSHOT_ENCODING_FLOAT32)
+                    {
+                        float single = (float) value;
+                        memcpy(buffer + i * elementSize, &single, sizeof(float));
+                    }
+                    else
+                    {
+                        double level = step > 0 ? floor((value - minimum) / step + 0.5) : 0;
+                        uint16_t quantized = (uint16_t) std::min(std::max(level, 0.0), QUANTIZATION_LEVELS);
+                        memcpy(buffer + i * elementSize, &quantized, sizeof(uint16_t));
+                    }
+                }
+
+                // zero the tail of the last chunk up to the column alignment
+                size_t bytes = chunk * elementSize;
+                if (first + chunk == count)
+                {
+                    size_t padded = AlignColumn(bytes);
+                    memset(buffer + bytes, 0, padded - bytes);
+                    bytes = padded;
+                }
+                Write(buffer, bytes);
+            }
+        }
+    };
+
+    void FindRange(const std::vector<double>& values, double& minimum, double& step)
+    {
+        if (values.empty())
+        {
+            minimum = 0;
+            step = 0;
+            return;
+        }
+
+        std::pair<std::vector<double>::const_iterator, std::vector<double>::const_iterator> range =
+            std::minmax_element(values.begin(), values.end());
+        minimum = *range.first;
+        step = (*range.second - *range.first) / QUANTIZATION_LEVELS;
+    }
+}
+
+bool RatingSnapshot::Write(const char* path, const RatingTable& table, Encoding encoding, double conservativeMultiplier)
+{
+    size_t count = table.Size();
+    size_t columnSize = AlignColumn(count * ElementSize(encoding));
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.encoding = encoding;
+    header.playerCount = count;
+    header.conservativeMultiplier = conservativeMultiplier;
+    FindRange(table.mean, header.meanMinimum, header.meanStep);
+    FindRange(table.standardDeviation, header.standardDeviationMinimum, header.standardDeviationStep);
+    header.meanOffset = sizeof(Header);
+    header.standardDeviationOffset = header.meanOffset + columnSize;
+    header.fileSize = header.standardDeviationOffset + columnSize;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    // header goes first with a zero checksum, which is also what the checksum covers, and again once it is known
+    ColumnWriter writer;
+    writer.file = file;
+    writer.success = true;
+    writer.checksum = CHECKSUM_OFFSET;
+    writer.Write(&header, sizeof(header));
+
+    writer.WriteColumn(table.mean.data(), count, encoding, header.meanMinimum, header.meanStep);
+    writer.WriteColumn(table.standardDeviation.data(), count, encoding, header.standardDeviationMinimum, header.standardDeviationStep);
+
+    header.checksum = writer.checksum;
+    bool success = writer.success && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    success = fclose(file) == 0 && success;
+    return success;
+}
+
+RatingSnapshot::View::View() : data(NULL), size(0), header(NULL)
+{
+}
+
+RatingSnapshot::View::~View()
+{
+    Close();
+}
+
+bool RatingSnapshot::View::Open(const char* path)
+{
+    Close();
+
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || (size_t) status.st_size < sizeof(Header))
+    {
+        close(file);
+        return false;
+    }
+
+    size = (size_t) status.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED)
+    {
+        size = 0;
+        return false;
+    }
+
+    data = static_cast<const char*>(mapping);
+    header = reinterpret_cast<const Header*>(data);
+
+    // the player count is bounded by the file before it is multiplied, and the columns are checked against
+    // the space left after their offsets, so a damaged header can't overflow into a valid looking layout
+    bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+                 (header->version == 1 || header->version == SNAPSHOT_VERSION) &&
+                 header->encoding <= SNAPSHOT_ENCODING_UINT16 &&
+                 header->fileSize == size &&
+                 header->playerCount <= size / ElementSize((Encoding) header->encoding);
+    if (valid)
+    {
+        size_t columnSize = AlignColumn((size_t) header->playerCount * ElementSize((Encoding) header->encoding));
+        valid = header->meanOffset % COLUMN_ALIGNMENT == 0 && header->standardDeviationOffset % COLUMN_ALIGNMENT == 0 &&
+                header->meanOffset >= sizeof(Header) && header->standardDeviationOffset >= sizeof(Header) &&
+                header->meanOffset <= size && columnSize <= size - header->meanOffset &&
+                header->standardDeviationOffset <= size && columnSize <= size - header->standardDeviationOffset;
+    }
+    if (!valid)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void RatingSnapshot::View::Close()
+{
+    if (data)
+    {
+        munmap(const_cast<char*>(data), size);
+    }
+
+    data = NULL;
+    size = 0;
+    header = NULL;
+}
+
+bool RatingSnapshot::View::VerifyChecksum() const
+{
+    if (!header)
+    {
+        return false;
+    }
+
+    uint64_t checksum = CHECKSUM_OFFSET;
+    if (header->version >= 2)
+    {
+        Header zeroed = *header;
+        zeroed.checksum = 0;
+        checksum = UpdateChecksum(checksum, &zeroed, sizeof(zeroed));
+    }
+    return UpdateChecksum(checksum, data + sizeof(Header), size - sizeof(Header)) == header->checksum;
+}
+
+static double MaximumColumnError(RatingSnapshot::Encoding encoding, double minimum, double step)
+{
+    switch (encoding)
+    {
+        case RatingSnapshot::SNAPSHOT_ENCODING_FLOAT64:
+            return 0;
+        case RatingSnapshot::SNAPSHOT_ENCODING_FLOAT32:
+        {
+            // round to nearest, half an ulp of the largest magnitude
+            double largest = std::max(fabs(minimum), fabs(minimum + step * QUANTIZATION_LEVELS));
+            return largest * ldexp(1.0, -24);
+        }
+        case RatingSnapshot::SNAPSHOT_ENCODING_UINT16:
+            return step / 2;
+    }
+    return 0;
+}
+
+double RatingSnapshot::View::MaximumMeanError() const
+{
+    return MaximumColumnError(ColumnEncoding(), header->meanMinimum, header->meanStep);
+}
+
+double RatingSnapshot::View::MaximumStandardDeviationError() const
+{
+    return MaximumColumnError(ColumnEncoding(), header->standardDeviationMinimum, header->standardDeviationStep);
+}
+
+static inline double DecodeValue(const char* column, RatingSnapshot::Encoding encoding, size_t index, double minimum, double step)
+{
+    switch (encoding)
+    {
+        case RatingSnapshot::SNAPSHOT_ENCODING_FLOAT64:
+            return reinterpret_cast<const double*>(column)[index];
+        case RatingSnapshot::SNAPSHOT_ENCODING_FLOAT32:
+            return reinterpret_cast<const float*>(column)[index];
+        case RatingSnapshot::SNAPSHOT_ENCODING_UINT16:
+            return minimum + reinterpret_cast<const uint16_t*>(column)[index] * step;
+    }
+    return 0;
+}
+
+double RatingSnapshot::View::Mean(size_t index) const
+{
+    return DecodeValue(data + header->meanOffset, ColumnEncoding(), index, header->meanMinimum, header->meanStep);
+}
+
+double RatingSnapshot::View::StandardDeviation(size_t index) const
+{
+    return DecodeValue(data + header->standardDeviationOffset, ColumnEncoding(), index,
+                       header->standardDeviationMinimum, header->standardDeviationStep);
+}
+
+Rating RatingSnapshot::View::Get(size_t index) const
+{
+    return Rating(Mean(index), StandardDeviation(index), header->conservativeMultiplier);
+}
+
+const double* RatingSnapshot::View::MeanColumn() const
+{
+    return ColumnEncoding() == SNAPSHOT_ENCODING_FLOAT64 ? reinterpret_cast<const double*>(data + header->meanOffset) : NULL;
+}
+
+const double* RatingSnapshot::View::StandardDeviationColumn() const
+{
+    return ColumnEncoding() == SNAPSHOT_ENCODING_FLOAT64 ? reinterpret_cast<const double*>(data + header->standardDeviationOffset) : NULL;
+}
+
+const float* RatingSnapshot::View::MeanColumnFloat() const
+{
+    return ColumnEncoding() == SNAPSHOT_ENCODING_FLOAT32 ? reinterpret_cast<const float*>(data + header->meanOffset) : NULL;
+}
+
+const float* RatingSnapshot::View::StandardDeviationColumnFloat() const
+{
+    return ColumnEncoding() == SNAPSHOT_ENCODING_FLOAT32 ? reinterpret_cast<const float*>(data + header->standardDeviationOffset) : NULL;
+}
+
+const uint16_t* RatingSnapshot::View::MeanColumnQuantized() const
+{
+    return ColumnEncoding() == SNAPSHOT_ENCODING_UINT16 ? reinterpret_cast<const uint16_t*>(data + header->meanOffset) : NULL;
+}
+
+const uint16_t* RatingSnapshot::View::StandardDeviationColumnQuantized() const
+{
+    return ColumnEncoding() == SNAPSHOT_ENCODING_UINT16 ? reinterpret_cast<const uint16_t*>(data + header->standardDeviationOffset) : NULL;
+}
+
+void RatingSnapshot::View::Load(RatingTable& table) const
+{
+    size_t count = Size();
+    table.Resize(count, 0, 0);
+    if (table.tracksLastPlayed)
+    {
+        // the snapshot has no lastPlayed, none of the old timestamps belongs to the loaded ratings
+        table.lastPlayed.assign(count, NEVER_PLAYED);
+    }
+
+    if (ColumnEncoding() == SNAPSHOT_ENCODING_FLOAT64)
+    {
+        memcpy(table.mean.data(), MeanColumn(), count * sizeof(double));
+        memcpy(table.standardDeviation.data(), StandardDeviationColumn(), count * sizeof(double));
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        table.mean[i] = Mean(i);
+        table.standardDeviation[i] = StandardDeviation(i);
+    }
+}
@@ -0,0 +1,118 @@
+//
+//  RatingSnapshot.h
+//  Skills
+//
+//  Created by KleMiX on 16/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingTable.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Checkpoint of a RatingTable that is used straight from a memory mapping.
+//
+// A 128 byte Header is followed by the mean column and the standard deviation column, each starting on a
+// 64 byte boundary, native byte order. Columns are stored as doubles, floats or 16 bit values quantized
+// between the smallest and largest value of the column, the conservative multiplier is stored once for
+// the whole table. The checksum covers the whole file, the header with its checksum field zeroed (version 1
+// files only cover what follows the header), and is only checked on request, so opening a snapshot doesn't
+// touch the columns.
+namespace RatingSnapshot
+{
+    enum Encoding
+    {
+        SNAPSHOT_ENCODING_FLOAT64 = 0,
+        SNAPSHOT_ENCODING_FLOAT32 = 1,
+        SNAPSHOT_ENCODING_UINT16 = 2,   // error at most half a step, (maximum - minimum) / 131070
+    };
+
+    enum
+    {
+        SNAPSHOT_VERSION = 2,
+    };
+
+    struct Header
+    {
+        char magic[8];                      // "SKLSNAPS"
+        uint32_t version;
+        uint32_t encoding;
+        uint64_t playerCount;
+        double conservativeMultiplier;
+
+        // range of the columns, SNAPSHOT_ENCODING_UINT16 stores value = minimum + quantized * step
+        double meanMinimum;
+        double meanStep;
+        double standardDeviationMinimum;
+        double standardDeviationStep;
+
+        uint64_t meanOffset;                // from the start of the file
+        uint64_t standardDeviationOffset;
+        uint64_t fileSize;
+        uint64_t checksum;
+
+        char reserved[32];
+    };
+
+    bool    Write(const char* path, const RatingTable& table, Encoding encoding, double conservativeMultiplier = DEFAULT_CONSERVATIVE_MULTIPLIER);
+
+    // Read-only view of a snapshot file
+    class View
+    {
+    public:
+        View();
+        ~View();
+
+        bool    Open(const char* path);
+        void    Close();
+
+        // Reads every column, false when the file was damaged
+        bool    VerifyChecksum() const;
+
+        size_t  Size() const
+        {
+            return header ? (size_t) header->playerCount : 0;
+        }
+
+        Encoding ColumnEncoding() const
+        {
+            return (Encoding) header->encoding;
+        }
+
+        double  ConservativeMultiplier() const
+        {
+            return header->conservativeMultiplier;
+        }
+
+        // Largest difference between a stored and the original value
+        double  MaximumMeanError() const;
+        double  MaximumStandardDeviationError() const;
+
+        double  Mean(size_t index) const;
+        double  StandardDeviation(size_t index) const;
+        Rating  Get(size_t index) const;
+
+        // Raw columns for code that works on them directly, NULL when stored in another encoding
+        const double*   MeanColumn() const;
+        const double*   StandardDeviationColumn() const;
+        const float*    MeanColumnFloat() const;
+        const float*    StandardDeviationColumnFloat() const;
+        const uint16_t* MeanColumnQuantized() const;
+        const uint16_t* StandardDeviationColumnQuantized() const;
+
+        // Decodes the whole snapshot into a table. Snapshots don't store lastPlayed, a table that tracks it
+        // gets every player as NEVER_PLAYED, see TimeDynamics::Apply for exporting the inflation.
+        void    Load(RatingTable& table) const;
+
+    private:
+        View(const View&);
+        View& operator = (const View&);
+
+        const char* data;
+        size_t size;
+        const Header* header;
+    };
+}
@@ -0,0 +1,98 @@
+//
+//  RatingTable.h
+//  Skills
+//
+//  Created by KleMiX on 26/01/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "Rating.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// lastPlayed of players that haven't played since the column was enabled, time dynamics leave them alone
+const uint64_t NEVER_PLAYED = ~(uint64_t) 0;
+
+// A single 1v1 result, players are referenced by their index in a RatingTable.
+// Ranks follow RatingCalculator::CalculateNewRatings: the higher rank wins, equal ranks are a draw.
+struct MatchRecord
+{
+    int player1;
+    int player2;
+    int rank1;
+    int rank2;
+    
+    MatchRecord() : player1(0), player2(0), rank1(0), rank2(0) { }
+    MatchRecord(int player1, int player2, int rank1, int rank2) : player1(player1), player2(player2), rank1(rank1), rank2(rank2) { }
+};
+
+// Structure-of-arrays storage for many ratings, means and standard deviations live in separate columns
+// so batch updates only touch the data they need. Scalar is the type of the columns, RatingTable stores doubles.
+//
+// The lastPlayed column is optional and only kept once TrackLastPlayed was called, TimeDynamics uses it to
+// widen the standard deviations of inactive players.
+template <class Scalar>
+struct BasicRatingTable
+{
+    std::vector<Scalar> mean;
+    std::vector<Scalar> standardDeviation;
+    std::vector<uint64_t> lastPlayed;
+    bool tracksLastPlayed;
+    
+    BasicRatingTable() : tracksLastPlayed(false) { }
+    BasicRatingTable(size_t playerCount, Scalar initialMean, Scalar initialStandardDeviation) : mean(playerCount, initialMean), standardDeviation(playerCount, initialStandardDeviation), tracksLastPlayed(false) { }
+    
+    size_t Size() const
+    {
+        return mean.size();
+    }
+    
+    void Resize(size_t playerCount, Scalar initialMean, Scalar initialStandardDeviation)
+    {
+        mean.resize(playerCount, initialMean);
+        standardDeviation.resize(playerCount, initialStandardDeviation);
+        if (tracksLastPlayed)
+        {
+            lastPlayed.resize(playerCount, NEVER_PLAYED);
+        }
+    }
+    
+    int Add(BasicRating<Scalar> rating)
+    {
+        mean.push_back(rating.mean);
+        standardDeviation.push_back(rating.standardDeviation);
+        if (tracksLastPlayed)
+        {
+            lastPlayed.push_back(NEVER_PLAYED);
+        }
+        return (int) mean.size() - 1;
+    }
+    
+    // Players already in the table start as NEVER_PLAYED
+    void TrackLastPlayed()
+    {
+        if (!tracksLastPlayed)
+        {
+            tracksLastPlayed = true;
+            lastPlayed.assign(Size(), NEVER_PLAYED);
+        }
+    }
+    
+    BasicRating<Scalar> Get(int index) const
+    {
+        return BasicRating<Scalar>(mean[index], standardDeviation[index]);
+    }
+    
+    void Set(int index, BasicRating<Scalar> rating)
+    {
+        mean[index] = rating.mean;
+        standardDeviation[index] = rating.standardDeviation;
+    }
+};
+
+typedef BasicRatingTable<double> RatingTable;
+typedef BasicRatingTable<float> FloatRatingTable;
@@ -0,0 +1,143 @@
+//
+//  ReplayIdentityTest.cpp
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "RatingCalculator.h"
+#include "ParallelReplay.h"
+#include "ShardedRatingService.h"
+#include "RatingHistory.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+// Replays a fixed seeded history through RatingCalculator::CalculateNewRatings one pair at a time and through
+// every batch path that promises the same ratings bit for bit: the table batch, ParallelReplay, ShardedRatingService
+// and RatingHistory with tolerance 0 after a correction. Exits with 1 when any rating differs in any bit, run by ctest.
+
+namespace
+{
+    const size_t PLAYER_COUNT = 20000;
+    const size_t MATCH_COUNT = 400000;
+    const uint64_t SEED = 20140420;
+
+    // Wins both ways and draws, a few players much more active than the rest so waves and rounds get uneven
+    void MakeHistory(std::vector<MatchRecord>& matches)
+    {
+        std::mt19937_64 random(SEED);
+        matches.reserve(MATCH_COUNT);
+        while (matches.size() < MATCH_COUNT)
+        {
+            int player1 = (int) (random() % 8 == 0 ? random() % 64 : random() % PLAYER_COUNT);
+            int player2 = (int) (random() % PLAYER_COUNT);
+            if (player1 != player2)
+            {
+                matches.push_back(MatchRecord(player1, player2, (int) (random() % 3), 1));
+            }
+        }
+    }
+
+    void ReplayPairs(const GameModel& model, const std::vector<MatchRecord>& matches, size_t skipped, RatingTable& table)
+    {
+        std::vector<Rating> ratings(PLAYER_COUNT, Rating(model.initialMean, model.initialStandardDeviation));
+        for (size_t i = 0; i < matches.size(); i++)
+        {
+            const MatchRecord& match = matches[i];
+            if (i != skipped)
+            {
+                RatingCalculator::CalculateNewRatings(model, ratings[match.player1], ratings[match.player2], match.rank1, match.rank2);
+            }
+        }
+
+        table = RatingTable(PLAYER_COUNT, model.initialMean, model.initialStandardDeviation);
+        for (size_t i = 0; i < PLAYER_COUNT; i++)
+        {
+            table.Set((int) i, ratings[i]);
+        }
+    }
+
+    bool Check(const char* name, const RatingTable& expected, const RatingTable& table, bool applied)
+    {
+        size_t differing = 0;
+        for (size_t i = 0; applied && i < expected.Size(); i++)
+        {
+            // bitwise, -0.0 and 0.0 or two NaNs must not pass as equal
+            if (memcmp(&expected.mean[i], &table.mean[i], sizeof(double)) != 0 ||
+                memcmp(&expected.standardDeviation[i], &table.standardDeviation[i], sizeof(double)) != 0)
+            {
+                differing++;
+            }
+        }
+
+        bool identical = applied && table.Size() == expected.Size() && differing == 0;
+        printf("%-40s %s", name, identical ? "identical" : "FAILED");
+        if (!applied)
+        {
+            printf(", not applied");
+        }
+        else if (differing > 0)
+        {
+            printf(", %zu players differ", differing);
+        }
+        printf("\n");
+        return identical;
+    }
+
+    bool CheckSharded(const GameModel& model, const std::vector<MatchRecord>& matches, const RatingTable& expected, int shardCount)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "ShardedRatingService, %d shards", shardCount);
+
+        ShardedRatingService service(model, PLAYER_COUNT, shardCount);
+        RatingTable table;
+        bool applied = service.Start() && service.CalculateNewRatings(matches.data(), matches.size()) && service.CopyTo(table);
+        service.Stop();
+        return Check(name, expected, table, applied);
+    }
+}
+
+int main()
+{
+    GameModel model;
+    std::vector<MatchRecord> matches;
+    MakeHistory(matches);
+
+    RatingTable expected;
+    ReplayPairs(model, matches, MATCH_COUNT, expected);
+    printf("%zu players, %zu matches\n\n", PLAYER_COUNT, matches.size());
+
+    bool success = true;
+
+    // the shards fork, before any thread is started
+    success = CheckSharded(model, matches, expected, 1) && success;
+    success = CheckSharded(model, matches, expected, 3) && success;
+
+    RatingTable table(PLAYER_COUNT, model.initialMean, model.initialStandardDeviation);
+    bool applied = RatingCalculator::CalculateNewRatings(model, table, matches.data(), matches.size());
+    success = Check("RatingCalculator table batch", expected, table, applied) && success;
+
+    ThreadPool pool(4);
+    table = RatingTable(PLAYER_COUNT, model.initialMean, model.initialStandardDeviation);
+    applied = ParallelReplay::CalculateNewRatings(model, table, matches.data(), matches.size(), pool);
+    success = Check("ParallelReplay, 4 threads", expected, table, applied) && success;
+
+    // void a match early in the history, so the correction reaches far, then bring it back
+    size_t corrected = MATCH_COUNT / 10;
+    RatingHistory history(model, PLAYER_COUNT);
+    applied = history.Add(matches.data(), matches.size()) && history.Void(corrected);
+
+    RatingTable withoutCorrected;
+    ReplayPairs(model, matches, corrected, withoutCorrected);
+    success = Check("RatingHistory, voided match", withoutCorrected, history.Ratings(), applied) && success;
+
+    applied = history.Amend(corrected, matches[corrected].rank1, matches[corrected].rank2);
+    success = Check("RatingHistory, amended back", expected, history.Ratings(), applied) && success;
+
+    printf("\n%s\n", success ? "all paths identical" : "paths differ");
+    return success ? 0 : 1;
+}
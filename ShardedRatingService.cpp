@@ -0,0 +1,534 @@
+//
+//  ShardedRatingService.cpp
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "ShardedRatingService.h"
+#include "RatingCalculatorCore.h"
+#include "TimeDynamics.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace
+{
+    enum MessageType
+    {
+        MESSAGE_ROUND = 1,      // operations and prior requests, answered with the priors
+        MESSAGE_COPY,           // answered with every row of the shard
+        MESSAGE_STOP,
+    };
+
+    // Followed by the arrays it counts, in this order. Answers only carry priors.
+    struct MessageHeader
+    {
+        uint32_t type;
+        uint32_t operationCount;
+        uint32_t priorCount;
+    };
+
+    const uint32_t REMOTE_OPPONENT = 0xffffffff;
+
+#ifdef MSG_NOSIGNAL
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;   // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+    // A shard that died shows up as a failed write instead of a SIGPIPE
+    bool WriteAll(int socket, const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            ssize_t written = send(socket, bytes, size, SEND_FLAGS);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            bytes += written;
+            size -= (size_t) written;
+        }
+        return true;
+    }
+
+    bool ReadAll(int socket, void* data, size_t size)
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0)
+        {
+            ssize_t got = recv(socket, bytes, size, 0);
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (got <= 0)
+            {
+                return false;
+            }
+            bytes += got;
+            size -= (size_t) got;
+        }
+        return true;
+    }
+
+    template <class T>
+    bool WriteArray(int socket, const std::vector<T>& values)
+    {
+        return values.empty() || WriteAll(socket, values.data(), values.size() * sizeof(T));
+    }
+
+    template <class T>
+    bool ReadArray(int socket, std::vector<T>& values, size_t count)
+    {
+        values.resize(count);
+        return count == 0 || ReadAll(socket, values.data(), count * sizeof(T));
+    }
+
+    GameResult ResultOf(int rank, int opponentRank)
+    {
+        return rank == opponentRank ? GAME_RESULT_DRAW : (rank > opponentRank ? GAME_RESULT_WON : GAME_RESULT_LOST);
+    }
+}
+
+ShardedRatingService::ShardedRatingService(const GameModel& model, size_t playerCount, int shardCount) :
+    model(model), playerCount(playerCount), shardCount(shardCount > 0 ? shardCount : 1)
+{
+}
+
+ShardedRatingService::~ShardedRatingService()
+{
+    Stop();
+}
+
+bool ShardedRatingService::Start()
+{
+    if (IsRunning())
+    {
+        return true;
+    }
+
+    shards.reserve(shardCount);
+    for (int s = 0; s < shardCount; s++)
+    {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+        {
+            Stop();
+            return false;
+        }
+
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(sockets[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+        setsockopt(sockets[1], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+        pid_t process = fork();
+        if (process < 0)
+        {
+            close(sockets[0]);
+            close(sockets[1]);
+            Stop();
+            return false;
+        }
+
+        if (process == 0)
+        {
+            // the child keeps only its own end, the coordinator's sockets stay with the coordinator
+            close(sockets[0]);
+            for (size_t i = 0; i < shards.size(); i++)
+            {
+                close(shards[i].socket);
+            }
+            RunShard(model, RowCount(s), sockets[1]);
+            _exit(0);
+        }
+
+        close(sockets[1]);
+        shards.push_back(Shard());
+        shards.back().process = process;
+        shards.back().socket = sockets[0];
+        shards.back().answerPending = false;
+    }
+    return true;
+}
+
+void ShardedRatingService::Stop()
+{
+    MessageHeader header = { MESSAGE_STOP, 0, 0 };
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        WriteAll(shards[i].socket, &header, sizeof(header));
+        close(shards[i].socket);
+    }
+
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        while (waitpid(shards[i].process, NULL, 0) < 0 && errno == EINTR)
+        {
+        }
+    }
+    shards.clear();
+}
+
+bool ShardedRatingService::CalculateNewRatings(const MatchRecord* matches, size_t matchCount)
+{
+    if (!IsRunning() || TimeDynamics::NeedsTimestamps(model))
+    {
+        return false;
+    }
+
+    // the next round is built while the shards work on this one
+    size_t roundCount = ScheduleRounds(matches, matchCount);
+    AddRound(matches, 0);
+    bool ok = true;
+    for (size_t round = 0; round < roundCount && ok; round++)
+    {
+        ok = SendRound(round);
+        if (round + 1 < roundCount)
+        {
+            AddRound(matches, round + 1);
+        }
+        ok = ReceiveRound(round) && ok;
+    }
+
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        shards[i].operations.clear();
+    }
+
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        lastRound[matches[i].player1] = 0;
+        lastRound[matches[i].player2] = 0;
+    }
+    return ok;
+}
+
+size_t ShardedRatingService::ScheduleRounds(const MatchRecord* matches, size_t matchCount)
+{
+    if (lastRound.size() != playerCount)
+    {
+        lastRound.assign(playerCount, 0);
+    }
+    for (size_t s = 0; s < shards.size(); s++)
+    {
+        for (size_t round = 0; round < shards[s].priorRequests.size(); round++)
+        {
+            shards[s].priorRequests[round].clear();
+        }
+    }
+
+    // round of every match, the prior of a player is asked for at the end of the round of their last match.
+    // roundOffsets counts the matches of every round first.
+    roundOffsets.assign(1, 0);
+    matchRound.resize(matchCount);
+    priorSlots.resize(2 * matchCount);
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        const MatchRecord& match = matches[i];
+        uint32_t round1 = lastRound[match.player1];
+        uint32_t round2 = lastRound[match.player2];
+        uint32_t round = std::max(round1, round2);
+        if (ShardOf(match.player1) != ShardOf(match.player2))
+        {
+            priorSlots[2 * i] = RequestPrior(match.player1, round1);
+            priorSlots[2 * i + 1] = RequestPrior(match.player2, round2);
+            round++;
+        }
+
+        lastRound[match.player1] = round;
+        lastRound[match.player2] = round;
+        matchRound[i] = round;
+        if (round == roundOffsets.size())
+        {
+            roundOffsets.push_back(0);
+        }
+        roundOffsets[round]++;
+    }
+
+    // counting sort keeps the original order inside a round
+    size_t roundCount = roundOffsets.size();
+    size_t offset = 0;
+    for (size_t round = 0; round < roundCount; round++)
+    {
+        size_t size = roundOffsets[round];
+        roundOffsets[round] = offset;
+        offset += size;
+    }
+    roundOffsets.push_back(offset);
+
+    std::vector<size_t> position(roundOffsets.begin(), roundOffsets.end() - 1);
+    ordered.resize(matchCount);
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        ordered[position[matchRound[i]]++] = (uint32_t) i;
+    }
+    return roundCount;
+}
+
+ShardedRatingService::PriorSlot ShardedRatingService::RequestPrior(int player, uint32_t round)
+{
+    Shard& shard = shards[ShardOf(player)];
+    if (shard.priorRequests.size() <= round)
+    {
+        shard.priorRequests.resize(round + 1);
+    }
+
+    PriorSlot slot;
+    slot.round = round;
+    slot.index = (uint32_t) shard.priorRequests[round].size();
+    shard.priorRequests[round].push_back(RowOf(player));
+    return slot;
+}
+
+// The priors of round - 1 are still being computed, they are deferred until its answers are in
+void ShardedRatingService::AddRound(const MatchRecord* matches, size_t round)
+{
+    for (size_t k = roundOffsets[round]; k < roundOffsets[round + 1]; k++)
+    {
+        size_t i = ordered[k];
+        const MatchRecord& match = matches[i];
+        Shard& shard1 = shards[ShardOf(match.player1)];
+        Shard& shard2 = shards[ShardOf(match.player2)];
+
+        Operation operation;
+        operation.player = RowOf(match.player1);
+        operation.rank = match.rank1;
+        operation.opponentRank = match.rank2;
+        if (&shard1 == &shard2)
+        {
+            operation.opponent = RowOf(match.player2);
+            operation.opponentPrior.mean = 0;
+            operation.opponentPrior.standardDeviation = 0;
+            shard1.operations.push_back(operation);
+            continue;
+        }
+
+        // the answers come from earlier rounds, both priors are from before this match
+        const PriorSlot& slot1 = priorSlots[2 * i];
+        const PriorSlot& slot2 = priorSlots[2 * i + 1];
+        operation.opponent = REMOTE_OPPONENT;
+        AddRemoteOperation(operation, ShardOf(match.player1), ShardOf(match.player2), slot2, round);
+
+        operation.player = RowOf(match.player2);
+        operation.rank = match.rank2;
+        operation.opponentRank = match.rank1;
+        AddRemoteOperation(operation, ShardOf(match.player2), ShardOf(match.player1), slot1, round);
+    }
+}
+
+void ShardedRatingService::AddRemoteOperation(Operation& operation, int shard, int sourceShard, const PriorSlot& slot, size_t round)
+{
+    std::vector<Operation>& operations = shards[shard].operations;
+    if (slot.round + 1 == round)
+    {
+        DeferredPrior deferred = { (uint32_t) shard, (uint32_t) operations.size(), (uint32_t) sourceShard, slot.index };
+        deferredPriors.push_back(deferred);
+        operation.opponentPrior.mean = 0;
+        operation.opponentPrior.standardDeviation = 0;
+    }
+    else
+    {
+        operation.opponentPrior = shards[sourceShard].priors[slot.round][slot.index];
+    }
+    operations.push_back(operation);
+}
+
+// Every message goes out before any answer is read, so the shards work on the round at the same time.
+// Shards without anything to do in this round sit it out.
+bool ShardedRatingService::SendRound(size_t round)
+{
+    static const std::vector<uint32_t> noRequests;
+
+    bool ok = true;
+    for (size_t i = 0; i < shards.size() && ok; i++)
+    {
+        Shard& shard = shards[i];
+        const std::vector<uint32_t>& requests = round < shard.priorRequests.size() ? shard.priorRequests[round] : noRequests;
+        if (shard.operations.empty() && requests.empty())
+        {
+            continue;
+        }
+
+        MessageHeader header = { MESSAGE_ROUND, (uint32_t) shard.operations.size(), (uint32_t) requests.size() };
+        ok = WriteAll(shard.socket, &header, sizeof(header)) && WriteArray(shard.socket, shard.operations) &&
+             WriteArray(shard.socket, requests);
+        shard.answerPending = ok;
+    }
+
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        shards[i].operations.clear();
+    }
+    return ok;
+}
+
+// Reads the answers of every shard that got the round, then fills in the priors the next round was waiting for
+bool ShardedRatingService::ReceiveRound(size_t round)
+{
+    bool ok = true;
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        Shard& shard = shards[i];
+        if (!shard.answerPending)
+        {
+            continue;
+        }
+        shard.answerPending = false;
+
+        if (shard.priors.size() <= round)
+        {
+            shard.priors.resize(round + 1);
+        }
+        size_t requestCount = round < shard.priorRequests.size() ? shard.priorRequests[round].size() : 0;
+        MessageHeader answer;
+        ok = ok && ReadAll(shard.socket, &answer, sizeof(answer)) && answer.priorCount == requestCount &&
+             ReadArray(shard.socket, shard.priors[round], answer.priorCount);
+    }
+
+    for (size_t i = 0; i < deferredPriors.size() && ok; i++)
+    {
+        const DeferredPrior& deferred = deferredPriors[i];
+        shards[deferred.shard].operations[deferred.operation].opponentPrior = shards[deferred.sourceShard].priors[round][deferred.index];
+    }
+    deferredPriors.clear();
+    return ok;
+}
+
+bool ShardedRatingService::Get(int player, Rating& rating)
+{
+    if (!IsRunning() || player < 0 || (size_t) player >= playerCount)
+    {
+        return false;
+    }
+
+    // a round with nothing to apply
+    Shard& shard = shards[ShardOf(player)];
+    MessageHeader header = { MESSAGE_ROUND, 0, 1 };
+    uint32_t row = RowOf(player);
+    MessageHeader answer;
+    Prior prior;
+    if (!WriteAll(shard.socket, &header, sizeof(header)) || !WriteAll(shard.socket, &row, sizeof(row)) ||
+        !ReadAll(shard.socket, &answer, sizeof(answer)) || answer.priorCount != 1 || !ReadAll(shard.socket, &prior, sizeof(prior)))
+    {
+        return false;
+    }
+
+    rating = Rating(prior.mean, prior.standardDeviation);
+    return true;
+}
+
+bool ShardedRatingService::CopyTo(RatingTable& table)
+{
+    if (!IsRunning())
+    {
+        return false;
+    }
+
+    MessageHeader header = { MESSAGE_COPY, 0, 0 };
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        if (!WriteAll(shards[i].socket, &header, sizeof(header)))
+        {
+            return false;
+        }
+    }
+
+    table.Resize(playerCount, model.initialMean, model.initialStandardDeviation);
+    std::vector<Prior> rows;
+    for (int s = 0; s < shardCount; s++)
+    {
+        MessageHeader answer;
+        if (!ReadAll(shards[s].socket, &answer, sizeof(answer)) || answer.priorCount != RowCount(s) ||
+            !ReadArray(shards[s].socket, rows, answer.priorCount))
+        {
+            return false;
+        }
+
+        for (size_t row = 0; row < rows.size(); row++)
+        {
+            size_t player = row * shardCount + s;
+            table.mean[player] = rows[row].mean;
+            table.standardDeviation[player] = rows[row].standardDeviation;
+        }
+    }
+    return true;
+}
+
+void ShardedRatingService::RunShard(const GameModel& model, size_t rowCount, int socket)
+{
+    // the coordinator's terminal signals are for the coordinator, the shard stops when its socket closes
+    signal(SIGINT, SIG_IGN);
+
+    RatingTable table(rowCount, model.initialMean, model.initialStandardDeviation);
+    double* mean = table.mean.data();
+    double* standardDeviation = table.standardDeviation.data();
+    std::vector<Operation> operations;
+    std::vector<uint32_t> priorRequests;
+    std::vector<Prior> priors;
+
+    MessageHeader header;
+    while (ReadAll(socket, &header, sizeof(header)) && header.type != MESSAGE_STOP)
+    {
+        if (header.type == MESSAGE_COPY)
+        {
+            priors.resize(rowCount);
+            for (size_t row = 0; row < rowCount; row++)
+            {
+                priors[row].mean = mean[row];
+                priors[row].standardDeviation = standardDeviation[row];
+            }
+        }
+        else
+        {
+            if (!ReadArray(socket, operations, header.operationCount) || !ReadArray(socket, priorRequests, header.priorCount))
+            {
+                break;
+            }
+
+            for (size_t i = 0; i < operations.size(); i++)
+            {
+                const Operation& operation = operations[i];
+                if (operation.opponent != REMOTE_OPPONENT)
+                {
+                    RatingCalculator::UpdateRatings<GameModel, double, uint32_t>(model, mean, standardDeviation, operation.player,
+                                                                                 operation.opponent, operation.rank, operation.opponentRank);
+                    continue;
+                }
+
+                Rating rating = RatingCalculator::CalculateNewRating(model, table.Get(operation.player),
+                                                                     Rating(operation.opponentPrior.mean, operation.opponentPrior.standardDeviation),
+                                                                     ResultOf(operation.rank, operation.opponentRank));
+                mean[operation.player] = rating.mean;
+                standardDeviation[operation.player] = rating.standardDeviation;
+            }
+
+            priors.resize(priorRequests.size());
+            for (size_t i = 0; i < priorRequests.size(); i++)
+            {
+                priors[i].mean = mean[priorRequests[i]];
+                priors[i].standardDeviation = standardDeviation[priorRequests[i]];
+            }
+        }
+
+        MessageHeader answer = { header.type, 0, (uint32_t) priors.size() };
+        if (!WriteAll(socket, &answer, sizeof(answer)) || !WriteArray(socket, priors))
+        {
+            break;
+        }
+    }
+    close(socket);
+}
@@ -0,0 +1,162 @@
+//
+//  ShardedRatingService.h
+//  Skills
+//
+//  Created by KleMiX on 20/04/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "RatingTable.h"
+#include "GameModel.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+// Ratings partitioned over worker processes, for populations one process can't hold or update alone.
+//
+// Player p lives on shard p % shardCount at row p / shardCount of that shard's RatingTable. The process that
+// calls Start is the coordinator, it forks one process per shard and talks to each over a Unix socket pair.
+// Matches with both players on one shard are sent to it as they are. For a match across shards both shards
+// get their own player, the ranks and the opponent's prior (mean, standard deviation), and apply
+// RatingCalculator::CalculateNewRating to their side. Both sides use the priors from before the match, so the
+// ratings are exactly the ones of RatingCalculator::CalculateNewRatings for the same matches in the same order.
+//
+// A batch runs in rounds, one round trip to every shard that has work at once. A shard applies the matches of
+// a round in their original order and then answers with the priors that later rounds asked for. Only the
+// priors cost a round: a match goes to the round of its players' previous matches, one later when it crosses
+// shards, so with one shard a batch is a single message and the round count grows with how often the same
+// players meet across shards, not with the batch size.
+//
+// The shards do the rating math in parallel. The coordinator schedules the batch up front and builds every
+// round while the shards apply the one before, leaving out only the priors that round will answer; those are
+// copied in when the answers arrive. Between two rounds a shard waits for those copies and one round trip,
+// so throughput grows with the shard count until the scheduling pass or the number of cores is the limit.
+// Batches of thousands of matches keep the round trips cheap.
+class ShardedRatingService
+{
+public:
+    // Players are ids below playerCount, every one starts with the model's initial rating
+    ShardedRatingService(const GameModel& model, size_t playerCount, int shardCount);
+    // Stops the shards
+    ~ShardedRatingService();
+
+    // Forks the shard processes. Call it before starting any threads, the children only run the shard loop.
+    // False when a socket or process couldn't be created, the shards that did start are stopped again.
+    bool    Start();
+    void    Stop();
+
+    // Applies the matches in order and returns once every shard did. False when a shard stopped answering,
+    // the service has to be restarted then. Also false, with nothing applied, for a model with time dynamics,
+    // matches carry no timestamps.
+    bool    CalculateNewRatings(const MatchRecord* matches, size_t matchCount);
+
+    bool    Get(int player, Rating& rating);
+    // Collects every shard into one table indexed by player id
+    bool    CopyTo(RatingTable& table);
+
+    int     ShardCount() const
+    {
+        return shardCount;
+    }
+
+    size_t  PlayerCount() const
+    {
+        return playerCount;
+    }
+
+    bool    IsRunning() const
+    {
+        return !shards.empty();
+    }
+
+private:
+    struct Prior
+    {
+        double mean;
+        double standardDeviation;
+    };
+
+    // A match as one shard sees it, the opponent is another row of the shard or REMOTE_OPPONENT with the
+    // prior filled in
+    struct Operation
+    {
+        uint32_t player;
+        uint32_t opponent;
+        int32_t rank;
+        int32_t opponentRank;
+        Prior opponentPrior;
+    };
+
+    // Where the coordinator finds a prior: the answer of a shard to an earlier round of the batch
+    struct PriorSlot
+    {
+        uint32_t round;
+        uint32_t index;
+    };
+
+    // A prior of the round the shards are applying, copied into the next round once it was answered
+    struct DeferredPrior
+    {
+        uint32_t shard;         // whose next round needs it
+        uint32_t operation;
+        uint32_t sourceShard;
+        uint32_t index;
+    };
+
+    struct Shard
+    {
+        pid_t process;
+        int socket;
+        bool answerPending;
+
+        std::vector<Operation> operations;                  // of the round being built
+        std::vector<std::vector<uint32_t> > priorRequests;  // rows, by round
+        std::vector<std::vector<Prior> > priors;            // answers, by round
+    };
+
+    ShardedRatingService(const ShardedRatingService&);
+    ShardedRatingService& operator = (const ShardedRatingService&);
+
+    int     ShardOf(int player) const
+    {
+        return player % shardCount;
+    }
+
+    uint32_t RowOf(int player) const
+    {
+        return (uint32_t) (player / shardCount);
+    }
+
+    size_t  RowCount(int shard) const
+    {
+        return (playerCount + shardCount - 1 - shard) / shardCount;
+    }
+
+    size_t  ScheduleRounds(const MatchRecord* matches, size_t matchCount);
+    PriorSlot RequestPrior(int player, uint32_t round);
+    void    AddRound(const MatchRecord* matches, size_t round);
+    void    AddRemoteOperation(Operation& operation, int shard, int sourceShard, const PriorSlot& slot, size_t round);
+    bool    SendRound(size_t round);
+    bool    ReceiveRound(size_t round);
+
+    static void RunShard(const GameModel& model, size_t rowCount, int socket);
+
+    GameModel model;
+    size_t playerCount;
+    int shardCount;
+    std::vector<Shard> shards;
+
+    // per player, the round of their last match in the batch being scheduled; 0 again after every batch
+    std::vector<uint32_t> lastRound;
+    std::vector<uint32_t> matchRound;
+    // match indices round after round, original order inside a round
+    std::vector<uint32_t> ordered;
+    std::vector<size_t> roundOffsets;
+    // two per match, only set for matches across shards
+    std::vector<PriorSlot> priorSlots;
+    std::vector<DeferredPrior> deferredPriors;
+};
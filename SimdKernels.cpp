@@ -0,0 +1,376 @@
+//
+//  SimdKernels.cpp
+//  Skills
+//
+//  Created by KleMiX on 02/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "SimdKernels.h"
+#include "GaussianDistribution.h"
+#include "TruncatedGaussianCorrectionFunctions.h"
+#include "TimeDynamics.h"
+
+#include <math.h>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_KERNELS_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_KERNELS_X86 0
+#endif
+
+namespace
+{
+    struct KernelTable
+    {
+        void (*exp)(const double* x, double* result, size_t count);
+        void (*errorFunctionCumulativeTo)(const double* x, double* result, size_t count);
+        void (*cumulativeTo)(const double* x, double* result, size_t count);
+        void (*at)(const double* x, double* result, size_t count);
+        void (*exceedsMargin)(const double* t, const double* e, double* v, double* w, size_t count);
+        void (*withinMargin)(const double* t, const double* e, double* v, double* w, size_t count);
+        void (*winChanceRow)(double rowMean, double rowVariance, const double* mean, const double* variance, double* result, size_t count);
+        void (*matchQualityRow)(double rowMean, double rowVariance, const double* mean, const double* variance, double twoBetaSquared,
+                                double* result, size_t count);
+        void (*inflateStandardDeviations)(const double* sd, const uint64_t* lastPlayed, uint64_t now, double growth, double maximum,
+                                          double* result, size_t count);
+    };
+
+    // Same series as GaussianDistribution::ErrorFunctionCumulativeTo
+    const int ERF_COEFFICIENT_COUNT = 28;
+    const double erfCoefficients[ERF_COEFFICIENT_COUNT] = {
+        -1.3026537197817094, 6.4196979235649026e-1,
+        1.9476473204185836e-2, -9.561514786808631e-3, -9.46595344482036e-4,
+        3.66839497852761e-4, 4.2523324806907e-5, -2.0278578112534e-5,
+        -1.624290004647e-6, 1.303655835580e-6, 1.5626441722e-8, -8.5238095915e-8,
+        6.529054439e-9, 5.059343495e-9, -9.91364156e-10, -2.27365122e-10,
+        9.6467911e-11, 2.394038e-12, -6.886027e-12, 8.94487e-13, 3.13092e-13,
+        -1.12708e-13, 3.81e-16, 7.106e-15, -1.523e-15, -9.4e-17, 1.21e-16, -2.8e-17
+    };
+
+    // Below this the truncated Gaussian corrections switch to their asymptotic values
+    const double TINY_DENOMINATOR = 2.222758749e-162;
+}
+
+namespace Scalar
+{
+    // Plain loops over the scalar functions, used when no vector unit is available
+    static void Exp(const double* x, double* result, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) result[i] = exp(x[i]);
+    }
+
+    static void ErrorFunctionCumulativeTo(const double* x, double* result, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) result[i] = GaussianDistribution::ErrorFunctionCumulativeTo(x[i]);
+    }
+
+    static void CumulativeTo(const double* x, double* result, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) result[i] = GaussianDistribution::CumulativeTo(x[i]);
+    }
+
+    static void At(const double* x, double* result, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) result[i] = GaussianDistribution::At(x[i]);
+    }
+
+    static void ExceedsMargin(const double* t, const double* e, double* v, double* w, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (v) v[i] = TruncatedGaussianCorrectionFunctions::VExceedsMargin(t[i], e[i]);
+            if (w) w[i] = TruncatedGaussianCorrectionFunctions::WExceedsMargin(t[i], e[i]);
+        }
+    }
+
+    static void WithinMargin(const double* t, const double* e, double* v, double* w, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (v) v[i] = TruncatedGaussianCorrectionFunctions::VWithinMargin(t[i], e[i]);
+            if (w) w[i] = TruncatedGaussianCorrectionFunctions::WWithinMargin(t[i], e[i]);
+        }
+    }
+
+    static void WinChanceRow(double rowMean, double rowVariance, const double* mean, const double* variance, double* result, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            result[i] = GaussianDistribution::CumulativeTo((rowMean - mean[i]) / sqrt(rowVariance + variance[i]));
+        }
+    }
+
+    static void MatchQualityRow(double rowMean, double rowVariance, const double* mean, const double* variance, double twoBetaSquared,
+                                double* result, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            double sum = twoBetaSquared + rowVariance + variance[i];
+            double meanDelta = rowMean - mean[i];
+            result[i] = sqrt(twoBetaSquared / sum) * exp(-(meanDelta * meanDelta) / (2 * sum));
+        }
+    }
+
+    static void InflateStandardDeviations(const double* sd, const uint64_t* lastPlayed, uint64_t now, double growth, double maximum,
+                                          double* result, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) result[i] = TimeDynamics::InflatedStandardDeviation(sd[i], lastPlayed[i], now, growth, maximum);
+    }
+
+    static const KernelTable kernels =
+    {
+        Exp,
+        ErrorFunctionCumulativeTo,
+        CumulativeTo,
+        At,
+        ExceedsMargin,
+        WithinMargin,
+        WinChanceRow,
+        MatchQualityRow,
+        InflateStandardDeviations,
+    };
+}
+
+#if SIMD_KERNELS_X86
+
+namespace Sse2
+{
+#define SIMD_TARGET __attribute__((target("sse2")))
+    typedef __m128d Vec;
+    typedef __m128d Mask;
+    const size_t WIDTH = 2;
+
+    static inline SIMD_TARGET Vec Load(const double* p) { return _mm_loadu_pd(p); }
+    static inline SIMD_TARGET void Store(double* p, Vec a) { _mm_storeu_pd(p, a); }
+    static inline SIMD_TARGET Vec Set(double a) { return _mm_set1_pd(a); }
+    static inline SIMD_TARGET Vec Add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+    static inline SIMD_TARGET Vec Sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+    static inline SIMD_TARGET Vec Mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+    static inline SIMD_TARGET Vec Div(Vec a, Vec b) { return _mm_div_pd(a, b); }
+    static inline SIMD_TARGET Vec MulAdd(Vec a, Vec b, Vec c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static inline SIMD_TARGET Vec Min(Vec a, Vec b) { return _mm_min_pd(a, b); }
+    static inline SIMD_TARGET Vec Max(Vec a, Vec b) { return _mm_max_pd(a, b); }
+    static inline SIMD_TARGET Vec Sqrt(Vec a) { return _mm_sqrt_pd(a); }
+    static inline SIMD_TARGET Vec Abs(Vec a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    static inline SIMD_TARGET Mask Less(Vec a, Vec b) { return _mm_cmplt_pd(a, b); }
+    static inline SIMD_TARGET Vec Select(Mask m, Vec a, Vec b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+    static inline SIMD_TARGET bool AnyTrue(Mask m) { return _mm_movemask_pd(m) != 0; }
+    static inline SIMD_TARGET Vec RoundToNearest(Vec a) { return _mm_cvtepi32_pd(_mm_cvtpd_epi32(a)); }
+    static inline SIMD_TARGET Vec ScaleByPowerOfTwo(Vec a, Vec n)
+    {
+        __m128i exponent = _mm_add_epi32(_mm_cvtpd_epi32(n), _mm_set1_epi32(1023));
+        exponent = _mm_slli_epi64(_mm_unpacklo_epi32(exponent, _mm_setzero_si128()), 52);
+        return _mm_mul_pd(a, _mm_castsi128_pd(exponent));
+    }
+
+#include "SimdKernelsImpl.inl"
+#undef SIMD_TARGET
+}
+
+namespace Avx2
+{
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+    typedef __m256d Vec;
+    typedef __m256d Mask;
+    const size_t WIDTH = 4;
+
+    static inline SIMD_TARGET Vec Load(const double* p) { return _mm256_loadu_pd(p); }
+    static inline SIMD_TARGET void Store(double* p, Vec a) { _mm256_storeu_pd(p, a); }
+    static inline SIMD_TARGET Vec Set(double a) { return _mm256_set1_pd(a); }
+    static inline SIMD_TARGET Vec Add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+    static inline SIMD_TARGET Vec Sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+    static inline SIMD_TARGET Vec Mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+    static inline SIMD_TARGET Vec Div(Vec a, Vec b) { return _mm256_div_pd(a, b); }
+    static inline SIMD_TARGET Vec MulAdd(Vec a, Vec b, Vec c) { return _mm256_fmadd_pd(a, b, c); }
+    static inline SIMD_TARGET Vec Min(Vec a, Vec b) { return _mm256_min_pd(a, b); }
+    static inline SIMD_TARGET Vec Max(Vec a, Vec b) { return _mm256_max_pd(a, b); }
+    static inline SIMD_TARGET Vec Sqrt(Vec a) { return _mm256_sqrt_pd(a); }
+    static inline SIMD_TARGET Vec Abs(Vec a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static inline SIMD_TARGET Mask Less(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static inline SIMD_TARGET Vec Select(Mask m, Vec a, Vec b) { return _mm256_blendv_pd(b, a, m); }
+    static inline SIMD_TARGET bool AnyTrue(Mask m) { return _mm256_movemask_pd(m) != 0; }
+    static inline SIMD_TARGET Vec RoundToNearest(Vec a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static inline SIMD_TARGET Vec ScaleByPowerOfTwo(Vec a, Vec n)
+    {
+        __m128i exponent = _mm_add_epi32(_mm256_cvtpd_epi32(n), _mm_set1_epi32(1023));
+        return _mm256_mul_pd(a, _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_cvtepi32_epi64(exponent), 52)));
+    }
+
+#include "SimdKernelsImpl.inl"
+#undef SIMD_TARGET
+}
+
+namespace Avx512
+{
+#define SIMD_TARGET __attribute__((target("avx512f")))
+    typedef __m512d Vec;
+    typedef __mmask8 Mask;
+    const size_t WIDTH = 8;
+
+    static inline SIMD_TARGET Vec Load(const double* p) { return _mm512_loadu_pd(p); }
+    static inline SIMD_TARGET void Store(double* p, Vec a) { _mm512_storeu_pd(p, a); }
+    static inline SIMD_TARGET Vec Set(double a) { return _mm512_set1_pd(a); }
+    static inline SIMD_TARGET Vec Add(Vec a, Vec b) { return _mm512_add_pd(a, b); }
+    static inline SIMD_TARGET Vec Sub(Vec a, Vec b) { return _mm512_sub_pd(a, b); }
+    static inline SIMD_TARGET Vec Mul(Vec a, Vec b) { return _mm512_mul_pd(a, b); }
+    static inline SIMD_TARGET Vec Div(Vec a, Vec b) { return _mm512_div_pd(a, b); }
+    static inline SIMD_TARGET Vec MulAdd(Vec a, Vec b, Vec c) { return _mm512_fmadd_pd(a, b, c); }
+    static inline SIMD_TARGET Vec Min(Vec a, Vec b) { return _mm512_min_pd(a, b); }
+    static inline SIMD_TARGET Vec Max(Vec a, Vec b) { return _mm512_max_pd(a, b); }
+    static inline SIMD_TARGET Vec Sqrt(Vec a) { return _mm512_sqrt_pd(a); }
+    static inline SIMD_TARGET Vec Abs(Vec a) { return _mm512_abs_pd(a); }
+    static inline SIMD_TARGET Mask Less(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static inline SIMD_TARGET Vec Select(Mask m, Vec a, Vec b) { return _mm512_mask_blend_pd(m, b, a); }
+    static inline SIMD_TARGET bool AnyTrue(Mask m) { return m != 0; }
+    static inline SIMD_TARGET Vec RoundToNearest(Vec a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static inline SIMD_TARGET Vec ScaleByPowerOfTwo(Vec a, Vec n) { return _mm512_scalef_pd(a, n); }
+
+#include "SimdKernelsImpl.inl"
+#undef SIMD_TARGET
+}
+
+#endif
+
+static const KernelTable* TableFor(SimdKernels::InstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+#if SIMD_KERNELS_X86
+        case SimdKernels::INSTRUCTION_SET_AVX512:
+            return &Avx512::kernels;
+        case SimdKernels::INSTRUCTION_SET_AVX2:
+            return &Avx2::kernels;
+        case SimdKernels::INSTRUCTION_SET_SSE2:
+            return &Sse2::kernels;
+#endif
+        default:
+            return &Scalar::kernels;
+    }
+}
+
+static std::atomic<int>& ActiveInstructionSetStorage()
+{
+    static std::atomic<int> activeInstructionSet(SimdKernels::SupportedInstructionSet());
+    return activeInstructionSet;
+}
+
+static inline const KernelTable* ActiveTable()
+{
+    return TableFor((SimdKernels::InstructionSet) ActiveInstructionSetStorage().load(std::memory_order_relaxed));
+}
+
+SimdKernels::InstructionSet SimdKernels::SupportedInstructionSet()
+{
+#if SIMD_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return INSTRUCTION_SET_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return INSTRUCTION_SET_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return INSTRUCTION_SET_SSE2;
+    }
+#endif
+    return INSTRUCTION_SET_SCALAR;
+}
+
+SimdKernels::InstructionSet SimdKernels::ActiveInstructionSet()
+{
+    return (InstructionSet) ActiveInstructionSetStorage().load(std::memory_order_relaxed);
+}
+
+void SimdKernels::SetInstructionSet(InstructionSet instructionSet)
+{
+    InstructionSet supported = SupportedInstructionSet();
+    ActiveInstructionSetStorage().store(instructionSet > supported ? supported : instructionSet, std::memory_order_relaxed);
+}
+
+const char* SimdKernels::InstructionSetName(InstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+        case INSTRUCTION_SET_AVX512:
+            return "avx512";
+        case INSTRUCTION_SET_AVX2:
+            return "avx2";
+        case INSTRUCTION_SET_SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+void SimdKernels::Exp(const double* x, double* result, size_t count)
+{
+    ActiveTable()->exp(x, result, count);
+}
+
+void SimdKernels::ErrorFunctionCumulativeTo(const double* x, double* result, size_t count)
+{
+    ActiveTable()->errorFunctionCumulativeTo(x, result, count);
+}
+
+void SimdKernels::CumulativeTo(const double* x, double* result, size_t count)
+{
+    ActiveTable()->cumulativeTo(x, result, count);
+}
+
+void SimdKernels::At(const double* x, double* result, size_t count)
+{
+    ActiveTable()->at(x, result, count);
+}
+
+void SimdKernels::VExceedsMargin(const double* teamPerformanceDifference, const double* drawMargin, double* result, size_t count)
+{
+    ActiveTable()->exceedsMargin(teamPerformanceDifference, drawMargin, result, NULL, count);
+}
+
+void SimdKernels::WExceedsMargin(const double* teamPerformanceDifference, const double* drawMargin, double* result, size_t count)
+{
+    ActiveTable()->exceedsMargin(teamPerformanceDifference, drawMargin, NULL, result, count);
+}
+
+void SimdKernels::VWithinMargin(const double* teamPerformanceDifference, const double* drawMargin, double* result, size_t count)
+{
+    ActiveTable()->withinMargin(teamPerformanceDifference, drawMargin, result, NULL, count);
+}
+
+void SimdKernels::WWithinMargin(const double* teamPerformanceDifference, const double* drawMargin, double* result, size_t count)
+{
+    ActiveTable()->withinMargin(teamPerformanceDifference, drawMargin, NULL, result, count);
+}
+
+void SimdKernels::ExceedsMargin(const double* teamPerformanceDifference, const double* drawMargin, double* v, double* w, size_t count)
+{
+    ActiveTable()->exceedsMargin(teamPerformanceDifference, drawMargin, v, w, count);
+}
+
+void SimdKernels::WithinMargin(const double* teamPerformanceDifference, const double* drawMargin, double* v, double* w, size_t count)
+{
+    ActiveTable()->withinMargin(teamPerformanceDifference, drawMargin, v, w, count);
+}
+
+void SimdKernels::WinChanceRow(double rowMean, double rowVariance, const double* mean, const double* variance, double* result, size_t count)
+{
+    ActiveTable()->winChanceRow(rowMean, rowVariance, mean, variance, result, count);
+}
+
+void SimdKernels::MatchQualityRow(double rowMean, double rowVariance, const double* mean, const double* variance, double twoBetaSquared,
+                                  double* result, size_t count)
+{
+    ActiveTable()->matchQualityRow(rowMean, rowVariance, mean, variance, twoBetaSquared, result, count);
+}
+
+void SimdKernels::InflateStandardDeviations(const double* standardDeviation, const uint64_t* lastPlayed, uint64_t now,
+                                            double varianceGrowth, double maximumStandardDeviation, double* result, size_t count)
+{
+    ActiveTable()->inflateStandardDeviations(standardDeviation, lastPlayed, now, varianceGrowth, maximumStandardDeviation, result, count);
+}
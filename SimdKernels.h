@@ -0,0 +1,68 @@
+//
+//  SimdKernels.h
+//  Skills
+//
+//  Created by KleMiX on 02/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Vectorized versions of the GaussianDistribution and TruncatedGaussianCorrectionFunctions hot paths.
+// Every function evaluates count independent arguments, the best instruction set supported by the cpu
+// is picked at runtime (SSE2 = 2, AVX2 = 4, AVX-512 = 8 values per instruction).
+//
+// Results are not bit-identical to the scalar functions: exp is evaluated with a Cephes style
+// polynomial and AVX2/AVX-512 use fused multiply-add. Exp and At stay within 1 ulp, the cumulative
+// functions within 1e-13 relative (deep tails) and the V/W corrections within 1e-9 absolute.
+// Every element goes through the same vector code regardless of its position in the array,
+// so results never depend on count or alignment.
+//
+// ParallelReplay with REPLAY_KERNEL_VECTORIZED runs the rating updates of a wave through ExceedsMargin and
+// WithinMargin.
+namespace SimdKernels
+{
+    enum InstructionSet
+    {
+        INSTRUCTION_SET_SCALAR = 0,
+        INSTRUCTION_SET_SSE2 = 1,
+        INSTRUCTION_SET_AVX2 = 2,
+        INSTRUCTION_SET_AVX512 = 3,
+    };
+
+    InstructionSet  SupportedInstructionSet();
+    InstructionSet  ActiveInstructionSet();
+    // Mostly useful for benchmarks and comparisons, requests above the supported set are clamped
+    void            SetInstructionSet(InstructionSet instructionSet);
+    const char*     InstructionSetName(InstructionSet instructionSet);
+
+    void    Exp(const double* x, double* result, size_t count);
+    void    ErrorFunctionCumulativeTo(const double* x, double* result, size_t count);
+    // standard normal distribution
+    void    CumulativeTo(const double* x, double* result, size_t count);
+    void    At(const double* x, double* result, size_t count);
+
+    // Arguments are already divided by c, same as the two argument scalar versions
+    void    VExceedsMargin(const double* teamPerformanceDifference, const double* drawMargin, double* result, size_t count);
+    void    WExceedsMargin(const double* teamPerformanceDifference, const double* drawMargin, double* result, size_t count);
+    void    VWithinMargin(const double* teamPerformanceDifference, const double* drawMargin, double* result, size_t count);
+    void    WWithinMargin(const double* teamPerformanceDifference, const double* drawMargin, double* result, size_t count);
+
+    // V and W share the same cumulative and density evaluations, so computing both at once is almost free
+    void    ExceedsMargin(const double* teamPerformanceDifference, const double* drawMargin, double* v, double* w, size_t count);
+    void    WithinMargin(const double* teamPerformanceDifference, const double* drawMargin, double* v, double* w, size_t count);
+
+    // One row of RatingMatrix, the player (rowMean, rowVariance) against count players given by mean and
+    // variance. Same formulas as RatingCalculator::CalculateWinChance and CalculateMatchQuality.
+    void    WinChanceRow(double rowMean, double rowVariance, const double* mean, const double* variance, double* result, size_t count);
+    void    MatchQualityRow(double rowMean, double rowVariance, const double* mean, const double* variance, double twoBetaSquared,
+                            double* result, size_t count);
+
+    // TimeDynamics::InflatedStandardDeviation for count players, result may be standardDeviation itself.
+    // Only rounding differs from the scalar version where fused multiply-add is used.
+    void    InflateStandardDeviations(const double* standardDeviation, const uint64_t* lastPlayed, uint64_t now,
+                                      double varianceGrowth, double maximumStandardDeviation, double* result, size_t count);
+}
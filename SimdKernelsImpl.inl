@@ -0,0 +1,300 @@
+//
+//  SimdKernelsImpl.inl
+//  Skills
+//
+//  Created by KleMiX on 02/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+// Kernel bodies shared by every instruction set. Included by SimdKernels.cpp inside a namespace that
+// provides SIMD_TARGET, Vec, Mask, WIDTH and the basic operations (Load, Store, Set, Add, Sub, Mul, Div,
+// MulAdd, Min, Max, Sqrt, Abs, Less, Select, AnyTrue, RoundToNearest, ScaleByPowerOfTwo).
+// Every kernel mirrors its scalar counterpart line by line, including the fallback branches.
+
+static inline SIMD_TARGET Vec ExpKernel(Vec x)
+{
+    // Cephes exp: x = n*ln(2) + r, exp(r) from a Pade approximation, then scaled by 2^n
+    Mask underflow = Less(x, Set(-745.13321910194110842));
+    Mask overflow = Less(Set(709.78271289338399678), x);
+    x = Min(Max(x, Set(-745.13321910194110842)), Set(709.78271289338399678));
+
+    Vec n = RoundToNearest(Mul(x, Set(1.4426950408889634073599)));
+    x = Sub(x, Mul(n, Set(6.93145751953125e-1)));
+    x = Sub(x, Mul(n, Set(1.42860682030941723212e-6)));
+
+    Vec xx = Mul(x, x);
+    Vec px = Mul(x, MulAdd(MulAdd(Set(1.26177193074810590878e-4), xx, Set(3.02994407707441961300e-2)), xx, Set(9.99999999999999999910e-1)));
+    Vec qx = MulAdd(MulAdd(MulAdd(Set(3.00198505138664455042e-6), xx, Set(2.52448340349684104192e-3)), xx, Set(2.27265548208155028766e-1)), xx, Set(2.0));
+    x = Div(px, Sub(qx, px));
+    x = MulAdd(Set(2.0), x, Set(1.0));
+
+    // scale in two steps so 2^n never leaves the normal range, subnormal results come out right
+    Vec half = RoundToNearest(Mul(n, Set(0.5)));
+    x = ScaleByPowerOfTwo(ScaleByPowerOfTwo(x, half), Sub(n, half));
+
+    return Select(underflow, Set(0.0), Select(overflow, Set(HUGE_VAL), x));
+}
+
+static inline SIMD_TARGET Vec ErrorFunctionCumulativeToKernel(Vec x)
+{
+    // Derived from page 265 of Numerical Recipes 3rd Edition
+    Vec z = Abs(x);
+
+    Vec t = Div(Set(2.0), Add(Set(2.0), z));
+    Vec ty = Sub(Mul(Set(4.0), t), Set(2.0));
+
+    Vec d = Set(0.0);
+    Vec dd = Set(0.0);
+
+    for (int j = ERF_COEFFICIENT_COUNT - 1; j > 0; j--)
+    {
+        Vec tmp = d;
+        d = MulAdd(ty, d, Sub(Set(erfCoefficients[j]), dd));
+        dd = tmp;
+    }
+
+    Vec exponent = Sub(MulAdd(Set(0.5), MulAdd(ty, d, Set(erfCoefficients[0])), Mul(Sub(Set(0.0), z), z)), dd);
+    Vec ans = Mul(t, ExpKernel(exponent));
+    return Select(Less(x, Set(0.0)), Sub(Set(2.0), ans), ans);
+}
+
+static inline SIMD_TARGET Vec CumulativeToKernel(Vec x)
+{
+    return Mul(Set(0.5), ErrorFunctionCumulativeToKernel(Mul(Set(-0.707106781186547524400844362104), x)));
+}
+
+static inline SIMD_TARGET Vec AtKernel(Vec x)
+{
+    // 1/sqrt(2*pi) * e^(-x^2/2)
+    return Mul(Set(0.398942280401432677939946059934), ExpKernel(Div(Mul(Sub(Set(0.0), x), x), Set(2.0))));
+}
+
+static inline SIMD_TARGET void ExceedsMarginKernel(Vec teamPerformanceDifference, Vec drawMargin, Vec& v, Vec& w)
+{
+    Vec x = Sub(teamPerformanceDifference, drawMargin);
+    Vec denominator = CumulativeToKernel(x);
+    Mask tiny = Less(denominator, Set(TINY_DENOMINATOR));
+
+    Vec vWin = Div(AtKernel(x), denominator);
+    Vec wWin = Mul(vWin, Sub(Add(vWin, teamPerformanceDifference), drawMargin));
+
+    v = vWin;
+    w = wWin;
+    if (AnyTrue(tiny))
+    {
+        v = Select(tiny, Add(Sub(Set(0.0), teamPerformanceDifference), drawMargin), vWin);
+        w = Select(tiny, Select(Less(teamPerformanceDifference, Set(0.0)), Set(1.0), Set(0.0)), wWin);
+    }
+}
+
+static inline SIMD_TARGET void WithinMarginKernel(Vec teamPerformanceDifference, Vec drawMargin, Vec& v, Vec& w)
+{
+    Vec absoluteValue = Abs(teamPerformanceDifference);
+    Vec upper = Sub(drawMargin, absoluteValue);
+    Vec lower = Sub(Sub(Set(0.0), drawMargin), absoluteValue);
+
+    Vec denominator = Sub(CumulativeToKernel(upper), CumulativeToKernel(lower));
+    Mask tiny = Less(denominator, Set(TINY_DENOMINATOR));
+    Mask negative = Less(teamPerformanceDifference, Set(0.0));
+
+    Vec atUpper = AtKernel(upper);
+    Vec atLower = AtKernel(lower);
+
+    Vec vt = Div(Sub(atLower, atUpper), denominator);
+    Vec vDraw = Select(negative, Sub(Set(0.0), vt), vt);
+    Vec wDraw = Add(Mul(vt, vt), Div(Sub(Mul(upper, atUpper), Mul(lower, atLower)), denominator));
+
+    v = vDraw;
+    w = wDraw;
+    if (AnyTrue(tiny))
+    {
+        Vec vFallback = Select(negative,
+                               Sub(Sub(Set(0.0), teamPerformanceDifference), drawMargin),
+                               Add(Sub(Set(0.0), teamPerformanceDifference), drawMargin));
+        v = Select(tiny, vFallback, vDraw);
+        w = Select(tiny, Set(1.0), wDraw);
+    }
+}
+
+// Array drivers, the tail is padded so the last elements go through exactly the same code
+
+struct ExpOp { static inline SIMD_TARGET Vec Apply(Vec x) { return ExpKernel(x); } };
+struct ErrorFunctionCumulativeToOp { static inline SIMD_TARGET Vec Apply(Vec x) { return ErrorFunctionCumulativeToKernel(x); } };
+struct CumulativeToOp { static inline SIMD_TARGET Vec Apply(Vec x) { return CumulativeToKernel(x); } };
+struct AtOp { static inline SIMD_TARGET Vec Apply(Vec x) { return AtKernel(x); } };
+
+struct ExceedsMarginOp { static inline SIMD_TARGET void Apply(Vec t, Vec e, Vec& v, Vec& w) { ExceedsMarginKernel(t, e, v, w); } };
+struct WithinMarginOp { static inline SIMD_TARGET void Apply(Vec t, Vec e, Vec& v, Vec& w) { WithinMarginKernel(t, e, v, w); } };
+
+template <class Op>
+static SIMD_TARGET void MapUnary(const double* x, double* result, size_t count)
+{
+    size_t i = 0;
+    for (; i + WIDTH <= count; i += WIDTH)
+    {
+        Store(result + i, Op::Apply(Load(x + i)));
+    }
+
+    if (i < count)
+    {
+        double in[WIDTH] = { 0 };
+        double out[WIDTH];
+        for (size_t j = 0; j < count - i; j++) in[j] = x[i + j];
+        Store(out, Op::Apply(Load(in)));
+        for (size_t j = 0; j < count - i; j++) result[i + j] = out[j];
+    }
+}
+
+// v or w may be null when only one of them is needed
+template <class Op>
+static SIMD_TARGET void MapCorrection(const double* teamPerformanceDifference, const double* drawMargin, double* v, double* w, size_t count)
+{
+    Vec vv;
+    Vec ww;
+
+    size_t i = 0;
+    for (; i + WIDTH <= count; i += WIDTH)
+    {
+        Op::Apply(Load(teamPerformanceDifference + i), Load(drawMargin + i), vv, ww);
+        if (v) Store(v + i, vv);
+        if (w) Store(w + i, ww);
+    }
+
+    if (i < count)
+    {
+        double inT[WIDTH] = { 0 };
+        double inE[WIDTH] = { 0 };
+        double outV[WIDTH];
+        double outW[WIDTH];
+        for (size_t j = 0; j < count - i; j++)
+        {
+            inT[j] = teamPerformanceDifference[i + j];
+            inE[j] = drawMargin[i + j];
+        }
+        Op::Apply(Load(inT), Load(inE), vv, ww);
+        Store(outV, vv);
+        Store(outW, ww);
+        for (size_t j = 0; j < count - i; j++)
+        {
+            if (v) v[i + j] = outV[j];
+            if (w) w[i + j] = outW[j];
+        }
+    }
+}
+
+static void Exp(const double* x, double* result, size_t count) { MapUnary<ExpOp>(x, result, count); }
+static void ErrorFunctionCumulativeTo(const double* x, double* result, size_t count) { MapUnary<ErrorFunctionCumulativeToOp>(x, result, count); }
+static void CumulativeTo(const double* x, double* result, size_t count) { MapUnary<CumulativeToOp>(x, result, count); }
+static void At(const double* x, double* result, size_t count) { MapUnary<AtOp>(x, result, count); }
+
+static void ExceedsMargin(const double* t, const double* e, double* v, double* w, size_t count) { MapCorrection<ExceedsMarginOp>(t, e, v, w, count); }
+static void WithinMargin(const double* t, const double* e, double* v, double* w, size_t count) { MapCorrection<WithinMarginOp>(t, e, v, w, count); }
+
+static inline SIMD_TARGET Vec WinChanceKernel(Vec rowMean, Vec rowVariance, Vec mean, Vec variance)
+{
+    return CumulativeToKernel(Div(Sub(rowMean, mean), Sqrt(Add(rowVariance, variance))));
+}
+
+static inline SIMD_TARGET Vec MatchQualityKernel(Vec rowMean, Vec rowVariance, Vec mean, Vec variance, Vec twoBetaSquared)
+{
+    Vec sum = Add(Add(twoBetaSquared, rowVariance), variance);
+    Vec meanDelta = Sub(rowMean, mean);
+    Vec exponent = Div(Sub(Set(0.0), Mul(meanDelta, meanDelta)), Mul(Set(2.0), sum));
+    return Mul(Sqrt(Div(twoBetaSquared, sum)), ExpKernel(exponent));
+}
+
+// the win chance doesn't depend on beta, MapRow passes it to both
+struct WinChanceOp { static inline SIMD_TARGET Vec Apply(Vec m0, Vec v0, Vec m, Vec v, Vec) { return WinChanceKernel(m0, v0, m, v); } };
+struct MatchQualityOp { static inline SIMD_TARGET Vec Apply(Vec m0, Vec v0, Vec m, Vec v, Vec b) { return MatchQualityKernel(m0, v0, m, v, b); } };
+
+// The tail is padded with unit variances so no lane divides by zero
+template <class Op>
+static SIMD_TARGET void MapRow(double rowMean, double rowVariance, const double* mean, const double* variance, double twoBetaSquared,
+                               double* result, size_t count)
+{
+    Vec rowMeanVec = Set(rowMean);
+    Vec rowVarianceVec = Set(rowVariance);
+    Vec twoBetaSquaredVec = Set(twoBetaSquared);
+
+    size_t i = 0;
+    for (; i + WIDTH <= count; i += WIDTH)
+    {
+        Store(result + i, Op::Apply(rowMeanVec, rowVarianceVec, Load(mean + i), Load(variance + i), twoBetaSquaredVec));
+    }
+
+    if (i < count)
+    {
+        double inMean[WIDTH] = { 0 };
+        double inVariance[WIDTH];
+        double out[WIDTH];
+        for (size_t j = 0; j < WIDTH; j++)
+        {
+            inMean[j] = i + j < count ? mean[i + j] : 0.0;
+            inVariance[j] = i + j < count ? variance[i + j] : 1.0;
+        }
+        Store(out, Op::Apply(rowMeanVec, rowVarianceVec, Load(inMean), Load(inVariance), twoBetaSquaredVec));
+        for (size_t j = 0; j < count - i; j++) result[i + j] = out[j];
+    }
+}
+
+static void WinChanceRow(double rowMean, double rowVariance, const double* mean, const double* variance, double* result, size_t count)
+{
+    MapRow<WinChanceOp>(rowMean, rowVariance, mean, variance, 0.0, result, count);
+}
+
+static void MatchQualityRow(double rowMean, double rowVariance, const double* mean, const double* variance, double twoBetaSquared,
+                            double* result, size_t count)
+{
+    MapRow<MatchQualityOp>(rowMean, rowVariance, mean, variance, twoBetaSquared, result, count);
+}
+
+static inline SIMD_TARGET Vec InflateKernel(Vec standardDeviation, Vec elapsed, Vec growth, Vec maximum)
+{
+    Vec inflated = Sqrt(Add(Mul(standardDeviation, standardDeviation), Mul(growth, elapsed)));
+    return Select(Less(standardDeviation, maximum), Min(inflated, maximum), standardDeviation);
+}
+
+// Elapsed times are converted one by one, there is no unsigned 64 bit conversion below AVX-512DQ
+static SIMD_TARGET void InflateStandardDeviations(const double* sd, const uint64_t* lastPlayed, uint64_t now, double growth, double maximum,
+                                                  double* result, size_t count)
+{
+    Vec growthVec = Set(growth);
+    Vec maximumVec = Set(maximum);
+    double elapsed[WIDTH];
+
+    size_t i = 0;
+    for (; i + WIDTH <= count; i += WIDTH)
+    {
+        for (size_t j = 0; j < WIDTH; j++)
+        {
+            elapsed[j] = now > lastPlayed[i + j] ? (double) (now - lastPlayed[i + j]) : 0.0;
+        }
+        Store(result + i, InflateKernel(Load(sd + i), Load(elapsed), growthVec, maximumVec));
+    }
+
+    if (i < count)
+    {
+        double in[WIDTH] = { 0 };
+        double out[WIDTH];
+        for (size_t j = 0; j < WIDTH; j++)
+        {
+            in[j] = i + j < count ? sd[i + j] : 0.0;
+            elapsed[j] = i + j < count && now > lastPlayed[i + j] ? (double) (now - lastPlayed[i + j]) : 0.0;
+        }
+        Store(out, InflateKernel(Load(in), Load(elapsed), growthVec, maximumVec));
+        for (size_t j = 0; j < count - i; j++) result[i + j] = out[j];
+    }
+}
+
+static const KernelTable kernels =
+{
+    Exp,
+    ErrorFunctionCumulativeTo,
+    CumulativeTo,
+    At,
+    ExceedsMargin,
+    WithinMargin,
+    WinChanceRow,
+    MatchQualityRow,
+    InflateStandardDeviations,
+};
@@ -0,0 +1,558 @@
+//
+//  TeamRatingCalculator.cpp
+//  Skills
+//
+//  Created by KleMiX on 23/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "TeamRatingCalculator.h"
+#include "Instrumentation.h"
+#include "MessageArena.h"
+#include "NaturalGaussian.h"
+#include "TruncatedGaussianCorrectionFunctions.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+// Implementation follows the factor graph of the TrueSkill paper (Herbrich, Minka, Graepel 2006):
+//
+//   skill --likelihood--> performance --team sum--> team performance --difference--> difference --truncate
+//
+// Every variable keeps its current marginal and the last message every neighbouring factor sent to it,
+// factors are run in the order given by the schedule.
+
+namespace
+{
+    const int MAXIMUM_ITERATIONS = 10;
+    const double MINIMUM_DELTA = 0.0001;
+    const size_t MAXIMUM_CACHED_SCHEDULES = 64;
+
+    // The team sum is solved for every player by dividing by their weight, like the reference TrueSkill
+    // nobody plays less than this
+    const double MINIMUM_PARTIAL_PLAY = 0.0001;
+
+    enum StepType
+    {
+        STEP_PRIOR,
+        STEP_LIKELIHOOD_DOWN,
+        STEP_TEAM_SUM_DOWN,
+        STEP_DIFFERENCE_DOWN,
+        STEP_TRUNCATE_UP,
+        STEP_DIFFERENCE_UP,
+        STEP_TEAM_SUM_UP,
+        STEP_LIKELIHOOD_UP,
+    };
+
+    struct Step
+    {
+        StepType type;
+        int index;      // player, team or difference
+        int argument;   // player inside the team for STEP_TEAM_SUM_UP, side for STEP_DIFFERENCE_UP
+    };
+
+    // Everything that only depends on the shape of the match, teams are in rank order
+    struct Schedule
+    {
+        std::vector<int> teamSizes;
+        double beta;
+        double drawProbability;
+
+        int playerCount;
+        int maximumTeamSize;
+        std::vector<int> teamOffsets;
+        std::vector<double> drawMargins;
+
+        std::vector<Step> down;     // priors to team performances
+        std::vector<Step> loop;     // team differences, repeated until the truncations settle
+        std::vector<Step> up;       // back to the skills
+    };
+
+    // Marginals and messages, named after the factor the message comes from
+    struct Graph
+    {
+        const Schedule* schedule;
+        const GameModel* model;
+
+        const double* weights;
+        const bool* draws;
+
+        NaturalGaussian* skill;
+        NaturalGaussian* skillFromPrior;
+        NaturalGaussian* skillFromLikelihood;
+
+        NaturalGaussian* performance;
+        NaturalGaussian* performanceFromLikelihood;
+        NaturalGaussian* performanceFromTeam;
+
+        NaturalGaussian* teamPerformance;
+        NaturalGaussian* teamPerformanceFromTeam;
+        NaturalGaussian* teamPerformanceFromNextDifference;
+        NaturalGaussian* teamPerformanceFromPreviousDifference;
+
+        NaturalGaussian* difference;
+        NaturalGaussian* differenceFromSum;
+        NaturalGaussian* differenceFromTruncate;
+
+        // scratch space for the sum factors
+        const NaturalGaussian** sumValues;
+        const NaturalGaussian** sumMessages;
+        double* sumCoefficients;
+
+        const Rating* priors;
+    };
+
+    void AddStep(std::vector<Step>& steps, StepType type, int index, int argument)
+    {
+        Step step;
+        step.type = type;
+        step.index = index;
+        step.argument = argument;
+        steps.push_back(step);
+    }
+
+    void BuildSchedule(Schedule& schedule, const GameModel& model, const int* sortedTeamSizes, int teamCount)
+    {
+        schedule.teamSizes.assign(sortedTeamSizes, sortedTeamSizes + teamCount);
+        schedule.beta = model.beta;
+        schedule.drawProbability = model.drawProbability;
+
+        schedule.playerCount = 0;
+        schedule.maximumTeamSize = 0;
+        schedule.teamOffsets.resize(teamCount);
+        for (int t = 0; t < teamCount; t++)
+        {
+            schedule.teamOffsets[t] = schedule.playerCount;
+            schedule.playerCount += sortedTeamSizes[t];
+            schedule.maximumTeamSize = std::max(schedule.maximumTeamSize, sortedTeamSizes[t]);
+        }
+
+        // same as GameModel::GetDrawMarginFromDrawProbability with n1 + n2 players
+        double inverseCumulative = GaussianDistribution::InverseCumulativeTo(.5*(model.drawProbability + 1), 0, 1);
+        int differenceCount = teamCount - 1;
+        schedule.drawMargins.resize(differenceCount);
+        for (int d = 0; d < differenceCount; d++)
+        {
+            schedule.drawMargins[d] = inverseCumulative * sqrt(sortedTeamSizes[d] + sortedTeamSizes[d + 1]) * model.beta;
+        }
+
+        schedule.down.clear();
+        schedule.loop.clear();
+        schedule.up.clear();
+
+        for (int i = 0; i < schedule.playerCount; i++)
+        {
+            AddStep(schedule.down, STEP_PRIOR, i, 0);
+        }
+        for (int i = 0; i < schedule.playerCount; i++)
+        {
+            AddStep(schedule.down, STEP_LIKELIHOOD_DOWN, i, 0);
+        }
+        for (int t = 0; t < teamCount; t++)
+        {
+            AddStep(schedule.down, STEP_TEAM_SUM_DOWN, t, 0);
+        }
+
+        if (differenceCount == 1)
+        {
+            AddStep(schedule.loop, STEP_DIFFERENCE_DOWN, 0, 0);
+            AddStep(schedule.loop, STEP_TRUNCATE_UP, 0, 0);
+        }
+        else
+        {
+            // sweep to the last team and back, passing the information along the chain
+            for (int d = 0; d < differenceCount - 1; d++)
+            {
+                AddStep(schedule.loop, STEP_DIFFERENCE_DOWN, d, 0);
+                AddStep(schedule.loop, STEP_TRUNCATE_UP, d, 0);
+                AddStep(schedule.loop, STEP_DIFFERENCE_UP, d, 1);
+            }
+            for (int d = differenceCount - 1; d > 0; d--)
+            {
+                AddStep(schedule.loop, STEP_DIFFERENCE_DOWN, d, 0);
+                AddStep(schedule.loop, STEP_TRUNCATE_UP, d, 0);
+                AddStep(schedule.loop, STEP_DIFFERENCE_UP, d, 0);
+            }
+        }
+
+        AddStep(schedule.up, STEP_DIFFERENCE_UP, 0, 0);
+        AddStep(schedule.up, STEP_DIFFERENCE_UP, differenceCount - 1, 1);
+        for (int t = 0; t < teamCount; t++)
+        {
+            for (int x = 0; x < sortedTeamSizes[t]; x++)
+            {
+                AddStep(schedule.up, STEP_TEAM_SUM_UP, t, x);
+            }
+        }
+        for (int i = 0; i < schedule.playerCount; i++)
+        {
+            AddStep(schedule.up, STEP_LIKELIHOOD_UP, i, 0);
+        }
+    }
+
+    const Schedule& FindSchedule(const GameModel& model, const int* sortedTeamSizes, int teamCount)
+    {
+        static thread_local std::vector<Schedule> schedules;
+
+        for (size_t i = 0; i < schedules.size(); i++)
+        {
+            const Schedule& schedule = schedules[i];
+            if (schedule.beta == model.beta && schedule.drawProbability == model.drawProbability &&
+                (int) schedule.teamSizes.size() == teamCount &&
+                std::equal(schedule.teamSizes.begin(), schedule.teamSizes.end(), sortedTeamSizes))
+            {
+                return schedule;
+            }
+        }
+
+        if (schedules.size() >= MAXIMUM_CACHED_SCHEDULES)
+        {
+            schedules.clear();
+        }
+
+        schedules.push_back(Schedule());
+        BuildSchedule(schedules.back(), model, sortedTeamSizes, teamCount);
+        return schedules.back();
+    }
+
+    inline double MeanOf(const NaturalGaussian& gaussian)
+    {
+        // a uniform message has no mean, treat it as 0 like the reference implementation
+        return gaussian.precision == 0 ? 0 : gaussian.precisionMean / gaussian.precision;
+    }
+
+    inline double UpdateMessage(NaturalGaussian& variable, NaturalGaussian& message, const NaturalGaussian& newMessage)
+    {
+        NaturalGaussian oldMessage = message;
+        message = newMessage;
+
+        NaturalGaussian newValue = (variable / oldMessage) * newMessage;
+        double delta = variable - newValue;
+        variable = newValue;
+        return delta;
+    }
+
+    inline double UpdateValue(NaturalGaussian& variable, NaturalGaussian& message, const NaturalGaussian& newValue)
+    {
+        message = (newValue * message) / variable;
+
+        double delta = variable - newValue;
+        variable = newValue;
+        return delta;
+    }
+
+    double SumUpdate(NaturalGaussian& variable, NaturalGaussian& message, int termCount,
+                     const NaturalGaussian** values, const NaturalGaussian** messages, const double* coefficients)
+    {
+        double inversePrecision = 0;
+        double mean = 0;
+
+        for (int i = 0; i < termCount; i++)
+        {
+            NaturalGaussian divided = *values[i] / *messages[i];
+            mean += coefficients[i] * MeanOf(divided);
+            inversePrecision += (coefficients[i] * coefficients[i]) / divided.precision;
+        }
+
+        double precision = 1.0 / inversePrecision;
+        return UpdateMessage(variable, message, NaturalGaussian::FromPrecisionMean(precision * mean, precision));
+    }
+
+    NaturalGaussian LikelihoodMessage(const NaturalGaussian& from, const NaturalGaussian& fromMessage, double variance)
+    {
+        NaturalGaussian message = from / fromMessage;
+        double a = 1.0 / (1.0 + variance * message.precision);
+        return NaturalGaussian::FromPrecisionMean(a * message.precisionMean, a * message.precision);
+    }
+
+    double RunStep(Graph& graph, const Step& step)
+    {
+        const Schedule& schedule = *graph.schedule;
+        const GameModel& model = *graph.model;
+
+        switch (step.type)
+        {
+            case STEP_PRIOR:
+            {
+                const Rating& prior = graph.priors[step.index];
+                double standardDeviation = sqrt(prior.standardDeviation * prior.standardDeviation + model.dynamicsFactorSquared);
+                return UpdateValue(graph.skill[step.index], graph.skillFromPrior[step.index],
+                                   NaturalGaussian::FromMeanStandardDeviation(prior.mean, standardDeviation));
+            }
+
+            case STEP_LIKELIHOOD_DOWN:
+            {
+                NaturalGaussian message = LikelihoodMessage(graph.skill[step.index], graph.skillFromLikelihood[step.index], model.betaSquared);
+                return UpdateMessage(graph.performance[step.index], graph.performanceFromLikelihood[step.index], message);
+            }
+
+            case STEP_LIKELIHOOD_UP:
+            {
+                NaturalGaussian message = LikelihoodMessage(graph.performance[step.index], graph.performanceFromLikelihood[step.index], model.betaSquared);
+                return UpdateMessage(graph.skill[step.index], graph.skillFromLikelihood[step.index], message);
+            }
+
+            case STEP_TEAM_SUM_DOWN:
+            {
+                int offset = schedule.teamOffsets[step.index];
+                int size = schedule.teamSizes[step.index];
+                for (int x = 0; x < size; x++)
+                {
+                    graph.sumValues[x] = &graph.performance[offset + x];
+                    graph.sumMessages[x] = &graph.performanceFromTeam[offset + x];
+                    graph.sumCoefficients[x] = graph.weights[offset + x];
+                }
+                return SumUpdate(graph.teamPerformance[step.index], graph.teamPerformanceFromTeam[step.index], size,
+                                 graph.sumValues, graph.sumMessages, graph.sumCoefficients);
+            }
+
+            case STEP_TEAM_SUM_UP:
+            {
+                int offset = schedule.teamOffsets[step.index];
+                int size = schedule.teamSizes[step.index];
+                double coefficient = graph.weights[offset + step.argument];
+                for (int x = 0; x < size; x++)
+                {
+                    if (x == step.argument)
+                    {
+                        graph.sumValues[x] = &graph.teamPerformance[step.index];
+                        graph.sumMessages[x] = &graph.teamPerformanceFromTeam[step.index];
+                        graph.sumCoefficients[x] = 1.0 / coefficient;
+                    }
+                    else
+                    {
+                        graph.sumValues[x] = &graph.performance[offset + x];
+                        graph.sumMessages[x] = &graph.performanceFromTeam[offset + x];
+                        graph.sumCoefficients[x] = -graph.weights[offset + x] / coefficient;
+                    }
+                }
+                return SumUpdate(graph.performance[offset + step.argument], graph.performanceFromTeam[offset + step.argument], size,
+                                 graph.sumValues, graph.sumMessages, graph.sumCoefficients);
+            }
+
+            case STEP_DIFFERENCE_DOWN:
+            {
+                int d = step.index;
+                graph.sumValues[0] = &graph.teamPerformance[d];
+                graph.sumMessages[0] = &graph.teamPerformanceFromNextDifference[d];
+                graph.sumCoefficients[0] = 1;
+                graph.sumValues[1] = &graph.teamPerformance[d + 1];
+                graph.sumMessages[1] = &graph.teamPerformanceFromPreviousDifference[d + 1];
+                graph.sumCoefficients[1] = -1;
+                return SumUpdate(graph.difference[d], graph.differenceFromSum[d], 2,
+                                 graph.sumValues, graph.sumMessages, graph.sumCoefficients);
+            }
+
+            case STEP_DIFFERENCE_UP:
+            {
+                // difference = left - right, so left = difference + right and right = left - difference
+                int d = step.index;
+                if (step.argument == 0)
+                {
+                    graph.sumValues[0] = &graph.difference[d];
+                    graph.sumMessages[0] = &graph.differenceFromSum[d];
+                    graph.sumCoefficients[0] = 1;
+                    graph.sumValues[1] = &graph.teamPerformance[d + 1];
+                    graph.sumMessages[1] = &graph.teamPerformanceFromPreviousDifference[d + 1];
+                    graph.sumCoefficients[1] = 1;
+                    return SumUpdate(graph.teamPerformance[d], graph.teamPerformanceFromNextDifference[d], 2,
+                                     graph.sumValues, graph.sumMessages, graph.sumCoefficients);
+                }
+
+                graph.sumValues[0] = &graph.teamPerformance[d];
+                graph.sumMessages[0] = &graph.teamPerformanceFromNextDifference[d];
+                graph.sumCoefficients[0] = 1;
+                graph.sumValues[1] = &graph.difference[d];
+                graph.sumMessages[1] = &graph.differenceFromSum[d];
+                graph.sumCoefficients[1] = -1;
+                return SumUpdate(graph.teamPerformance[d + 1], graph.teamPerformanceFromPreviousDifference[d + 1], 2,
+                                 graph.sumValues, graph.sumMessages, graph.sumCoefficients);
+            }
+
+            case STEP_TRUNCATE_UP:
+            {
+                int d = step.index;
+                NaturalGaussian divided = graph.difference[d] / graph.differenceFromTruncate[d];
+                double sqrtPrecision = sqrt(divided.precision);
+                double teamPerformanceDifference = divided.precisionMean / sqrtPrecision;
+                double drawMargin = schedule.drawMargins[d] * sqrtPrecision;
+
+                double v;
+                double w;
+                const TruncatedGaussianCorrectionTables* tables = model.CorrectionTables();
+                GaussianAccuracy accuracy = model.Accuracy();
+                if (graph.draws[d])
+                {
+                    if (tables)
+                    {
+                        tables->WithinMargin(teamPerformanceDifference, drawMargin, v, w);
+                    }
+                    else
+                    {
+                        v = TruncatedGaussianCorrectionFunctions::VWithinMargin(teamPerformanceDifference, drawMargin, accuracy);
+                        w = TruncatedGaussianCorrectionFunctions::WWithinMargin(teamPerformanceDifference, drawMargin, accuracy);
+                    }
+                }
+                else
+                {
+                    if (tables)
+                    {
+                        tables->ExceedsMargin(teamPerformanceDifference, drawMargin, v, w);
+                    }
+                    else
+                    {
+                        v = TruncatedGaussianCorrectionFunctions::VExceedsMargin(teamPerformanceDifference, drawMargin, accuracy);
+                        w = TruncatedGaussianCorrectionFunctions::WExceedsMargin(teamPerformanceDifference, drawMargin, accuracy);
+                    }
+                }
+
+                double denominator = 1.0 - w;
+                NaturalGaussian newValue = NaturalGaussian::FromPrecisionMean(
+                    (divided.precisionMean + sqrtPrecision * v) / denominator, divided.precision / denominator);
+                return UpdateValue(graph.difference[d], graph.differenceFromTruncate[d], newValue);
+            }
+        }
+
+        return 0;
+    }
+
+    NaturalGaussian* AllocateUniform(MessageArena& arena, int count)
+    {
+        NaturalGaussian* result = arena.Allocate<NaturalGaussian>(count);
+        for (int i = 0; i < count; i++)
+        {
+            result[i] = NaturalGaussian();
+        }
+        return result;
+    }
+}
+
+void TeamRatingCalculator::CalculateNewRatings(const GameModel& model, Rating* ratings, const int* teamSizes, const int* teamRanks, int teamCount)
+{
+    CalculateNewRatings(model, ratings, teamSizes, teamRanks, teamCount, NULL);
+}
+
+void TeamRatingCalculator::CalculateNewRatings(const GameModel& model, Rating* ratings, const int* teamSizes, const int* teamRanks, int teamCount,
+                                               const double* partialPlay)
+{
+    SKILLS_TIME(TIMER_TEAM_CALCULATE_NEW_RATINGS);
+
+    if (teamCount < 2)
+    {
+        return;
+    }
+
+    MessageArena& arena = MessageArena::ForCurrentThread();
+    arena.Reset();
+
+    // best team first, insertion sort keeps teams with equal ranks in their original order
+    int* order = arena.Allocate<int>(teamCount);
+    int* inputOffsets = arena.Allocate<int>(teamCount);
+    int* sortedTeamSizes = arena.Allocate<int>(teamCount);
+    int playerCount = 0;
+    for (int t = 0; t < teamCount; t++)
+    {
+        inputOffsets[t] = playerCount;
+        playerCount += teamSizes[t];
+
+        int position = t;
+        while (position > 0 && teamRanks[order[position - 1]] < teamRanks[t])
+        {
+            order[position] = order[position - 1];
+            position--;
+        }
+        order[position] = t;
+    }
+    for (int t = 0; t < teamCount; t++)
+    {
+        sortedTeamSizes[t] = teamSizes[order[t]];
+    }
+
+    const Schedule& schedule = FindSchedule(model, sortedTeamSizes, teamCount);
+
+    Graph graph;
+    graph.schedule = &schedule;
+    graph.model = &model;
+
+    // players in graph order
+    Rating* priors = arena.Allocate<Rating>(playerCount);
+    int* playerIndices = arena.Allocate<int>(playerCount);
+    double* weights = arena.Allocate<double>(playerCount);
+    for (int t = 0, i = 0; t < teamCount; t++)
+    {
+        int team = order[t];
+        for (int x = 0; x < teamSizes[team]; x++, i++)
+        {
+            int player = inputOffsets[team] + x;
+            playerIndices[i] = player;
+            priors[i] = ratings[player];
+            // written so that NaN gets clamped too
+            weights[i] = !partialPlay ? 1.0 : (partialPlay[player] >= MINIMUM_PARTIAL_PLAY ? partialPlay[player] : MINIMUM_PARTIAL_PLAY);
+        }
+    }
+
+    int differenceCount = teamCount - 1;
+    bool* draws = arena.Allocate<bool>(differenceCount);
+    for (int d = 0; d < differenceCount; d++)
+    {
+        draws[d] = teamRanks[order[d]] == teamRanks[order[d + 1]];
+    }
+
+    graph.priors = priors;
+    graph.weights = weights;
+    graph.draws = draws;
+
+    graph.skill = AllocateUniform(arena, playerCount);
+    graph.skillFromPrior = AllocateUniform(arena, playerCount);
+    graph.skillFromLikelihood = AllocateUniform(arena, playerCount);
+    graph.performance = AllocateUniform(arena, playerCount);
+    graph.performanceFromLikelihood = AllocateUniform(arena, playerCount);
+    graph.performanceFromTeam = AllocateUniform(arena, playerCount);
+    graph.teamPerformance = AllocateUniform(arena, teamCount);
+    graph.teamPerformanceFromTeam = AllocateUniform(arena, teamCount);
+    graph.teamPerformanceFromNextDifference = AllocateUniform(arena, teamCount);
+    graph.teamPerformanceFromPreviousDifference = AllocateUniform(arena, teamCount);
+    graph.difference = AllocateUniform(arena, differenceCount);
+    graph.differenceFromSum = AllocateUniform(arena, differenceCount);
+    graph.differenceFromTruncate = AllocateUniform(arena, differenceCount);
+
+    int scratchSize = std::max(schedule.maximumTeamSize, 2);
+    graph.sumValues = arena.Allocate<const NaturalGaussian*>(scratchSize);
+    graph.sumMessages = arena.Allocate<const NaturalGaussian*>(scratchSize);
+    graph.sumCoefficients = arena.Allocate<double>(scratchSize);
+
+    for (size_t s = 0; s < schedule.down.size(); s++)
+    {
+        RunStep(graph, schedule.down[s]);
+    }
+
+    for (int iteration = 0; iteration < MAXIMUM_ITERATIONS; iteration++)
+    {
+        double delta = 0;
+        for (size_t s = 0; s < schedule.loop.size(); s++)
+        {
+            double stepDelta = RunStep(graph, schedule.loop[s]);
+            if (schedule.loop[s].type == STEP_TRUNCATE_UP)
+            {
+                delta = std::max(delta, stepDelta);
+            }
+        }
+
+        if (delta <= MINIMUM_DELTA)
+        {
+            break;
+        }
+    }
+
+    for (size_t s = 0; s < schedule.up.size(); s++)
+    {
+        RunStep(graph, schedule.up[s]);
+    }
+
+    for (int i = 0; i < playerCount; i++)
+    {
+        Rating& rating = ratings[playerIndices[i]];
+        rating = Rating(graph.skill[i].Mean(), graph.skill[i].StandardDeviation(), rating.conservativeMultiplier);
+    }
+}
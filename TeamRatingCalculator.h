@@ -0,0 +1,28 @@
+//
+//  TeamRatingCalculator.h
+//  Skills
+//
+//  Created by KleMiX on 23/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "Rating.h"
+#include "GameModel.h"
+
+// Full TrueSkill factor graph for any number of teams of any size, from 1v1 up to free-for-all.
+//
+// Players are passed team after team: the first teamSizes[0] ratings belong to team 0, the next
+// teamSizes[1] to team 1 and so on. Ranks follow RatingCalculator::CalculateNewRatings, the higher rank
+// wins and equal ranks are a draw. partialPlay optionally gives the fraction of the match every player
+// took part in (0, 1], anything below 0.0001 (zero, negative or NaN) counts as 0.0001.
+//
+// The graph lives in MessageArena::ForCurrentThread() and the message schedule is built once per team
+// layout and cached per thread, so after the first match of a given shape an update does no heap allocation.
+namespace TeamRatingCalculator
+{
+    void    CalculateNewRatings(const GameModel& model, Rating* ratings, const int* teamSizes, const int* teamRanks, int teamCount);
+    void    CalculateNewRatings(const GameModel& model, Rating* ratings, const int* teamSizes, const int* teamRanks, int teamCount,
+                                const double* partialPlay);
+}
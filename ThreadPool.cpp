@@ -0,0 +1,178 @@
+//
+//  ThreadPool.cpp
+//  Skills
+//
+//  Created by KleMiX on 02/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount) : pendingTasks(0), nextQueue(0), stopping(false)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+        {
+            threadCount = 1;
+        }
+    }
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        queues.push_back(new Queue());
+    }
+
+    for (size_t i = 0; i + 1 < threadCount; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+        delete queues[i];
+    }
+}
+
+size_t ThreadPool::ThreadCount() const
+{
+    return workers.size() + 1;
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grainSize, const RangeFunction& body)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (grainSize == 0)
+    {
+        grainSize = 1;
+    }
+
+    size_t chunkCount = (count + grainSize - 1) / grainSize;
+    if (workers.empty() || chunkCount == 1)
+    {
+        body(0, count);
+        return;
+    }
+
+    Job job;
+    job.body = &body;
+    job.remaining = chunkCount;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pendingTasks += chunkCount;
+    }
+
+    // spread the chunks so every worker starts on its own queue
+    size_t first = nextQueue.fetch_add(1);
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        Task task;
+        task.job = &job;
+        task.begin = c * grainSize;
+        task.end = std::min(count, task.begin + grainSize);
+
+        Queue& queue = *queues[(first + c) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    wakeUp.notify_all();
+
+    // the last queue belongs to outside callers
+    size_t own = queues.size() - 1;
+    Task task;
+    while (job.remaining.load() > 0 && (PopTask(own, task) || StealTask(own, task)))
+    {
+        RunTask(task);
+    }
+
+    // always synchronize with the last RunTask so it is done with the job before it goes away
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.done.wait(lock, [&job] { return job.remaining.load() == 0; });
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+    for (;;)
+    {
+        Task task;
+        if (PopTask(index, task) || StealTask(index, task))
+        {
+            RunTask(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this] { return stopping || pendingTasks.load() > 0; });
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::PopTask(size_t index, Task& task)
+{
+    Queue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    pendingTasks--;
+    return true;
+}
+
+bool ThreadPool::StealTask(size_t index, Task& task)
+{
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        Queue& queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            pendingTasks--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::RunTask(const Task& task)
+{
+    Job& job = *task.job;
+    (*job.body)(task.begin, task.end);
+
+    std::lock_guard<std::mutex> lock(job.mutex);
+    if (--job.remaining == 0)
+    {
+        job.done.notify_all();
+    }
+}
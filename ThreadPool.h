@@ -0,0 +1,77 @@
+//
+//  ThreadPool.h
+//  Skills
+//
+//  Created by KleMiX on 02/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with a task queue per worker. Idle workers steal from the front of the
+// other queues while owners take from the back, so uneven chunks even out without a central queue
+// everybody fights over.
+class ThreadPool
+{
+public:
+    typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+    // threadCount 0 uses every hardware thread, the calling thread counts as one of them
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    // Calls body on chunks of [0, count) of at most grainSize items and returns when all of them are done.
+    // The calling thread works on the chunks too. Small ranges run inline.
+    void ParallelFor(size_t count, size_t grainSize, const RangeFunction& body);
+
+    // Including the calling thread
+    size_t ThreadCount() const;
+
+private:
+    struct Job
+    {
+        const RangeFunction* body;
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    struct Task
+    {
+        Job* job;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator = (const ThreadPool&);
+
+    void WorkerLoop(size_t index);
+    bool PopTask(size_t index, Task& task);
+    bool StealTask(size_t index, Task& task);
+    void RunTask(const Task& task);
+
+    std::vector<std::thread> workers;
+    std::vector<Queue*> queues;     // one per worker plus one for outside callers
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<size_t> pendingTasks;
+    std::atomic<size_t> nextQueue;
+    bool stopping;
+};
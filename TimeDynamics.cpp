@@ -0,0 +1,81 @@
+//
+//  TimeDynamics.cpp
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "TimeDynamics.h"
+#include "RatingCalculator.h"
+#include "SimdKernels.h"
+
+#include <string.h>
+
+Rating TimeDynamics::GetRating(const GameModel& model, const RatingTable& table, int player, uint64_t now)
+{
+    Rating rating = table.Get(player);
+    if (table.tracksLastPlayed)
+    {
+        rating.standardDeviation = InflatedStandardDeviation(model, rating.standardDeviation, table.lastPlayed[player], now);
+    }
+    return rating;
+}
+
+void TimeDynamics::GetStandardDeviations(const GameModel& model, const RatingTable& table, size_t first, size_t count,
+                                         uint64_t now, double* result)
+{
+    if (!table.tracksLastPlayed)
+    {
+        memcpy(result, table.standardDeviation.data() + first, count * sizeof(double));
+        return;
+    }
+
+    SimdKernels::InflateStandardDeviations(table.standardDeviation.data() + first, table.lastPlayed.data() + first, now,
+                                           model.timeDynamicsFactorSquared, model.maximumStandardDeviation, result, count);
+}
+
+void TimeDynamics::CalculateNewRatings(const GameModel& model, RatingTable& table, int player1, int player2, int rank1, int rank2,
+                                       uint64_t timestamp)
+{
+    table.TrackLastPlayed();
+
+    Rating rating1 = GetRating(model, table, player1, timestamp);
+    Rating rating2 = GetRating(model, table, player2, timestamp);
+    RatingCalculator::CalculateNewRatings(model, rating1, rating2, rank1, rank2);
+
+    table.Set(player1, rating1);
+    table.Set(player2, rating2);
+    table.lastPlayed[player1] = timestamp;
+    table.lastPlayed[player2] = timestamp;
+}
+
+void TimeDynamics::CalculateNewRatings(const GameModel& model, RatingTable& table, const MatchRecord* matches, const uint64_t* timestamps,
+                                       size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        CalculateNewRatings(model, table, matches[i].player1, matches[i].player2, matches[i].rank1, matches[i].rank2, timestamps[i]);
+    }
+}
+
+void TimeDynamics::Apply(const GameModel& model, RatingTable& table, uint64_t now)
+{
+    if (!table.tracksLastPlayed)
+    {
+        return;
+    }
+
+    // in place is fine, the kernel loads every block before storing it
+    double* standardDeviation = table.standardDeviation.data();
+    SimdKernels::InflateStandardDeviations(standardDeviation, table.lastPlayed.data(), now,
+                                           model.timeDynamicsFactorSquared, model.maximumStandardDeviation, standardDeviation, table.Size());
+
+    for (size_t i = 0; i < table.Size(); i++)
+    {
+        if (table.lastPlayed[i] != NEVER_PLAYED && table.lastPlayed[i] < now)
+        {
+            table.lastPlayed[i] = now;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+//
+//  TimeDynamics.h
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "GameModel.h"
+#include "RatingTable.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+
+// Uncertainty that grows while a player is inactive, see GameModel::UseTimeDynamics. Nothing sweeps the
+// table: the stored standard deviation stays as of the last match and the inflation for the time since
+// lastPlayed is added whenever the rating is read or updated. Tables need TrackLastPlayed, the update
+// functions turn it on themselves.
+namespace TimeDynamics
+{
+    // sqrt(sd^2 + varianceGrowth * elapsed) capped at maximumStandardDeviation, a deviation already above the cap
+    // is left alone. SimdKernels::InflateStandardDeviations evaluates the same formula.
+    inline double InflatedStandardDeviation(double standardDeviation, uint64_t lastPlayed, uint64_t now,
+                                            double varianceGrowth, double maximumStandardDeviation)
+    {
+        double elapsed = now > lastPlayed ? (double) (now - lastPlayed) : 0.0;
+        double inflated = sqrt(standardDeviation * standardDeviation + varianceGrowth * elapsed);
+        return standardDeviation < maximumStandardDeviation ? std::min(inflated, maximumStandardDeviation) : standardDeviation;
+    }
+
+    inline double InflatedStandardDeviation(const GameModel& model, double standardDeviation, uint64_t lastPlayed, uint64_t now)
+    {
+        return InflatedStandardDeviation(standardDeviation, lastPlayed, now, model.timeDynamicsFactorSquared, model.maximumStandardDeviation);
+    }
+
+    // True when updating the table needs timestamps: the model lets deviations grow or the table already keeps
+    // lastPlayed. Every update path without timestamps refuses such models and tables instead of rating without
+    // the inflation, so a history gives the same ratings whichever way it is applied.
+    inline bool NeedsTimestamps(const GameModel& model)
+    {
+        return model.timeDynamicsFactor > 0;
+    }
+
+    template <class Scalar>
+    inline bool NeedsTimestamps(const GameModel& model, const BasicRatingTable<Scalar>& table)
+    {
+        return NeedsTimestamps(model) || table.tracksLastPlayed;
+    }
+
+    Rating  GetRating(const GameModel& model, const RatingTable& table, int player, uint64_t now);
+
+    // Vectorized bulk read of the standard deviations of players [first, first + count), for leaderboard
+    // exports, matchmaking and the like
+    void    GetStandardDeviations(const GameModel& model, const RatingTable& table, size_t first, size_t count,
+                                  uint64_t now, double* result);
+
+    // Inflates both players to timestamp, updates them like RatingCalculator::CalculateNewRatings and marks
+    // them as played at timestamp
+    void    CalculateNewRatings(const GameModel& model, RatingTable& table, int player1, int player2, int rank1, int rank2,
+                                uint64_t timestamp);
+    // Matches in time order, timestamps[i] belongs to matches[i]
+    void    CalculateNewRatings(const GameModel& model, RatingTable& table, const MatchRecord* matches, const uint64_t* timestamps,
+                                size_t count);
+
+    // Writes the inflation up to now into the standard deviation column and moves lastPlayed of everybody who
+    // played to now, reads stay the same up to rounding. Handy before exporting the plain columns, e.g. to RatingSnapshot.
+    void    Apply(const GameModel& model, RatingTable& table, uint64_t now);
+}
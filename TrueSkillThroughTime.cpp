@@ -0,0 +1,263 @@
+//
+//  TrueSkillThroughTime.cpp
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "TrueSkillThroughTime.h"
+#include "RatingCalculator.h"
+
+#include <math.h>
+#include <algorithm>
+#include <mutex>
+
+namespace
+{
+    const uint32_t NO_SKILL = ~0u;
+    const size_t MATCHES_PER_TASK = 4096;
+    const size_t PLAYERS_PER_TASK = 1024;
+
+    bool IsValidHistory(const MatchRecord* matches, const uint32_t* timeSlices, size_t matchCount, size_t playerCount)
+    {
+        for (size_t i = 0; i < matchCount; i++)
+        {
+            const MatchRecord& match = matches[i];
+            if (match.player1 < 0 || (size_t) match.player1 >= playerCount || match.player2 < 0 || (size_t) match.player2 >= playerCount ||
+                (i > 0 && timeSlices[i] < timeSlices[i - 1]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Message through the dynamics factor between two slices, uniform stays uniform
+    NaturalGaussian Diffuse(const NaturalGaussian& distribution, double variance)
+    {
+        if (distribution.precision <= 0)
+        {
+            return NaturalGaussian();
+        }
+        return NaturalGaussian::FromMeanVariance(distribution.Mean(), distribution.Variance() + variance);
+    }
+}
+
+TrueSkillThroughTime::TrueSkillThroughTime(const GameModel& model, const MatchRecord* matches, const uint32_t* timeSlices, size_t matchCount,
+                                           size_t playerCount)
+: model(model),
+  matchModel(model.initialMean, model.initialStandardDeviation, model.beta, model.drawProbability, 0.0),
+  matchCount(matchCount),
+  playerCount(playerCount),
+  valid(IsValidHistory(matches, timeSlices, matchCount, playerCount)),
+  lastChange(HUGE_VAL)
+{
+    // a refused history is built as one without matches, every player keeps the prior
+    if (!valid)
+    {
+        this->matchCount = matchCount = 0;
+    }
+
+    // the match messages are computed like any other update, with the game's tables and accuracy tier
+    matchModel.correctionTables = model.correctionTables;
+    matchModel.UseAccuracy(model.Accuracy());
+
+    outcomes.resize(matchCount);
+    matchSkills.assign(2 * matchCount, NO_SKILL);
+    matchMessages.resize(2 * matchCount);
+
+    // appearances of every player in match order, so in slice order too
+    std::vector<size_t> appearanceOffsets(playerCount + 1, 0);
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        const MatchRecord& match = matches[i];
+        outcomes[i] = match.rank1 > match.rank2 ? 1 : (match.rank1 < match.rank2 ? -1 : 0);
+        if (match.player1 != match.player2)
+        {
+            appearanceOffsets[match.player1 + 1]++;
+            appearanceOffsets[match.player2 + 1]++;
+        }
+    }
+    for (size_t p = 0; p < playerCount; p++)
+    {
+        appearanceOffsets[p + 1] += appearanceOffsets[p];
+    }
+
+    std::vector<size_t> position(appearanceOffsets.begin(), appearanceOffsets.end() - 1);
+    skillMessages.resize(appearanceOffsets[playerCount]);
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        const MatchRecord& match = matches[i];
+        if (match.player1 != match.player2)
+        {
+            skillMessages[position[match.player1]++] = (uint32_t) (2 * i);
+            skillMessages[position[match.player2]++] = (uint32_t) (2 * i + 1);
+        }
+    }
+
+    // one skill per player and slice
+    playerSkillOffsets.resize(playerCount + 1);
+    for (size_t p = 0; p < playerCount; p++)
+    {
+        playerSkillOffsets[p] = skillTimeSlices.size();
+        for (size_t a = appearanceOffsets[p]; a < appearanceOffsets[p + 1]; a++)
+        {
+            uint32_t message = skillMessages[a];
+            uint32_t timeSlice = timeSlices[message / 2];
+            if (a == appearanceOffsets[p] || timeSlice != skillTimeSlices.back())
+            {
+                skillTimeSlices.push_back(timeSlice);
+                skillMessageOffsets.push_back(a);
+            }
+            matchSkills[message] = (uint32_t) (skillTimeSlices.size() - 1);
+        }
+    }
+    playerSkillOffsets[playerCount] = skillTimeSlices.size();
+    skillMessageOffsets.push_back(skillMessages.size());
+
+    size_t skillCount = skillTimeSlices.size();
+    forward.resize(skillCount);
+    backward.resize(skillCount);
+    likelihood.resize(skillCount);
+    marginal.resize(skillCount);
+
+    // every match message starts uniform, so this spreads the priors along the chains
+    UpdatePlayers(0, playerCount);
+}
+
+void TrueSkillThroughTime::UpdateMatches(size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        uint32_t skill1 = matchSkills[2 * i];
+        uint32_t skill2 = matchSkills[2 * i + 1];
+        if (skill1 == NO_SKILL)
+        {
+            continue;
+        }
+
+        // everything the skills know except this match
+        NaturalGaussian cavity1 = marginal[skill1] / matchMessages[2 * i];
+        NaturalGaussian cavity2 = marginal[skill2] / matchMessages[2 * i + 1];
+        if (cavity1.precision <= 0 || cavity2.precision <= 0)
+        {
+            continue;
+        }
+
+        Rating player1(cavity1.Mean(), cavity1.StandardDeviation());
+        Rating player2(cavity2.Mean(), cavity2.StandardDeviation());
+        RatingCalculator::CalculateNewRatings(matchModel, player1, player2, outcomes[i] > 0 ? 1 : 0, outcomes[i] < 0 ? 1 : 0);
+
+        matchMessages[2 * i] = NaturalGaussian::FromMeanStandardDeviation(player1.mean, player1.standardDeviation) / cavity1;
+        matchMessages[2 * i + 1] = NaturalGaussian::FromMeanStandardDeviation(player2.mean, player2.standardDeviation) / cavity2;
+    }
+}
+
+double TrueSkillThroughTime::UpdatePlayers(size_t begin, size_t end)
+{
+    double change = 0;
+    for (size_t p = begin; p < end; p++)
+    {
+        size_t first = playerSkillOffsets[p];
+        size_t last = playerSkillOffsets[p + 1];
+        if (first == last)
+        {
+            continue;
+        }
+
+        for (size_t s = first; s < last; s++)
+        {
+            NaturalGaussian product;
+            for (size_t m = skillMessageOffsets[s]; m < skillMessageOffsets[s + 1]; m++)
+            {
+                product = product * matchMessages[skillMessages[m]];
+            }
+            likelihood[s] = product;
+        }
+
+        forward[first] = NaturalGaussian::FromMeanStandardDeviation(model.initialMean, model.initialStandardDeviation);
+        for (size_t s = first + 1; s < last; s++)
+        {
+            double variance = (skillTimeSlices[s] - skillTimeSlices[s - 1]) * model.dynamicsFactorSquared;
+            forward[s] = Diffuse(forward[s - 1] * likelihood[s - 1], variance);
+        }
+
+        backward[last - 1] = NaturalGaussian();
+        for (size_t s = last - 1; s > first; s--)
+        {
+            double variance = (skillTimeSlices[s] - skillTimeSlices[s - 1]) * model.dynamicsFactorSquared;
+            backward[s - 1] = Diffuse(backward[s] * likelihood[s], variance);
+        }
+
+        for (size_t s = first; s < last; s++)
+        {
+            NaturalGaussian updated = forward[s] * backward[s] * likelihood[s];
+            change = std::max(change, updated - marginal[s]);
+            marginal[s] = updated;
+        }
+    }
+    return change;
+}
+
+int TrueSkillThroughTime::Run(ThreadPool& pool, int maximumIterations, double convergence)
+{
+    int iteration = 0;
+    while (valid && iteration < maximumIterations)
+    {
+        // matches only read the marginals and write their own messages, players only read the messages
+        pool.ParallelFor(matchCount, MATCHES_PER_TASK, [this](size_t begin, size_t end)
+        {
+            UpdateMatches(begin, end);
+        });
+
+        std::mutex changeMutex;
+        double change = 0;
+        pool.ParallelFor(playerCount, PLAYERS_PER_TASK, [&](size_t begin, size_t end)
+        {
+            double taskChange = UpdatePlayers(begin, end);
+            std::lock_guard<std::mutex> lock(changeMutex);
+            change = std::max(change, taskChange);
+        });
+
+        lastChange = change;
+        iteration++;
+        if (change < convergence)
+        {
+            break;
+        }
+    }
+    return iteration;
+}
+
+double TrueSkillThroughTime::LastChange() const
+{
+    return lastChange;
+}
+
+void TrueSkillThroughTime::GetRatings(RatingTable& table) const
+{
+    table.Resize(playerCount, model.initialMean, model.initialStandardDeviation);
+    for (size_t p = 0; p < playerCount; p++)
+    {
+        if (playerSkillOffsets[p] == playerSkillOffsets[p + 1])
+        {
+            table.Set((int) p, Rating(model.initialMean, model.initialStandardDeviation));
+            continue;
+        }
+
+        const NaturalGaussian& skill = marginal[playerSkillOffsets[p + 1] - 1];
+        table.Set((int) p, Rating(skill.Mean(), skill.StandardDeviation()));
+    }
+}
+
+void TrueSkillThroughTime::GetHistory(int player, std::vector<uint32_t>& timeSlices, std::vector<Rating>& ratings) const
+{
+    timeSlices.clear();
+    ratings.clear();
+    for (size_t s = playerSkillOffsets[player]; s < playerSkillOffsets[player + 1]; s++)
+    {
+        timeSlices.push_back(skillTimeSlices[s]);
+        ratings.push_back(Rating(marginal[s].Mean(), marginal[s].StandardDeviation()));
+    }
+}
@@ -0,0 +1,88 @@
+//
+//  TrueSkillThroughTime.h
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "NaturalGaussian.h"
+#include "RatingTable.h"
+#include "GameModel.h"
+#include "ThreadPool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Offline smoothing of a whole match history in the spirit of TrueSkill Through Time (Dangauthier, Herbrich,
+// Minka, Graepel 2007). Unlike the filtering update every match also informs the skills before it, so early
+// matches are rated with everything that is known later.
+//
+// A player has one skill per time slice they played in, consecutive skills are linked by the dynamics
+// factor (model.dynamicsFactorSquared of variance per slice between them). Every iteration
+//   - recomputes the message of every match from the current skills, all matches at once (Jacobi), and
+//   - runs a forward and a backward pass along the chain of every player, players in parallel.
+// Both steps spread over the pool, so slices and players are processed in parallel. Memory is linear in the
+// number of matches and player slices and allocated once by the constructor. The match messages use the
+// correction tables and accuracy tier of the model like RatingCalculator does.
+class TrueSkillThroughTime
+{
+public:
+    // matches[i] happened in time slice timeSlices[i], slices must not decrease. Players are below playerCount,
+    // matches of a player against themselves are ignored. A history breaking either rule is refused, see IsValid.
+    TrueSkillThroughTime(const GameModel& model, const MatchRecord* matches, const uint32_t* timeSlices, size_t matchCount,
+                         size_t playerCount);
+
+    // False when the constructor refused the history. Nothing is smoothed then: Run returns 0 without an
+    // iteration and every player keeps the model prior.
+    bool    IsValid() const
+    {
+        return valid;
+    }
+
+    // Iterates until no skill changes by more than convergence, measured with the NaturalGaussian
+    // operator -, or maximumIterations ran. Returns the number of iterations, can be called again to continue.
+    int     Run(ThreadPool& pool, int maximumIterations = 30, double convergence = 1e-3);
+
+    // Largest change of the last iteration
+    double  LastChange() const;
+
+    // Skill after the last slice of every player, the model prior for players without matches
+    void    GetRatings(RatingTable& table) const;
+
+    // Skill of the player in every slice they played in, oldest first
+    void    GetHistory(int player, std::vector<uint32_t>& timeSlices, std::vector<Rating>& ratings) const;
+
+private:
+    TrueSkillThroughTime(const TrueSkillThroughTime&);
+    TrueSkillThroughTime& operator = (const TrueSkillThroughTime&);
+
+    void    UpdateMatches(size_t begin, size_t end);
+    double  UpdatePlayers(size_t begin, size_t end);
+
+    GameModel model;
+    GameModel matchModel;           // same game without dynamics, they live between the slices
+    size_t matchCount;
+    size_t playerCount;
+    bool valid;
+
+    // per match
+    std::vector<int8_t> outcomes;   // 1 when player1 won, -1 when player2 won, 0 for a draw
+    std::vector<uint32_t> matchSkills;              // skill of player1 and player2, 2 per match
+    std::vector<NaturalGaussian> matchMessages;     // from the match to those skills
+
+    // per skill, skills of a player are consecutive
+    std::vector<size_t> playerSkillOffsets;
+    std::vector<uint32_t> skillTimeSlices;
+    std::vector<size_t> skillMessageOffsets;        // into skillMessages
+    std::vector<uint32_t> skillMessages;            // indices into matchMessages
+    std::vector<NaturalGaussian> forward;           // from the previous slice, the prior for the first one
+    std::vector<NaturalGaussian> backward;          // from the next slice
+    std::vector<NaturalGaussian> likelihood;        // product of the match messages
+    std::vector<NaturalGaussian> marginal;
+
+    double lastChange;
+};
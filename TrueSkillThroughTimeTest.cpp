@@ -0,0 +1,234 @@
+//
+//  TrueSkillThroughTimeTest.cpp
+//  Skills
+//
+//  Created by KleMiX on 30/03/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "TrueSkillThroughTime.h"
+#include "RatingCalculator.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <random>
+#include <vector>
+
+// Smooths small seeded histories with TrueSkillThroughTime. Over several slices with dynamics the smoothing
+// has to converge, and running it again must not move the ratings. With zero dynamics and a single slice it
+// is plain expectation propagation over the matches, so the ratings must match a sequential EP run to its
+// fixed point, and a lone match must give the ratings of RatingCalculator::CalculateNewRatings. Histories with
+// a decreasing slice or a player outside the table are refused. Exits with 1 on any failure, run by ctest.
+
+namespace
+{
+    const size_t PLAYER_COUNT = 40;
+    const size_t MATCH_COUNT = 400;
+    const uint32_t SLICE_COUNT = 10;
+    const uint64_t SEED = 20140330;
+
+    // The common level of all players is only held by the priors, so that mode settles slowly. The change
+    // between iterations doesn't get much below 1e-8, rounding between the two parameterizations.
+    const int MAXIMUM_ITERATIONS = 1000;
+    const double CONVERGENCE = 1e-6;
+    const double REFERENCE_CONVERGENCE = 1e-7;
+    const double RERUN_TOLERANCE = 1e-6;
+    const double EP_TOLERANCE = 1e-6;
+    const double SINGLE_MATCH_TOLERANCE = 1e-12;
+
+    // Stronger players win more often, a few draws, slices in order
+    void MakeHistory(uint32_t sliceCount, std::vector<MatchRecord>& matches, std::vector<uint32_t>& timeSlices)
+    {
+        std::mt19937_64 random(SEED + sliceCount);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        matches.clear();
+        timeSlices.clear();
+        while (matches.size() < MATCH_COUNT)
+        {
+            int player1 = (int) (random() % PLAYER_COUNT);
+            int player2 = (int) (random() % PLAYER_COUNT);
+            if (player1 == player2)
+            {
+                continue;
+            }
+
+            double draw = uniform(random);
+            double win = 1.0 / (1.0 + exp((player2 - player1) / 8.0));
+            int rank1 = draw < 0.1 ? 0 : (uniform(random) < win ? 1 : 0);
+            int rank2 = draw < 0.1 ? 0 : 1 - rank1;
+            matches.push_back(MatchRecord(player1, player2, rank1, rank2));
+            timeSlices.push_back((uint32_t) (matches.size() * sliceCount / (MATCH_COUNT + 1)));
+        }
+    }
+
+    // Gauss-Seidel expectation propagation of one slice without dynamics, match after match until nothing moves
+    void RunReference(const GameModel& model, const std::vector<MatchRecord>& matches, std::vector<Rating>& ratings)
+    {
+        std::vector<NaturalGaussian> marginal(PLAYER_COUNT, NaturalGaussian::FromMeanStandardDeviation(model.initialMean, model.initialStandardDeviation));
+        std::vector<NaturalGaussian> messages(2 * matches.size());
+
+        double change = HUGE_VAL;
+        for (int sweep = 0; sweep < 10 * MAXIMUM_ITERATIONS && change > REFERENCE_CONVERGENCE; sweep++)
+        {
+            change = 0;
+            for (size_t i = 0; i < matches.size(); i++)
+            {
+                const MatchRecord& match = matches[i];
+                NaturalGaussian cavity1 = marginal[match.player1] / messages[2 * i];
+                NaturalGaussian cavity2 = marginal[match.player2] / messages[2 * i + 1];
+
+                Rating player1(cavity1.Mean(), cavity1.StandardDeviation());
+                Rating player2(cavity2.Mean(), cavity2.StandardDeviation());
+                RatingCalculator::CalculateNewRatings(model, player1, player2, match.rank1, match.rank2);
+
+                NaturalGaussian updated1 = NaturalGaussian::FromMeanStandardDeviation(player1.mean, player1.standardDeviation);
+                NaturalGaussian updated2 = NaturalGaussian::FromMeanStandardDeviation(player2.mean, player2.standardDeviation);
+                change = std::max(change, std::max(updated1 - marginal[match.player1], updated2 - marginal[match.player2]));
+                messages[2 * i] = updated1 / cavity1;
+                messages[2 * i + 1] = updated2 / cavity2;
+                marginal[match.player1] = updated1;
+                marginal[match.player2] = updated2;
+            }
+        }
+
+        ratings.resize(PLAYER_COUNT);
+        for (size_t p = 0; p < PLAYER_COUNT; p++)
+        {
+            ratings[p] = Rating(marginal[p].Mean(), marginal[p].StandardDeviation());
+        }
+    }
+
+    double LargestDifference(const std::vector<Rating>& expected, const RatingTable& table)
+    {
+        double difference = expected.size() == table.Size() ? 0 : HUGE_VAL;
+        for (size_t p = 0; p < expected.size() && p < table.Size(); p++)
+        {
+            difference = std::max(difference, fabs(expected[p].mean - table.mean[p]));
+            difference = std::max(difference, fabs(expected[p].standardDeviation - table.standardDeviation[p]));
+        }
+        return difference;
+    }
+
+    void ToRatings(const RatingTable& table, std::vector<Rating>& ratings)
+    {
+        ratings.resize(table.Size());
+        for (size_t p = 0; p < table.Size(); p++)
+        {
+            ratings[p] = Rating(table.mean[p], table.standardDeviation[p]);
+        }
+    }
+
+    bool Report(const char* name, bool passed, const char* detail)
+    {
+        printf("%-40s %s%s%s\n", name, passed ? "passed" : "FAILED", detail[0] ? ", " : "", detail);
+        return passed;
+    }
+
+    // Several slices with the default dynamics: Run has to stop on its own, a second Run barely moves anything
+    bool CheckConvergence(const GameModel& model, ThreadPool& pool)
+    {
+        std::vector<MatchRecord> matches;
+        std::vector<uint32_t> timeSlices;
+        MakeHistory(SLICE_COUNT, matches, timeSlices);
+
+        TrueSkillThroughTime smoothing(model, matches.data(), timeSlices.data(), matches.size(), PLAYER_COUNT);
+        int iterations = smoothing.Run(pool, MAXIMUM_ITERATIONS, CONVERGENCE);
+        double lastChange = smoothing.LastChange();
+
+        RatingTable converged;
+        std::vector<Rating> ratings;
+        smoothing.GetRatings(converged);
+        ToRatings(converged, ratings);
+
+        int rerunIterations = smoothing.Run(pool, MAXIMUM_ITERATIONS, CONVERGENCE);
+        RatingTable rerun;
+        smoothing.GetRatings(rerun);
+        double moved = LargestDifference(ratings, rerun);
+
+        char detail[128];
+        snprintf(detail, sizeof(detail), "%d iterations, last change %.1e, rerun %d iterations moved %.1e", iterations, lastChange,
+                 rerunIterations, moved);
+        return Report("slices with dynamics converge", smoothing.IsValid() && iterations < MAXIMUM_ITERATIONS && lastChange < CONVERGENCE &&
+                      rerunIterations == 1 && moved < RERUN_TOLERANCE, detail);
+    }
+
+    bool CheckSingleSlice(const GameModel& model, ThreadPool& pool)
+    {
+        std::vector<MatchRecord> matches;
+        std::vector<uint32_t> timeSlices;
+        MakeHistory(1, matches, timeSlices);
+
+        TrueSkillThroughTime smoothing(model, matches.data(), timeSlices.data(), matches.size(), PLAYER_COUNT);
+        int iterations = smoothing.Run(pool, MAXIMUM_ITERATIONS, CONVERGENCE);
+        RatingTable table;
+        smoothing.GetRatings(table);
+
+        std::vector<Rating> expected;
+        RunReference(model, matches, expected);
+        double difference = LargestDifference(expected, table);
+
+        char detail[128];
+        snprintf(detail, sizeof(detail), "%d iterations, %.1e from sequential EP", iterations, difference);
+        return Report("one slice, no dynamics, is EP", smoothing.IsValid() && iterations < MAXIMUM_ITERATIONS && difference < EP_TOLERANCE, detail);
+    }
+
+    bool CheckSingleMatch(const GameModel& model, ThreadPool& pool)
+    {
+        MatchRecord match(3, 1, 1, 0);
+        uint32_t timeSlice = 7;
+        TrueSkillThroughTime smoothing(model, &match, &timeSlice, 1, 4);
+        smoothing.Run(pool, MAXIMUM_ITERATIONS, CONVERGENCE);
+        RatingTable table;
+        smoothing.GetRatings(table);
+
+        std::vector<Rating> expected(4, Rating(model.initialMean, model.initialStandardDeviation));
+        RatingCalculator::CalculateNewRatings(model, expected[3], expected[1], match.rank1, match.rank2);
+        double difference = LargestDifference(expected, table);
+
+        char detail[64];
+        snprintf(detail, sizeof(detail), "%.1e from CalculateNewRatings", difference);
+        return Report("lone match is one update", smoothing.IsValid() && difference < SINGLE_MATCH_TOLERANCE, detail);
+    }
+
+    // Nothing may be smoothed, every player keeps the prior
+    bool CheckRefused(const char* name, const GameModel& model, ThreadPool& pool, const MatchRecord& badMatch, uint32_t badSlice)
+    {
+        std::vector<MatchRecord> matches;
+        std::vector<uint32_t> timeSlices;
+        MakeHistory(SLICE_COUNT, matches, timeSlices);
+        matches[matches.size() / 2] = badMatch;
+        timeSlices[matches.size() / 2] = badSlice;
+
+        TrueSkillThroughTime smoothing(model, matches.data(), timeSlices.data(), matches.size(), PLAYER_COUNT);
+        int iterations = smoothing.Run(pool, MAXIMUM_ITERATIONS, CONVERGENCE);
+        RatingTable table;
+        smoothing.GetRatings(table);
+
+        std::vector<Rating> prior(PLAYER_COUNT, Rating(model.initialMean, model.initialStandardDeviation));
+        return Report(name, !smoothing.IsValid() && iterations == 0 && LargestDifference(prior, table) == 0, "");
+    }
+}
+
+int main()
+{
+    GameModel model;
+    GameModel staticModel(model.initialMean, model.initialStandardDeviation, model.beta, model.drawProbability, 0.0);
+    ThreadPool pool(4);
+    printf("%zu players, %zu matches\n\n", PLAYER_COUNT, MATCH_COUNT);
+
+    bool success = true;
+    success = CheckConvergence(model, pool) && success;
+    success = CheckSingleSlice(staticModel, pool) && success;
+    success = CheckSingleMatch(staticModel, pool) && success;
+
+    std::vector<MatchRecord> matches;
+    std::vector<uint32_t> timeSlices;
+    MakeHistory(SLICE_COUNT, matches, timeSlices);
+    uint32_t middleSlice = timeSlices[matches.size() / 2];
+    success = CheckRefused("decreasing slice refused", model, pool, matches[matches.size() / 2], 0) && success;
+    success = CheckRefused("player at the limit refused", model, pool, MatchRecord(2, (int) PLAYER_COUNT, 1, 0), middleSlice) && success;
+    success = CheckRefused("negative player refused", model, pool, MatchRecord(-1, 2, 1, 0), middleSlice) && success;
+
+    printf("\n%s\n", success ? "all smoothing checks passed" : "smoothing checks failed");
+    return success ? 0 : 1;
+}
@@ -8,58 +8,114 @@
 
 #include "TruncatedGaussianCorrectionFunctions.h"
 #include "GaussianDistribution.h"
+#include "Instrumentation.h"
 
-double TruncatedGaussianCorrectionFunctions::VExceedsMargin(double teamPerformanceDifference, double drawMargin)
+namespace
 {
-    double denominator = GaussianDistribution::CumulativeTo(teamPerformanceDifference - drawMargin);
+    // Below this the denominators are too close to underflow for the ratio to mean anything and the
+    // asymptotic values are used instead. For float, At() reaches the subnormals just below 1e-38.
+    template <class Scalar> struct CorrectionLimits;
     
-    if (denominator < 2.222758749e-162)
+    template <> struct CorrectionLimits<double>
     {
+        static double TinyDenominator() { return 2.222758749e-162; }
+    };
+    
+    template <> struct CorrectionLimits<float>
+    {
+        static float TinyDenominator() { return 1.0e-35f; }
+    };
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::VExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin)
+{
+    return VExceedsMargin(teamPerformanceDifference, drawMargin, GAUSSIAN_ACCURACY_FULL);
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::VExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, GaussianAccuracy accuracy)
+{
+    Scalar denominator = BasicGaussianDistribution<Scalar>::CumulativeTo(teamPerformanceDifference - drawMargin, accuracy);
+    
+    if (denominator < CorrectionLimits<Scalar>::TinyDenominator())
+    {
+        SKILLS_COUNT(COUNTER_V_EXCEEDS_MARGIN_FALLBACK);
         return -teamPerformanceDifference + drawMargin;
     }
     
-    return GaussianDistribution::At(teamPerformanceDifference - drawMargin)/denominator;
+    return BasicGaussianDistribution<Scalar>::At(teamPerformanceDifference - drawMargin)/denominator;
 }
 
-double TruncatedGaussianCorrectionFunctions::VExceedsMargin(double teamPerformanceDifference, double drawMargin, double c)
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::VExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c)
 {
     return VExceedsMargin(teamPerformanceDifference/c, drawMargin/c);
     //return GaussianDistribution::At((teamPerformanceDifference - drawMargin) / c) / GaussianDistribution.CumulativeTo((teamPerformanceDifference - drawMargin) / c);
 }
 
-double TruncatedGaussianCorrectionFunctions::WExceedsMargin(double teamPerformanceDifference, double drawMargin)
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::VExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c, GaussianAccuracy accuracy)
+{
+    return VExceedsMargin(teamPerformanceDifference/c, drawMargin/c, accuracy);
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::WExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin)
 {
-    double denominator = GaussianDistribution::CumulativeTo(teamPerformanceDifference - drawMargin);
+    return WExceedsMargin(teamPerformanceDifference, drawMargin, GAUSSIAN_ACCURACY_FULL);
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::WExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, GaussianAccuracy accuracy)
+{
+    Scalar denominator = BasicGaussianDistribution<Scalar>::CumulativeTo(teamPerformanceDifference - drawMargin, accuracy);
     
-    if (denominator < 2.222758749e-162)
+    if (denominator < CorrectionLimits<Scalar>::TinyDenominator())
     {
-        if (teamPerformanceDifference < 0.0)
+        SKILLS_COUNT(COUNTER_W_EXCEEDS_MARGIN_FALLBACK);
+        if (teamPerformanceDifference < Scalar(0))
         {
-            return 1.0;
+            return 1;
         }
-        return 0.0;
+        return 0;
     }
     
-    double vWin = VExceedsMargin(teamPerformanceDifference, drawMargin);
+    Scalar vWin = VExceedsMargin(teamPerformanceDifference, drawMargin, accuracy);
     return vWin*(vWin + teamPerformanceDifference - drawMargin);
 }
 
-double TruncatedGaussianCorrectionFunctions::WExceedsMargin(double teamPerformanceDifference, double drawMargin, double c)
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::WExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c)
 {
     return WExceedsMargin(teamPerformanceDifference/c, drawMargin/c);
     //var vWin = VExceedsMargin(teamPerformanceDifference, drawMargin, c);
     //return vWin * (vWin + (teamPerformanceDifference - drawMargin) / c);
 }
 
-double TruncatedGaussianCorrectionFunctions::VWithinMargin(double teamPerformanceDifference, double drawMargin)
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::WExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c, GaussianAccuracy accuracy)
+{
+    return WExceedsMargin(teamPerformanceDifference/c, drawMargin/c, accuracy);
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::VWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin)
+{
+    return VWithinMargin(teamPerformanceDifference, drawMargin, GAUSSIAN_ACCURACY_FULL);
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::VWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, GaussianAccuracy accuracy)
 {
-    double teamPerformanceDifferenceAbsoluteValue = fabs(teamPerformanceDifference);
-    double denominator =
-    GaussianDistribution::CumulativeTo(drawMargin - teamPerformanceDifferenceAbsoluteValue) -
-    GaussianDistribution::CumulativeTo(-drawMargin - teamPerformanceDifferenceAbsoluteValue);
-    if (denominator < 2.222758749e-162)
+    Scalar teamPerformanceDifferenceAbsoluteValue = fabs(teamPerformanceDifference);
+    Scalar denominator =
+    BasicGaussianDistribution<Scalar>::CumulativeTo(drawMargin - teamPerformanceDifferenceAbsoluteValue, accuracy) -
+    BasicGaussianDistribution<Scalar>::CumulativeTo(-drawMargin - teamPerformanceDifferenceAbsoluteValue, accuracy);
+    if (denominator < CorrectionLimits<Scalar>::TinyDenominator())
     {
-        if (teamPerformanceDifference < 0.0)
+        SKILLS_COUNT(COUNTER_V_WITHIN_MARGIN_FALLBACK);
+        if (teamPerformanceDifference < Scalar(0))
         {
             return -teamPerformanceDifference - drawMargin;
         }
@@ -67,10 +123,10 @@ double TruncatedGaussianCorrectionFunctions::VWithinMargin(double teamPerformanc
         return -teamPerformanceDifference + drawMargin;
     }
     
-    double numerator = GaussianDistribution::At(-drawMargin - teamPerformanceDifferenceAbsoluteValue) -
-    GaussianDistribution::At(drawMargin - teamPerformanceDifferenceAbsoluteValue);
+    Scalar numerator = BasicGaussianDistribution<Scalar>::At(-drawMargin - teamPerformanceDifferenceAbsoluteValue) -
+    BasicGaussianDistribution<Scalar>::At(drawMargin - teamPerformanceDifferenceAbsoluteValue);
     
-    if (teamPerformanceDifference < 0.0)
+    if (teamPerformanceDifference < Scalar(0))
     {
         return -numerator/denominator;
     }
@@ -79,7 +135,8 @@ double TruncatedGaussianCorrectionFunctions::VWithinMargin(double teamPerformanc
 }
 
 // the additive correction of a double-sided truncated Gaussian with unit variance
-double TruncatedGaussianCorrectionFunctions::VWithinMargin(double teamPerformanceDifference, double drawMargin, double c)
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::VWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c)
 {
     return VWithinMargin(teamPerformanceDifference/c, drawMargin/c);
     //var teamPerformanceDifferenceAbsoluteValue = Math.Abs(teamPerformanceDifference);
@@ -88,33 +145,75 @@ double TruncatedGaussianCorrectionFunctions::VWithinMargin(double teamPerformanc
     //       (GaussianDistribution.CumulativeTo((drawMargin - teamPerformanceDifferenceAbsoluteValue) / c) - GaussianDistribution.CumulativeTo((-drawMargin - teamPerformanceDifferenceAbsoluteValue) / c));
 }
 
-double TruncatedGaussianCorrectionFunctions::WWithinMargin(double teamPerformanceDifference, double drawMargin)
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::VWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c, GaussianAccuracy accuracy)
 {
-    double teamPerformanceDifferenceAbsoluteValue = fabs(teamPerformanceDifference);
-    double denominator = GaussianDistribution::CumulativeTo(drawMargin - teamPerformanceDifferenceAbsoluteValue)
+    return VWithinMargin(teamPerformanceDifference/c, drawMargin/c, accuracy);
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::WWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin)
+{
+    return WWithinMargin(teamPerformanceDifference, drawMargin, GAUSSIAN_ACCURACY_FULL);
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::WWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, GaussianAccuracy accuracy)
+{
+    Scalar teamPerformanceDifferenceAbsoluteValue = fabs(teamPerformanceDifference);
+    Scalar denominator = BasicGaussianDistribution<Scalar>::CumulativeTo(drawMargin - teamPerformanceDifferenceAbsoluteValue, accuracy)
     -
-    GaussianDistribution::CumulativeTo(-drawMargin - teamPerformanceDifferenceAbsoluteValue);
+    BasicGaussianDistribution<Scalar>::CumulativeTo(-drawMargin - teamPerformanceDifferenceAbsoluteValue, accuracy);
     
-    if (denominator < 2.222758749e-162)
+    if (denominator < CorrectionLimits<Scalar>::TinyDenominator())
     {
-        return 1.0;
+        SKILLS_COUNT(COUNTER_W_WITHIN_MARGIN_FALLBACK);
+        return 1;
     }
     
-    double vt = VWithinMargin(teamPerformanceDifferenceAbsoluteValue, drawMargin);
+    Scalar vt = VWithinMargin(teamPerformanceDifferenceAbsoluteValue, drawMargin, accuracy);
     
     return vt*vt +
     (
      (drawMargin - teamPerformanceDifferenceAbsoluteValue)
      *
-     GaussianDistribution::At(
+     BasicGaussianDistribution<Scalar>::At(
                               drawMargin - teamPerformanceDifferenceAbsoluteValue)
      - (-drawMargin - teamPerformanceDifferenceAbsoluteValue)
      *
-     GaussianDistribution::At(-drawMargin - teamPerformanceDifferenceAbsoluteValue))/denominator;
+     BasicGaussianDistribution<Scalar>::At(-drawMargin - teamPerformanceDifferenceAbsoluteValue))/denominator;
 }
 
 // the multiplicative correction of a double-sided truncated Gaussian with unit variance
-double TruncatedGaussianCorrectionFunctions::WWithinMargin(double teamPerformanceDifference, double drawMargin, double c)
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::WWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c)
 {
     return WWithinMargin(teamPerformanceDifference/c, drawMargin/c);
-}
\ No newline at end of file
+}
+
+template <class Scalar>
+Scalar TruncatedGaussianCorrectionFunctions::WWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c, GaussianAccuracy accuracy)
+{
+    return WWithinMargin(teamPerformanceDifference/c, drawMargin/c, accuracy);
+}
+
+#define INSTANTIATE_CORRECTION_FUNCTIONS(Scalar) \
+    template Scalar TruncatedGaussianCorrectionFunctions::VExceedsMargin<Scalar>(Scalar, Scalar); \
+    template Scalar TruncatedGaussianCorrectionFunctions::VExceedsMargin<Scalar>(Scalar, Scalar, Scalar); \
+    template Scalar TruncatedGaussianCorrectionFunctions::VExceedsMargin<Scalar>(Scalar, Scalar, GaussianAccuracy); \
+    template Scalar TruncatedGaussianCorrectionFunctions::VExceedsMargin<Scalar>(Scalar, Scalar, Scalar, GaussianAccuracy); \
+    template Scalar TruncatedGaussianCorrectionFunctions::WExceedsMargin<Scalar>(Scalar, Scalar); \
+    template Scalar TruncatedGaussianCorrectionFunctions::WExceedsMargin<Scalar>(Scalar, Scalar, Scalar); \
+    template Scalar TruncatedGaussianCorrectionFunctions::WExceedsMargin<Scalar>(Scalar, Scalar, GaussianAccuracy); \
+    template Scalar TruncatedGaussianCorrectionFunctions::WExceedsMargin<Scalar>(Scalar, Scalar, Scalar, GaussianAccuracy); \
+    template Scalar TruncatedGaussianCorrectionFunctions::VWithinMargin<Scalar>(Scalar, Scalar); \
+    template Scalar TruncatedGaussianCorrectionFunctions::VWithinMargin<Scalar>(Scalar, Scalar, Scalar); \
+    template Scalar TruncatedGaussianCorrectionFunctions::VWithinMargin<Scalar>(Scalar, Scalar, GaussianAccuracy); \
+    template Scalar TruncatedGaussianCorrectionFunctions::VWithinMargin<Scalar>(Scalar, Scalar, Scalar, GaussianAccuracy); \
+    template Scalar TruncatedGaussianCorrectionFunctions::WWithinMargin<Scalar>(Scalar, Scalar); \
+    template Scalar TruncatedGaussianCorrectionFunctions::WWithinMargin<Scalar>(Scalar, Scalar, Scalar); \
+    template Scalar TruncatedGaussianCorrectionFunctions::WWithinMargin<Scalar>(Scalar, Scalar, GaussianAccuracy); \
+    template Scalar TruncatedGaussianCorrectionFunctions::WWithinMargin<Scalar>(Scalar, Scalar, Scalar, GaussianAccuracy);
+
+INSTANTIATE_CORRECTION_FUNCTIONS(float)
+INSTANTIATE_CORRECTION_FUNCTIONS(double)
@@ -8,17 +8,29 @@
 
 #pragma once
 
+#include "GaussianAccuracy.h"
+
+// Instantiated for float and double in TruncatedGaussianCorrectionFunctions.cpp. The versions without an
+// accuracy run at GAUSSIAN_ACCURACY_FULL.
 namespace TruncatedGaussianCorrectionFunctions
 {
-    double VExceedsMargin(double teamPerformanceDifference, double drawMargin);
-    double VExceedsMargin(double teamPerformanceDifference, double drawMargin, double c);
+    template <class Scalar> Scalar VExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin);
+    template <class Scalar> Scalar VExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c);
+    template <class Scalar> Scalar VExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, GaussianAccuracy accuracy);
+    template <class Scalar> Scalar VExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c, GaussianAccuracy accuracy);
     
-    double WExceedsMargin(double teamPerformanceDifference, double drawMargin);
-    double WExceedsMargin(double teamPerformanceDifference, double drawMargin, double c);
+    template <class Scalar> Scalar WExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin);
+    template <class Scalar> Scalar WExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c);
+    template <class Scalar> Scalar WExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, GaussianAccuracy accuracy);
+    template <class Scalar> Scalar WExceedsMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c, GaussianAccuracy accuracy);
     
-    double VWithinMargin(double teamPerformanceDifference, double drawMargin);
-    double VWithinMargin(double teamPerformanceDifference, double drawMargin, double c);
+    template <class Scalar> Scalar VWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin);
+    template <class Scalar> Scalar VWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c);
+    template <class Scalar> Scalar VWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, GaussianAccuracy accuracy);
+    template <class Scalar> Scalar VWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c, GaussianAccuracy accuracy);
     
-    double WWithinMargin(double teamPerformanceDifference, double drawMargin);
-    double WWithinMargin(double teamPerformanceDifference, double drawMargin, double c);
-}
\ No newline at end of file
+    template <class Scalar> Scalar WWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin);
+    template <class Scalar> Scalar WWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c);
+    template <class Scalar> Scalar WWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, GaussianAccuracy accuracy);
+    template <class Scalar> Scalar WWithinMargin(Scalar teamPerformanceDifference, Scalar drawMargin, Scalar c, GaussianAccuracy accuracy);
+}
@@ -0,0 +1,125 @@
+//
+//  TruncatedGaussianCorrectionTables.cpp
+//  Skills
+//
+//  Created by KleMiX on 16/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#include "TruncatedGaussianCorrectionTables.h"
+
+#include <algorithm>
+
+constexpr double TruncatedGaussianCorrectionTables::EXCEEDS_MINIMUM;
+constexpr double TruncatedGaussianCorrectionTables::EXCEEDS_INVERSE_STEP;
+constexpr double TruncatedGaussianCorrectionTables::WITHIN_INVERSE_STEP;
+
+TruncatedGaussianCorrectionTables::TruncatedGaussianCorrectionTables(double minimumDrawMargin, double maximumDrawMargin)
+{
+    if (maximumDrawMargin <= minimumDrawMargin)
+    {
+        // a single margin still needs a cell to interpolate in
+        maximumDrawMargin = minimumDrawMargin + std::max(fabs(minimumDrawMargin) * 1e-6, 1e-12);
+    }
+
+    this->minimumDrawMargin = minimumDrawMargin;
+    this->maximumDrawMargin = maximumDrawMargin;
+    minimumDrawMarginSquared = minimumDrawMargin * minimumDrawMargin;
+    marginNodeCount = MARGIN_NODE_COUNT;
+    inverseMarginStep = (marginNodeCount - 1) / (maximumDrawMargin * maximumDrawMargin - minimumDrawMarginSquared);
+
+    // exceeds margin, only depends on x = teamPerformanceDifference - drawMargin
+    double exceedsStep = 1.0 / EXCEEDS_INVERSE_STEP;
+    exceedsNodes.resize(EXCEEDS_NODE_COUNT * NODE_STRIDE);
+    for (int i = 0; i < EXCEEDS_NODE_COUNT; i++)
+    {
+        double x = EXCEEDS_MINIMUM + i * exceedsStep;
+        double v = TruncatedGaussianCorrectionFunctions::VExceedsMargin(x, 0.0);
+        double w = TruncatedGaussianCorrectionFunctions::WExceedsMargin(x, 0.0);
+
+        // V' = -W, W' = V'(V + x) + V(V' + 1)
+        double* node = &exceedsNodes[i * NODE_STRIDE];
+        node[0] = v;
+        node[1] = -w * exceedsStep;
+        node[2] = w;
+        node[3] = (-w * (v + x) + v * (1.0 - w)) * exceedsStep;
+    }
+
+    // within margin, V is odd and W even in teamPerformanceDifference so only the positive half is stored
+    double withinStep = 1.0 / WITHIN_INVERSE_STEP;
+    double marginStep = 1.0 / inverseMarginStep;
+    double derivativeStep = 1e-5;
+    withinNodes.resize(marginNodeCount * WITHIN_NODE_COUNT * NODE_STRIDE);
+    for (int m = 0; m < marginNodeCount; m++)
+    {
+        double drawMargin = sqrt(minimumDrawMarginSquared + m * marginStep);
+        for (int i = 0; i < WITHIN_NODE_COUNT; i++)
+        {
+            double t = i * withinStep;
+            double v = TruncatedGaussianCorrectionFunctions::VWithinMargin(t, drawMargin);
+            double w = TruncatedGaussianCorrectionFunctions::WWithinMargin(t, drawMargin);
+
+            // no closed form that is worth it for W', a central difference is far below the interpolation error
+            double wDerivative = 0.0;
+            if (i > 0)
+            {
+                wDerivative = (TruncatedGaussianCorrectionFunctions::WWithinMargin(t + derivativeStep, drawMargin) -
+                               TruncatedGaussianCorrectionFunctions::WWithinMargin(t - derivativeStep, drawMargin)) / (2 * derivativeStep);
+            }
+
+            double* node = &withinNodes[(m * WITHIN_NODE_COUNT + i) * NODE_STRIDE];
+            node[0] = v;
+            node[1] = -w * withinStep;
+            node[2] = w;
+            node[3] = wDerivative * withinStep;
+        }
+    }
+}
+
+TruncatedGaussianCorrectionTables TruncatedGaussianCorrectionTables::ForGame(double drawMargin, double beta, double maximumStandardDeviation)
+{
+    double twoBetaSquared = 2 * beta * beta;
+    double minimumC = sqrt(twoBetaSquared);
+    double maximumC = sqrt(2 * maximumStandardDeviation * maximumStandardDeviation + twoBetaSquared);
+
+    return TruncatedGaussianCorrectionTables(drawMargin / maximumC, drawMargin / minimumC);
+}
+
+TruncatedGaussianCorrectionTables::MaximumError TruncatedGaussianCorrectionTables::MeasureMaximumError(int samplesPerCell) const
+{
+    MaximumError result = { 0, 0, 0, 0 };
+    double v;
+    double w;
+
+    for (int i = 0; i < EXCEEDS_NODE_COUNT - 1; i++)
+    {
+        for (int k = 0; k < samplesPerCell; k++)
+        {
+            double x = EXCEEDS_MINIMUM + (i + (double) k / samplesPerCell) / EXCEEDS_INVERSE_STEP;
+            ExceedsMargin(x, 0.0, v, w);
+            result.vExceedsMargin = std::max(result.vExceedsMargin, fabs(v - TruncatedGaussianCorrectionFunctions::VExceedsMargin(x, 0.0)));
+            result.wExceedsMargin = std::max(result.wExceedsMargin, fabs(w - TruncatedGaussianCorrectionFunctions::WExceedsMargin(x, 0.0)));
+        }
+    }
+
+    double marginStep = (maximumDrawMargin - minimumDrawMargin) / (marginNodeCount - 1);
+    for (int m = 0; m < marginNodeCount - 1; m++)
+    {
+        for (int j = 0; j < samplesPerCell; j++)
+        {
+            double drawMargin = minimumDrawMargin + (m + (double) j / samplesPerCell) * marginStep;
+            for (int i = 0; i < WITHIN_NODE_COUNT - 1; i++)
+            {
+                for (int k = 0; k < samplesPerCell; k++)
+                {
+                    double t = (i + (double) k / samplesPerCell) / WITHIN_INVERSE_STEP;
+                    WithinMargin(t, drawMargin, v, w);
+                    result.vWithinMargin = std::max(result.vWithinMargin, fabs(v - TruncatedGaussianCorrectionFunctions::VWithinMargin(t, drawMargin)));
+                    result.wWithinMargin = std::max(result.wWithinMargin, fabs(w - TruncatedGaussianCorrectionFunctions::WWithinMargin(t, drawMargin)));
+                }
+            }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,179 @@
+//
+//  TruncatedGaussianCorrectionTables.h
+//  Skills
+//
+//  Created by KleMiX on 16/02/14.
+//  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
+//
+
+#pragma once
+
+#include "TruncatedGaussianCorrectionFunctions.h"
+
+#include <math.h>
+#include <vector>
+
+// Table driven versions of the truncated Gaussian corrections. Arguments are already divided by c,
+// same as the two argument versions in TruncatedGaussianCorrectionFunctions.
+//
+// The exceeds-margin functions only depend on x = teamPerformanceDifference - drawMargin and are stored
+// as one dimensional cubic Hermite tables over x in [-24, 12]. The within-margin functions are stored over
+// |teamPerformanceDifference| in [0, 12] (cubic Hermite) and drawMargin^2 in the range given at construction
+// (quadratic, both corrections are even in drawMargin). V' = -W holds for both corrections, so only W'
+// needs extra work when building the tables. Anything outside the tables goes to the exact functions.
+//
+// Maximum absolute error against TruncatedGaussianCorrectionFunctions, measured with MeasureMaximumError
+// (16 samples per cell, 32 give the same) for the default game model tables (drawMargin in [0.0562, 0.1257])
+// and rounded up, AccuracyTest checks them:
+//   VExceedsMargin 6.3e-10, WExceedsMargin 1.2e-09, VWithinMargin 1.1e-08, WWithinMargin 5.5e-09
+// The exceeds bounds don't depend on the game, the within bounds grow with the cube of the margin range.
+class TruncatedGaussianCorrectionTables
+{
+public:
+    struct MaximumError
+    {
+        double vExceedsMargin;
+        double wExceedsMargin;
+        double vWithinMargin;
+        double wWithinMargin;
+    };
+
+    TruncatedGaussianCorrectionTables(double minimumDrawMargin, double maximumDrawMargin);
+
+    // Covers every normalized margin drawMargin/c of a game, c ranges from sqrt(2*beta^2) for two perfectly
+    // known players up to two players with maximumStandardDeviation
+    static TruncatedGaussianCorrectionTables ForGame(double drawMargin, double beta, double maximumStandardDeviation);
+
+    MaximumError MeasureMaximumError(int samplesPerCell) const;
+
+    inline void ExceedsMargin(double teamPerformanceDifference, double drawMargin, double& v, double& w) const
+    {
+        double position = (teamPerformanceDifference - drawMargin - EXCEEDS_MINIMUM) * EXCEEDS_INVERSE_STEP;
+        if (!(position >= 0.0 && position < EXCEEDS_NODE_COUNT - 1))
+        {
+            v = TruncatedGaussianCorrectionFunctions::VExceedsMargin(teamPerformanceDifference, drawMargin);
+            w = TruncatedGaussianCorrectionFunctions::WExceedsMargin(teamPerformanceDifference, drawMargin);
+            return;
+        }
+
+        int index = (int) position;
+        Interpolate(&exceedsNodes[index * NODE_STRIDE], position - index, v, w);
+    }
+
+    inline void WithinMargin(double teamPerformanceDifference, double drawMargin, double& v, double& w) const
+    {
+        double absoluteValue = fabs(teamPerformanceDifference);
+        double position = absoluteValue * WITHIN_INVERSE_STEP;
+        double marginPosition = (drawMargin * drawMargin - minimumDrawMarginSquared) * inverseMarginStep;
+        if (!(position < WITHIN_NODE_COUNT - 1 && marginPosition >= 0.0 && marginPosition <= marginNodeCount - 1))
+        {
+            v = TruncatedGaussianCorrectionFunctions::VWithinMargin(teamPerformanceDifference, drawMargin);
+            w = TruncatedGaussianCorrectionFunctions::WWithinMargin(teamPerformanceDifference, drawMargin);
+            return;
+        }
+
+        // quadratic through the three closest margin rows
+        int index = (int) position;
+        int marginIndex = (int) (marginPosition + 0.5) - 1;
+        marginIndex = marginIndex < 0 ? 0 : (marginIndex > marginNodeCount - 3 ? marginNodeCount - 3 : marginIndex);
+        double fraction = position - index;
+        double s = marginPosition - marginIndex;
+        double l0 = 0.5 * (s - 1) * (s - 2);
+        double l1 = s * (2 - s);
+        double l2 = 0.5 * s * (s - 1);
+
+        double v0, w0, v1, w1, v2, w2;
+        const double* row = &withinNodes[(marginIndex * WITHIN_NODE_COUNT + index) * NODE_STRIDE];
+        Interpolate(row, fraction, v0, w0);
+        Interpolate(row + WITHIN_NODE_COUNT * NODE_STRIDE, fraction, v1, w1);
+        Interpolate(row + 2 * WITHIN_NODE_COUNT * NODE_STRIDE, fraction, v2, w2);
+
+        v = l0*v0 + l1*v1 + l2*v2;
+        w = l0*w0 + l1*w1 + l2*w2;
+
+        if (teamPerformanceDifference < 0.0)
+        {
+            v = -v;
+        }
+    }
+
+    // Float pipeline, the tables themselves stay in double
+    inline void ExceedsMargin(float teamPerformanceDifference, float drawMargin, float& v, float& w) const
+    {
+        double doubleV, doubleW;
+        ExceedsMargin((double) teamPerformanceDifference, (double) drawMargin, doubleV, doubleW);
+        v = (float) doubleV;
+        w = (float) doubleW;
+    }
+
+    inline void WithinMargin(float teamPerformanceDifference, float drawMargin, float& v, float& w) const
+    {
+        double doubleV, doubleW;
+        WithinMargin((double) teamPerformanceDifference, (double) drawMargin, doubleV, doubleW);
+        v = (float) doubleV;
+        w = (float) doubleW;
+    }
+
+    double VExceedsMargin(double teamPerformanceDifference, double drawMargin) const
+    {
+        double v, w;
+        ExceedsMargin(teamPerformanceDifference, drawMargin, v, w);
+        return v;
+    }
+
+    double WExceedsMargin(double teamPerformanceDifference, double drawMargin) const
+    {
+        double v, w;
+        ExceedsMargin(teamPerformanceDifference, drawMargin, v, w);
+        return w;
+    }
+
+    double VWithinMargin(double teamPerformanceDifference, double drawMargin) const
+    {
+        double v, w;
+        WithinMargin(teamPerformanceDifference, drawMargin, v, w);
+        return v;
+    }
+
+    double WWithinMargin(double teamPerformanceDifference, double drawMargin) const
+    {
+        double v, w;
+        WithinMargin(teamPerformanceDifference, drawMargin, v, w);
+        return w;
+    }
+
+private:
+    static const int NODE_STRIDE = 4; // V, step*V', W, step*W'
+
+    static const int EXCEEDS_NODE_COUNT = 36 * 32 + 1;
+    static constexpr double EXCEEDS_MINIMUM = -24.0;
+    static constexpr double EXCEEDS_INVERSE_STEP = 32.0;
+
+    static const int WITHIN_NODE_COUNT = 12 * 32 + 1;
+    static constexpr double WITHIN_INVERSE_STEP = 32.0;
+
+    static const int MARGIN_NODE_COUNT = 33;
+
+    // cubic Hermite interpolation of V and W between two nodes, derivatives are stored pre-multiplied by the step
+    static inline void Interpolate(const double* node, double t, double& v, double& w)
+    {
+        double t2 = t * t;
+        double t3 = t2 * t;
+        double h00 = 2*t3 - 3*t2 + 1;
+        double h10 = t3 - 2*t2 + t;
+        double h01 = -2*t3 + 3*t2;
+        double h11 = t3 - t2;
+
+        v = h00*node[0] + h10*node[1] + h01*node[4] + h11*node[5];
+        w = h00*node[2] + h10*node[3] + h01*node[6] + h11*node[7];
+    }
+
+    double minimumDrawMargin;
+    double maximumDrawMargin;
+    double minimumDrawMarginSquared;
+    double inverseMarginStep;
+    int marginNodeCount;
+
+    std::vector<double> exceedsNodes;
+    std::vector<double> withinNodes;
+};
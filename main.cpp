@@ -6,107 +6,382 @@
 //  Copyright (c) 2014 Vsevolod Klemetjev. All rights reserved.
 //
 
-#include <iostream>
-#include "RatingCalculator.h"
-#include "GaussianDistribution.h"
+#include "PlayerTable.h"
+#include "ParallelReplay.h"
+#include "ConcurrentRatingStore.h"
+#include "ThreadPool.h"
 
-struct Player
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Load generator: rates a synthetic population whose true skills are known and reports how fast it goes
+// and how quickly the ratings find the true skills.
+//
+// Players get a true skill from N(mean, spread). Matches arrive in blocks of MATCHES_PER_BLOCK, every block
+// has a random generator seeded from the seed and the block index, so the history is the same whatever the
+// thread count. Players join over the run (--new-players of them aren't there at the start), how often a
+// player plays follows a power law (--activity-skew, 0 is uniform), and the opponent is the one closest in
+// true skill out of --matchmaking candidates, which is roughly what a matchmaker does once the ratings
+// settled. Performances add N(0, beta) noise to the true skills, a difference within the draw margin is a draw.
+//
+// By default the matches are applied with ParallelReplay, so the ratings and every accuracy figure are the
+// same for any thread count. --concurrent has the threads apply their blocks to a ConcurrentRatingStore at
+// the same time instead, the way a live service would; the order of the updates then depends on the timing.
+//
+//   Skills [--players n] [--matches n] [--threads n] [--seed n] [--spread x] [--activity-skew x]
+//          [--new-players fraction] [--matchmaking n] [--checkpoints n] [--concurrent]
+
+namespace
 {
-    Rating r;
-    int gamesWon;
-    int gamesLost;
-    int luck;
-    int points;
-    
-    Player()
-    {
-        r = Rating(25.0, 25.0 / 3.0);
-        gamesLost = 0;
-        gamesWon = 0;
-        luck = rand() % 10;
-        points = 100;
-    }
-    
-    void RegisterBattle(bool won, Player& opponent)
+    typedef std::chrono::steady_clock Clock;
+
+    const size_t MATCHES_PER_BLOCK = 65536;
+    const size_t PLAYERS_PER_BLOCK = 65536;
+
+    struct Options
     {
-        if (won)
+        size_t playerCount;
+        size_t matchCount;
+        size_t threadCount;
+        uint64_t seed;
+        double skillSpread;
+        double activitySkew;
+        double newPlayers;
+        int matchmakingCandidates;
+        size_t checkpointCount;
+        bool concurrent;
+
+        Options()
+        : playerCount(1000000), matchCount(10000000), threadCount(0), seed(1), skillSpread(25.0 / 3.0), activitySkew(0.5),
+          newPlayers(0.5), matchmakingCandidates(4), checkpointCount(10), concurrent(false)
         {
-            gamesWon++;
-            opponent.gamesLost++;
         }
-        else
+    };
+
+    // Independent streams for every block, whoever generates it
+    std::mt19937_64 BlockRandom(uint64_t seed, uint64_t stream, size_t block)
+    {
+        std::seed_seq sequence = { (uint32_t) seed, (uint32_t) (seed >> 32), (uint32_t) stream, (uint32_t) block, (uint32_t) (block >> 32) };
+        return std::mt19937_64(sequence);
+    }
+
+    void MakeSkills(const Options& options, const GameModel& model, std::vector<double>& skills, ThreadPool& pool)
+    {
+        skills.resize(options.playerCount);
+        size_t blockCount = (options.playerCount + PLAYERS_PER_BLOCK - 1) / PLAYERS_PER_BLOCK;
+        pool.ParallelFor(blockCount, 1, [&](size_t begin, size_t end)
         {
-            gamesLost++;
-            opponent.gamesWon++;
-        }
-        
-        // some very basic points system
-
-        double chance = RatingCalculator::CalculateWinChance(r, opponent.r); // chance to win
-        double diff = won ? (1.0 - chance) : chance; // invert pointing if we actually won
-        int pts = round(diff * 12.0); // max of 12 points per round - (1.0 chance to win with a lose or 0.0 chance to win with a win)
-        
-//        std::cout << won << " with chance of " << chance << (won ? " +" : " -") << pts << std::endl; // debug info
-        
-        // assign points
-        points += pts * (won ? 1 : -1);
-        points = std::max(points, 0);
-        
-        opponent.points += pts * (!won ? 1 : -1);
-        opponent.points = std::max(opponent.points, 0);
+            for (size_t block = begin; block < end; block++)
+            {
+                std::mt19937_64 random = BlockRandom(options.seed, 0, block);
+                std::normal_distribution<double> normal(model.initialMean, options.skillSpread);
+                size_t last = std::min((block + 1) * PLAYERS_PER_BLOCK, options.playerCount);
+                for (size_t i = block * PLAYERS_PER_BLOCK; i < last; i++)
+                {
+                    skills[i] = normal(random);
+                }
+            }
+        });
     }
-    
-    void PrintInfo()
+
+    // Players below the returned count have joined by the given match
+    size_t JoinedPlayers(const Options& options, size_t match)
     {
-         std::cout << "rating: " << r.mean << ", " << r.standardDeviation << ", total games: " << gamesLost + gamesWon << ", games won: " << gamesWon << ", games lost: " << gamesLost << ", points: " << points << std::endl;
+        double progress = options.matchCount > 0 ? (double) match / options.matchCount : 1.0;
+        size_t joined = (size_t) (options.playerCount * (1.0 - options.newPlayers * (1.0 - progress)));
+        return std::min(std::max(joined, (size_t) 2), options.playerCount);
     }
-};
 
-bool sortPlayers(const Player left, const Player right)
-{
-    double leftRating = left.r.ConservativeRating();
-    double rightRating = right.r.ConservativeRating();
-    
-    if (leftRating == rightRating)
-        return false;
-    return leftRating > rightRating;
-}
+    // Power law over the joined players, the ones that joined first play the most
+    int PickPlayer(const Options& options, std::mt19937_64& random, size_t joined)
+    {
+        double u = std::generate_canonical<double, 64>(random);
+        size_t player = (size_t) (joined * pow(u, 1.0 / (1.0 - options.activitySkew)));
+        return (int) std::min(player, joined - 1);
+    }
 
-int main(int argc, const char * argv[])
-{
-    const int PLAYER_COUNT = 256;
-    const int ATTACKS_COUNT = 100;
-    Player players[PLAYER_COUNT];
-    
-    for (int i = 0; i < PLAYER_COUNT; i++)
+    void MakeBlock(const Options& options, const GameModel& model, const std::vector<double>& skills, size_t block, MatchRecord* matches)
+    {
+        std::mt19937_64 random = BlockRandom(options.seed, 1, block);
+        std::normal_distribution<double> performance(0.0, model.beta);
+
+        size_t first = block * MATCHES_PER_BLOCK;
+        size_t count = std::min(MATCHES_PER_BLOCK, options.matchCount - first);
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t joined = JoinedPlayers(options, first + i);
+            int player1 = PickPlayer(options, random, joined);
+
+            int player2 = -1;
+            double closest = 0;
+            for (int candidate = 0; candidate < options.matchmakingCandidates || player2 < 0; candidate++)
+            {
+                int opponent = PickPlayer(options, random, joined);
+                double distance = fabs(skills[opponent] - skills[player1]);
+                if (opponent != player1 && (player2 < 0 || distance < closest))
+                {
+                    player2 = opponent;
+                    closest = distance;
+                }
+            }
+
+            double difference = skills[player1] + performance(random) - (skills[player2] + performance(random));
+            bool draw = fabs(difference) <= model.drawMargin;
+            matches[i] = MatchRecord(player1, player2, draw || difference > 0 ? 1 : 0, draw || difference < 0 ? 1 : 0);
+        }
+    }
+
+    void MakeMatches(const Options& options, const GameModel& model, const std::vector<double>& skills, std::vector<MatchRecord>& matches,
+                     ThreadPool& pool)
+    {
+        matches.resize(options.matchCount);
+        size_t blockCount = (options.matchCount + MATCHES_PER_BLOCK - 1) / MATCHES_PER_BLOCK;
+        pool.ParallelFor(blockCount, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t block = begin; block < end; block++)
+            {
+                MakeBlock(options, model, skills, block, &matches[block * MATCHES_PER_BLOCK]);
+            }
+        });
+    }
+
+    struct Accuracy
     {
-        players[i] = Player();
+        size_t ratedPlayers;
+        double meanError;               // root mean square of mean - true skill
+        double rankCorrelation;         // Spearman, means against true skills
+        double averageStandardDeviation;
+    };
+
+    void Rank(const std::vector<double>& values, std::vector<int>& order, std::vector<double>& ranks)
+    {
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = (int) i;
+        }
+        std::sort(order.begin(), order.end(), [&](int left, int right)
+        {
+            return values[left] < values[right] || (values[left] == values[right] && left < right);
+        });
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            ranks[order[i]] = (double) i;
+        }
     }
 
-    for (int i = 0; i < PLAYER_COUNT; i++)
+    // Over the players that played at least once
+    Accuracy MeasureAccuracy(const PlayerTable& table, const std::vector<double>& skills)
     {
-        for (int j = 0; j < ATTACKS_COUNT; j++) // every player will do max 15 attacks against some other players
+        std::vector<double> means;
+        std::vector<double> trueSkills;
+        Accuracy accuracy;
+        double squaredError = 0;
+        double standardDeviations = 0;
+        for (size_t i = 0; i < table.Size(); i++)
         {
-            Player& opponent = players[rand() % PLAYER_COUNT];
-            if (&opponent != &players[i])
+            if (table.GamesPlayed((int) i) == 0)
             {
-                bool won = players[i].luck >= opponent.luck;//rand() % 2 == 1;
+                continue;
+            }
 
-                players[i].RegisterBattle(won, opponent);
-                
-                RatingCalculator::CalculateNewRatings(players[i].r, opponent.r, won ? 1 : 0, won ? 0 : 1);
+            double error = table.ratings.mean[i] - skills[i];
+            squaredError += error * error;
+            standardDeviations += table.ratings.standardDeviation[i];
+            means.push_back(table.ratings.mean[i]);
+            trueSkills.push_back(skills[i]);
+        }
+
+        size_t count = means.size();
+        accuracy.ratedPlayers = count;
+        accuracy.meanError = count > 0 ? sqrt(squaredError / count) : 0;
+        accuracy.averageStandardDeviation = count > 0 ? standardDeviations / count : 0;
+        accuracy.rankCorrelation = 0;
+        if (count > 1)
+        {
+            std::vector<int> order(count);
+            std::vector<double> meanRanks(count);
+            std::vector<double> skillRanks(count);
+            Rank(means, order, meanRanks);
+            Rank(trueSkills, order, skillRanks);
+
+            double squaredRankDifferences = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                squaredRankDifferences += (meanRanks[i] - skillRanks[i]) * (meanRanks[i] - skillRanks[i]);
             }
+            accuracy.rankCorrelation = 1.0 - 6.0 * squaredRankDifferences / ((double) count * ((double) count * count - 1));
         }
+        return accuracy;
     }
-    
-    std::sort(players, players + PLAYER_COUNT, sortPlayers);
-    
-    for (int i = 0; i < PLAYER_COUNT; i++)
+
+    // Share of the decided matches the player with the higher mean won, taken before the matches are applied.
+    // Negative when no match had different means.
+    double PredictionRate(const PlayerTable& table, const MatchRecord* matches, size_t matchCount)
     {
-        std::cout << "Player " << i+1 << " (" << players[i].r.ConservativeRating() << "): ";
-        players[i].PrintInfo();
+        size_t decided = 0;
+        size_t predicted = 0;
+        for (size_t i = 0; i < matchCount; i++)
+        {
+            const MatchRecord& match = matches[i];
+            double mean1 = table.ratings.mean[match.player1];
+            double mean2 = table.ratings.mean[match.player2];
+            if (match.rank1 == match.rank2 || mean1 == mean2)
+            {
+                continue;
+            }
+
+            decided++;
+            predicted += (mean1 > mean2) == (match.rank1 > match.rank2) ? 1 : 0;
+        }
+        return decided > 0 ? (double) predicted / decided : -1;
+    }
+
+    void ApplyConcurrently(ConcurrentRatingStore& store, const MatchRecord* matches, size_t matchCount, ThreadPool& pool)
+    {
+        pool.ParallelFor(matchCount, MATCHES_PER_BLOCK / 16, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                store.CalculateNewRatings((uint64_t) matches[i].player1, (uint64_t) matches[i].player2, matches[i].rank1, matches[i].rank2);
+            }
+        });
+    }
+
+    void CopyStore(const ConcurrentRatingStore& store, PlayerTable& table)
+    {
+        for (size_t i = 0; i < table.Size(); i++)
+        {
+            table.SetRating((int) i, store.Get((uint64_t) i));
+        }
+    }
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    void PrintUsage()
+    {
+        printf("usage: Skills [--players n] [--matches n] [--threads n] [--seed n] [--spread x] [--activity-skew x]\n"
+               "              [--new-players fraction] [--matchmaking n] [--checkpoints n] [--concurrent]\n");
     }
-    
-    return 0;
 }
 
+int main(int argc, const char * argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--players") == 0 && hasValue)
+        {
+            options.playerCount = std::max((size_t) atol(argv[++i]), (size_t) 2);
+        }
+        else if (strcmp(argv[i], "--matches") == 0 && hasValue)
+        {
+            options.matchCount = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            options.threadCount = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+        {
+            options.seed = (uint64_t) strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--spread") == 0 && hasValue)
+        {
+            options.skillSpread = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--activity-skew") == 0 && hasValue)
+        {
+            options.activitySkew = std::min(std::max(atof(argv[++i]), 0.0), 0.99);
+        }
+        else if (strcmp(argv[i], "--new-players") == 0 && hasValue)
+        {
+            options.newPlayers = std::min(std::max(atof(argv[++i]), 0.0), 1.0);
+        }
+        else if (strcmp(argv[i], "--matchmaking") == 0 && hasValue)
+        {
+            options.matchmakingCandidates = std::max(atoi(argv[++i]), 1);
+        }
+        else if (strcmp(argv[i], "--checkpoints") == 0 && hasValue)
+        {
+            options.checkpointCount = std::max((size_t) atol(argv[++i]), (size_t) 1);
+        }
+        else if (strcmp(argv[i], "--concurrent") == 0)
+        {
+            options.concurrent = true;
+        }
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    const GameModel& model = GameModel::Default();
+    ThreadPool pool(options.threadCount);
+
+    Clock::time_point start = Clock::now();
+    std::vector<double> skills;
+    std::vector<MatchRecord> matches;
+    MakeSkills(options, model, skills, pool);
+    MakeMatches(options, model, skills, matches, pool);
+    double generationSeconds = SecondsSince(start);
+
+    printf("%zu players, %zu matches, %zu threads, seed %llu, %s\n", options.playerCount, matches.size(), pool.ThreadCount(),
+           (unsigned long long) options.seed, options.concurrent ? "ConcurrentRatingStore" : "ParallelReplay");
+    printf("generated in %.2f s\n\n", generationSeconds);
+
+    PlayerTable table(model);
+    table.Resize(options.playerCount);
+    ConcurrentRatingStore* store = options.concurrent ? new ConcurrentRatingStore(model, options.playerCount) : NULL;
+
+    printf("%12s %10s %12s %10s %10s %10s %10s\n", "matches", "players", "updates/s", "predicted", "rms error", "rank corr", "avg sd");
+
+    size_t interval = std::max((matches.size() + options.checkpointCount - 1) / options.checkpointCount, (size_t) 1);
+    double updateSeconds = 0;
+    for (size_t first = 0; first < matches.size(); first += interval)
+    {
+        size_t count = std::min(interval, matches.size() - first);
+        double predicted = PredictionRate(table, &matches[first], count);
+
+        Clock::time_point checkpointStart = Clock::now();
+        if (store)
+        {
+            ApplyConcurrently(*store, &matches[first], count, pool);
+        }
+        else
+        {
+            ParallelReplay::CalculateNewRatings(model, table.ratings, &matches[first], count, pool);
+        }
+        double seconds = SecondsSince(checkpointStart);
+        updateSeconds += seconds;
+
+        if (store)
+        {
+            CopyStore(*store, table);
+        }
+        table.RecordResults(&matches[first], count);
+
+        Accuracy accuracy = MeasureAccuracy(table, skills);
+        char predictedText[16];
+        snprintf(predictedText, sizeof(predictedText), predicted < 0 ? "-" : "%.2f%%", predicted * 100);
+        printf("%12zu %10zu %12.0f %10s %10.4f %10.4f %10.4f\n", first + count, accuracy.ratedPlayers,
+               seconds > 0 ? 2.0 * count / seconds : 0.0, predictedText, accuracy.meanError, accuracy.rankCorrelation,
+               accuracy.averageStandardDeviation);
+    }
+
+    printf("\n%.0f updates/s overall, %.2f s updating\n", updateSeconds > 0 ? 2.0 * matches.size() / updateSeconds : 0.0, updateSeconds);
+
+    delete store;
+    return 0;
+}